@@ -0,0 +1,639 @@
+// Micro-benchmarks for the page table and replacement hot paths.
+// Standalone program, not part of pagingwithpr (see README "Benchmarks").
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <vector>
+#include <unistd.h>
+#include "pagetable.h"
+#include "pagetable_walk.h"
+#include "replacement.h"
+#include "simulator.h"
+#include "vaddr_tracereader.h"
+
+// Heap allocations made through operator new (page table arenas use
+// malloc and are counted from their slab lists instead)
+static unsigned long long allocationCount = 0;
+
+void *operator new(size_t bytes)
+{
+    allocationCount++;
+    void *p = malloc(bytes ? bytes : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+// Benchmark tables translate 32-bit addresses in every build (a
+// PAGING_VA64 build then times the generic walk for "fixed")
+static const unsigned int BENCH_ADDRESS_BITS = 32;
+
+// Small deterministic PRNG so runs are comparable
+static uint32_t xorshift32(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static double nowNs()
+{
+    using namespace std::chrono;
+    return (double)duration_cast<nanoseconds>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+// Time findLoadedVPN + noteFrameAccess over a pre-generated VPN stream
+static double timeResidentLookups(ReplacementState &rs,
+                                  const std::vector<unsigned int> &vpns)
+{
+    unsigned long long found = 0;
+    double start = nowNs();
+    for (unsigned int vpn : vpns) {
+        tickReplacementClock(rs);
+        int slot = findLoadedVPN(rs, vpn);
+        if (slot >= 0) {
+            noteFrameAccess(rs, vpn, slot);
+            found++;
+        }
+    }
+    double elapsed = nowNs() - start;
+
+    if (found != vpns.size()) {
+        fprintf(stderr, "resident lookup missed %llu pages\n",
+                (unsigned long long)vpns.size() - found);
+    }
+    return elapsed / vpns.size();
+}
+
+// Per-access cost of the resident-page lookup with every frame in use.
+// "hot" draws from a cache-resident subset of the frames, so it shows the
+// algorithmic cost; "uniform" draws from all frames and adds cache misses.
+static void benchResidentLookup(unsigned int frames, unsigned int accesses)
+{
+    // 20 VPN bits covers the 1M frame case
+    const unsigned int levelBits[] = {8, 6, 6};
+    PageTable *pt = createPageTable(3, levelBits, PT_RADIX, BENCH_ADDRESS_BITS);
+
+    // Aging interval is pushed out so the sweep does not dominate
+    ReplacementState rs;
+    initReplacementState(rs, frames, 0xFFFFFFFFu);
+
+    bool didFault, didEvict;
+    vaddr_t evictedVPN;
+    uint16_t evictedAgeBits;
+    for (unsigned int vpn = 0; vpn < frames; vpn++) {
+        unsigned int va = vpn << pt->offsetBits;
+        tickReplacementClock(rs);
+        ensureResidentPage(pt, rs, va, vpn, didFault, didEvict,
+                           evictedVPN, evictedAgeBits);
+    }
+
+    // Pre-generate the access streams so only the lookup is timed
+    const unsigned int hotPages = 1024;
+    std::vector<unsigned int> hot(accesses), uniform(accesses);
+    uint32_t seed = 0x9E3779B9u;
+    for (unsigned int i = 0; i < accesses; i++) {
+        // Spread the hot set across the whole frame range
+        unsigned int h = xorshift32(seed) % hotPages;
+        hot[i] = (unsigned int)(((unsigned long long)h * frames) / hotPages);
+        uniform[i] = xorshift32(seed) % frames;
+    }
+
+    double hotNs = timeResidentLookups(rs, hot);
+    double uniformNs = timeResidentLookups(rs, uniform);
+
+    printf("%10u frames  %8.2f ns/access hot  %8.2f ns/access uniform\n",
+           frames, hotNs, uniformNs);
+
+    destroyPageTable(pt);
+}
+
+// Per-miss cost of ensureResidentPage once memory is full, so every miss
+// evicts. Aging runs every bitInterval accesses, after which the oldest
+// band of frames is heaped again for the next victim; the stream mixes
+// hits on resident pages with misses on fresh VPNs.
+static void benchEviction(unsigned int frames, unsigned int accesses,
+                          unsigned int bitInterval)
+{
+    // 24 VPN bits leaves room for fresh pages beyond 1M frames
+    const unsigned int levelBits[] = {8, 8, 8};
+    PageTable *pt = createPageTable(3, levelBits, PT_RADIX, BENCH_ADDRESS_BITS);
+
+    ReplacementState rs;
+    initReplacementState(rs, frames, bitInterval);
+
+    bool didFault, didEvict;
+    vaddr_t evictedVPN;
+    uint16_t evictedAgeBits;
+    unsigned int nextVPN = 0;
+    for (; nextVPN < frames; nextVPN++) {
+        tickReplacementClock(rs);
+        ensureResidentPage(pt, rs, nextVPN << pt->offsetBits, nextVPN,
+                           didFault, didEvict, evictedVPN, evictedAgeBits);
+    }
+
+    unsigned int evictions = 0;
+    uint32_t seed = 0x2545F491u;
+    double start = nowNs();
+    for (unsigned int i = 0; i < accesses; i++) {
+        tickReplacementClock(rs);
+
+        // One access in four faults in a page never seen before
+        unsigned int vpn;
+        if ((xorshift32(seed) & 3) == 0) {
+            vpn = nextVPN++ & 0xFFFFFFu;
+        } else {
+            vpn = rs.frameVPN[xorshift32(seed) % frames];
+        }
+
+        int pfn = ensureResidentPage(pt, rs, vpn << pt->offsetBits, vpn,
+                                     didFault, didEvict,
+                                     evictedVPN, evictedAgeBits);
+        noteFrameAccess(rs, vpn, pfn);
+        if (didEvict) evictions++;
+    }
+    double elapsed = nowNs() - start;
+
+    printf("%10u frames  %8.2f ns/access  (%u evictions)\n",
+           frames, elapsed / accesses, evictions);
+
+    destroyPageTable(pt);
+}
+
+// Cost of aging (the -b 1 hot spot) with every frame in use: the accesses
+// of an interval, which catch up each accessed frame's bitstring, and the
+// pass that ends it. Roughly half the frames, or 64, are accessed per
+// interval; aging is lazy, so the pass itself is constant time.
+static void benchAging(unsigned int frames, unsigned int passes)
+{
+    const unsigned int levelBits[] = {8, 6, 6};
+    PageTable *pt = createPageTable(3, levelBits, PT_RADIX, BENCH_ADDRESS_BITS);
+
+    ReplacementState rs;
+    initReplacementState(rs, frames, 0xFFFFFFFFu);
+
+    bool didFault, didEvict;
+    vaddr_t evictedVPN;
+    uint16_t evictedAgeBits;
+    for (unsigned int vpn = 0; vpn < frames; vpn++) {
+        ensureResidentPage(pt, rs, vpn << pt->offsetBits, vpn,
+                           didFault, didEvict, evictedVPN, evictedAgeBits);
+    }
+
+    // Pre-generate each interval's accessed frames so only aging is timed
+    uint32_t seed = 0x6C078965u;
+    std::vector<unsigned int> half, few;
+    for (unsigned int f = 0; f < frames; f++) {
+        if (xorshift32(seed) & 1) half.push_back(f);
+    }
+    for (unsigned int i = 0; i < 64; i++) {
+        few.push_back(xorshift32(seed) % frames);
+    }
+
+    double halfNs = 0, fewNs = 0;
+    for (unsigned int p = 0; p < passes; p++) {
+        const std::vector<unsigned int> &accessed = (p & 1) ? few : half;
+        double start = nowNs();
+        for (unsigned int f : accessed) {
+            noteFrameAccess(rs, rs.frameVPN[f], (int)f);
+        }
+        performAgingUpdate(rs);
+        double elapsed = nowNs() - start;
+        if (p & 1) fewNs += elapsed; else halfNs += elapsed;
+    }
+
+    printf("%10u frames  %8.3f ns/frame (half accessed)  %10.1f ns/interval (64 accessed)\n",
+           frames, halfNs / ((double)(passes / 2) * frames), fewNs / (passes / 2));
+
+    destroyPageTable(pt);
+}
+
+// Time searchMappedPfn over a pre-generated address stream
+static double timeWalks(PageTable *pt, const std::vector<vaddr_t> &vas)
+{
+    unsigned long long found = 0;
+    double start = nowNs();
+    for (vaddr_t va : vas) {
+        if (searchMappedPfn(pt, va)) found++;
+    }
+    double elapsed = nowNs() - start;
+
+    if (found != vas.size()) {
+        fprintf(stderr, "walk missed %llu pages\n",
+                (unsigned long long)vas.size() - found);
+    }
+    return elapsed / vas.size();
+}
+
+// Time searchMappedPfnBatch over the same stream, 32 addresses at a time
+static double timeBatchWalks(PageTable *pt, const std::vector<vaddr_t> &vas)
+{
+    const size_t window = 32;
+    Map *maps[window];
+    unsigned long long found = 0;
+    double start = nowNs();
+    for (size_t r = 0; r < vas.size(); r += window) {
+        size_t n = vas.size() - r < window ? vas.size() - r : window;
+        searchMappedPfnBatch(pt, &vas[r], n, maps);
+        for (size_t i = 0; i < n; i++) {
+            if (maps[i]) found++;
+        }
+    }
+    double elapsed = nowNs() - start;
+
+    if (found != vas.size()) {
+        fprintf(stderr, "batched walk missed %llu pages\n",
+                (unsigned long long)vas.size() - found);
+    }
+    return elapsed / vas.size();
+}
+
+// Level split as written on the command line, e.g. "4/8/8"
+static void formatSplit(char *split, size_t size, unsigned int levelCount,
+                        const unsigned int levelBits[])
+{
+    int len = 0;
+    for (unsigned int i = 0; i < levelCount; i++) {
+        len += snprintf(split + len, size - len, "%s%u",
+                        i ? "/" : "", levelBits[i]);
+    }
+}
+
+// Per-lookup cost of the generic, specialized and batched page table
+// walks over the same table, with pages pages mapped and accessed at random
+static void benchWalk(unsigned int levelCount, const unsigned int levelBits[],
+                      unsigned int pages, unsigned int accesses)
+{
+    PageTable *pt = createPageTable(levelCount, levelBits, PT_RADIX,
+                                    BENCH_ADDRESS_BITS);
+    const PageTableWalk *walk = findPageTableWalk(levelCount, levelBits,
+                                                 BENCH_ADDRESS_BITS);
+
+    unsigned int vpnBits = pt->addressBits - pt->offsetBits;
+    uint32_t seed = 0x1B873593u;
+    std::vector<vaddr_t> mapped(pages);
+    for (unsigned int i = 0; i < pages; i++) {
+        unsigned int vpn = xorshift32(seed) & ((1u << vpnBits) - 1);
+        mapped[i] = vpn << pt->offsetBits;
+        insertMapForVpn2Pfn(pt, mapped[i], (int)i);
+    }
+
+    std::vector<vaddr_t> vas(accesses);
+    for (unsigned int i = 0; i < accesses; i++) {
+        vas[i] = mapped[xorshift32(seed) % pages];
+    }
+
+    double genericNs = timeWalks(pt, vas);
+    double batchNs = timeBatchWalks(pt, vas);
+    pt->walk = walk;
+    double fixedNs = timeWalks(pt, vas);
+
+    char split[64];
+    formatSplit(split, sizeof(split), levelCount, levelBits);
+    printf("%10s  %8.2f ns/walk generic  %8.2f ns/walk fixed  "
+           "%8.2f ns/walk batched\n",
+           split, genericNs, fixedNs, batchNs);
+
+    destroyPageTable(pt);
+}
+
+// Synthetic traces over a region of pages distinct pages, as virtual
+// addresses with 4 KB pages
+static const unsigned int SYNTH_OFFSET_BITS = 12;
+static const unsigned int SYNTH_VPN_MASK = (1u << (32 - SYNTH_OFFSET_BITS)) - 1;
+
+// Spread page numbers over the whole VPN space (an odd multiplier is a
+// bijection mod 2^20), so random pages do not all share one subtree
+static unsigned int scatterPage(unsigned int page)
+{
+    return (page * 0x9E3B1u) & SYNTH_VPN_MASK;
+}
+
+static unsigned int pageAddress(unsigned int vpn, uint32_t &seed)
+{
+    return (vpn << SYNTH_OFFSET_BITS) |
+           (xorshift32(seed) & ((1u << SYNTH_OFFSET_BITS) - 1));
+}
+
+// Walk the region a cache line at a time: 64 accesses per page
+static void genSequential(std::vector<vaddr_t> &vas, unsigned int pages,
+                          uint32_t &)
+{
+    unsigned long long regionBytes = (unsigned long long)pages << SYNTH_OFFSET_BITS;
+    for (size_t i = 0; i < vas.size(); i++) {
+        vas[i] = (unsigned int)(((unsigned long long)i * 64) % regionBytes);
+    }
+}
+
+// Every access a new page, 17 pages apart, wrapping around the region
+static void genStrided(std::vector<vaddr_t> &vas, unsigned int pages,
+                       uint32_t &seed)
+{
+    for (size_t i = 0; i < vas.size(); i++) {
+        unsigned int page = (unsigned int)(((unsigned long long)i * 17) % pages);
+        vas[i] = pageAddress(page, seed);
+    }
+}
+
+// Every page equally likely
+static void genUniform(std::vector<vaddr_t> &vas, unsigned int pages,
+                       uint32_t &seed)
+{
+    for (size_t i = 0; i < vas.size(); i++) {
+        vas[i] = pageAddress(scatterPage(xorshift32(seed) % pages), seed);
+    }
+}
+
+// Page of rank k drawn with probability proportional to 1 / k^0.99
+static void genZipfian(std::vector<vaddr_t> &vas, unsigned int pages,
+                       uint32_t &seed)
+{
+    std::vector<double> cdf(pages);
+    double sum = 0;
+    for (unsigned int k = 0; k < pages; k++) {
+        sum += 1.0 / pow((double)(k + 1), 0.99);
+        cdf[k] = sum;
+    }
+    for (size_t i = 0; i < vas.size(); i++) {
+        double u = (double)(xorshift32(seed) >> 8) / 16777216.0 * sum;
+        unsigned int rank = (unsigned int)(
+            std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+        if (rank >= pages) rank = pages - 1;
+        vas[i] = pageAddress(scatterPage(rank), seed);
+    }
+}
+
+// Cycle through the region one access per page, the LRU worst case
+// whenever it does not fit in memory
+static void genLoop(std::vector<vaddr_t> &vas, unsigned int pages,
+                    uint32_t &seed)
+{
+    for (size_t i = 0; i < vas.size(); i++) {
+        vas[i] = pageAddress(scatterPage((unsigned int)(i % pages)), seed);
+    }
+}
+
+struct TraceGenerator {
+    const char *name;
+    void (*generate)(std::vector<vaddr_t> &vas, unsigned int pages,
+                     uint32_t &seed);
+};
+
+static const TraceGenerator traceGenerators[] = {
+    { "sequential", genSequential },
+    { "strided",    genStrided },
+    { "uniform",    genUniform },
+    { "zipfian",    genZipfian },
+    { "loop",       genLoop },
+};
+
+// Resident set size of this process, in KB (0 where /proc is unavailable)
+static long currentRssKb()
+{
+    long pagesResident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%*s %ld", &pagesResident) != 1) pagesResident = 0;
+        fclose(f);
+    }
+    return pagesResident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Slabs and payload bytes held by the page table arenas
+static void arenaUsage(const PageTable *pt, unsigned long long &slabs,
+                       unsigned long long &bytes)
+{
+    slabs = 0;
+    bytes = 0;
+    for (unsigned int i = 0; i < pt->levelCount; i++) {
+        for (ArenaSlab *s = pt->arenas[i].slabs; s; s = s->next) slabs++;
+        bytes += pt->arenas[i].bytesReserved;
+    }
+}
+
+// Label for a page table: its level split ("s" appended for sparse
+// levels), or "hash" for the hashed backend
+static void formatTable(char *label, size_t size, unsigned int levelCount,
+                        const unsigned int levelBits[], PageTableBackend backend)
+{
+    if (backend == PT_HASHED) {
+        snprintf(label, size, "hash");
+        return;
+    }
+    formatSplit(label, size, levelCount, levelBits);
+    if (backend == PT_SPARSE) {
+        size_t len = strlen(label);
+        snprintf(label + len, size - len, "s");
+    }
+}
+
+// Per-access cost of building the table from the trace (a search, and an
+// insert on first touch) and of searching it once every page is mapped
+static void benchTableOps(const std::vector<vaddr_t> &vas,
+                          unsigned int levelCount, const unsigned int levelBits[],
+                          PageTableBackend backend)
+{
+    PageTable *pt = createPageTable(levelCount, levelBits, backend,
+                                    BENCH_ADDRESS_BITS);
+    pt->walk = findPageTableWalk(levelCount, levelBits, BENCH_ADDRESS_BITS);
+
+    int nextFrame = 0;
+    double start = nowNs();
+    for (vaddr_t va : vas) {
+        if (!searchMappedPfn(pt, va)) insertMapForVpn2Pfn(pt, va, nextFrame++);
+    }
+    double buildNs = (nowNs() - start) / vas.size();
+    double searchNs = timeWalks(pt, vas);
+
+    char split[64];
+    formatTable(split, sizeof(split), levelCount, levelBits, backend);
+    printf("%10s  %8.2f ns/access build  %8.2f ns/access search  "
+           "%6d pages  %8zu KB table\n",
+           split, buildNs, searchNs, nextFrame, pageTableBytes(pt) / 1024);
+
+    destroyPageTable(pt);
+}
+
+// Per-access cost of demand paging alone (search, then ensureResidentPage
+// on a miss) and of the summary-mode main loop (simulateBatch), with
+// frames frames. Allocations are those made by the main loop run, and
+// RSS is the whole process while that simulator is still alive.
+static void benchWorkload(const std::vector<vaddr_t> &vas,
+                          const std::vector<p2AddrTr> &records,
+                          unsigned int levelCount, const unsigned int levelBits[],
+                          PageTableBackend backend,
+                          unsigned int frames, unsigned int bitInterval)
+{
+    PageTable *pt = createPageTable(levelCount, levelBits, backend,
+                                    BENCH_ADDRESS_BITS);
+    pt->walk = findPageTableWalk(levelCount, levelBits, BENCH_ADDRESS_BITS);
+    ReplacementState rs;
+    initReplacementState(rs, frames, bitInterval);
+
+    bool didFault, didEvict;
+    vaddr_t evictedVPN;
+    uint16_t evictedAgeBits;
+    double start = nowNs();
+    for (vaddr_t va : vas) {
+        tickReplacementClock(rs);
+        unsigned int vpn = getFullVPN(pt, va);
+        Map *m = searchMappedPfn(pt, va);
+        int pfn = m ? mapFrameNumber(*m)
+                    : ensureResidentPage(pt, rs, va, vpn, didFault, didEvict,
+                                         evictedVPN, evictedAgeBits);
+        noteFrameAccess(rs, vpn, pfn);
+    }
+    double residentNs = (nowNs() - start) / vas.size();
+    destroyPageTable(pt);
+
+    unsigned long long allocsBefore = allocationCount;
+    start = nowNs();
+    Simulator *sim = createSimulator(levelCount, levelBits, frames,
+                                     bitInterval, nullptr, 0, 4, false, backend,
+                                     BENCH_ADDRESS_BITS);
+    const size_t window = 4096;
+    for (size_t r = 0; r < records.size(); r += window) {
+        size_t n = records.size() - r < window ? records.size() - r : window;
+        simulateBatch(*sim, &records[r], n);
+    }
+    double loopNs = (nowNs() - start) / records.size();
+
+    unsigned long long slabs, bytes;
+    arenaUsage(sim->pt, slabs, bytes);
+    unsigned long long allocs = allocationCount - allocsBefore + slabs;
+    long rss = currentRssKb();
+    double hitPercent = 100.0 * sim->stats.hits / sim->stats.addressesProcessed;
+
+    char split[64];
+    formatTable(split, sizeof(split), levelCount, levelBits, backend);
+    printf("%10s %8u frames  %8.2f ns/access resident  %8.2f ns/access loop  "
+           "%6.2f%% hits  %6llu allocs  %8ld KB RSS\n",
+           split, frames, residentNs, loopNs, hitPercent, allocs, rss);
+
+    destroySimulator(sim);
+}
+
+// Every synthetic generator against a few level splits and frame counts.
+// Memory is smaller than the region for all of them, so the miss-heavy
+// streams evict constantly.
+static void benchSynthetic(unsigned int accesses, unsigned int bitInterval)
+{
+    const unsigned int pages = 1u << 16;
+    const unsigned int split20[] = {20};
+    const unsigned int split812[] = {8, 12};
+    const unsigned int split488[] = {4, 8, 8};
+    const unsigned int split44444[] = {4, 4, 4, 4, 4};
+    struct {
+        unsigned int levelCount;
+        const unsigned int *levelBits;
+        PageTableBackend backend;
+    } splits[] = {
+        { 1, split20, PT_RADIX }, { 2, split812, PT_RADIX },
+        { 3, split488, PT_RADIX }, { 5, split44444, PT_RADIX },
+        { 3, split488, PT_SPARSE }, { 5, split44444, PT_SPARSE },
+        { 1, split20, PT_HASHED },
+    };
+
+    std::vector<vaddr_t> vas(accesses);
+    std::vector<p2AddrTr> records(accesses);
+    for (const TraceGenerator &gen : traceGenerators) {
+        uint32_t seed = 0x85EBCA6Bu;
+        gen.generate(vas, pages, seed);
+        for (unsigned int i = 0; i < accesses; i++) {
+            memset(&records[i], 0, sizeof(p2AddrTr));
+            records[i].addr = vas[i];
+        }
+
+        printf("%s, %u pages\n", gen.name, pages);
+        for (const auto &s : splits) {
+            benchTableOps(vas, s.levelCount, s.levelBits, s.backend);
+        }
+        for (const auto &s : splits) {
+            for (unsigned int frames = 1024; frames <= 8192; frames <<= 3) {
+                benchWorkload(vas, records, s.levelCount, s.levelBits,
+                              s.backend, frames, bitInterval);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int accesses = 2000000;
+    if (argc > 1) {
+        accesses = (unsigned int) atoi(argv[1]);
+        if (accesses < 1) {
+            fprintf(stderr, "Number of accesses must be greater than 0\n");
+            return 1;
+        }
+    }
+    // Optional section name runs just that section
+    const char *only = argc > 2 ? argv[2] : nullptr;
+    auto run = [only](const char *name) {
+        return !only || strcmp(only, name) == 0;
+    };
+
+    if (run("resident")) {
+        printf("Resident-page lookup, %u accesses per run\n", accesses);
+        for (unsigned int frames = 16; frames <= (1u << 20); frames <<= 2) {
+            benchResidentLookup(frames, accesses);
+        }
+    }
+
+    if (run("eviction")) {
+        const unsigned int bitInterval = 100000;
+        printf("\nEviction with full memory, -b %u, %u accesses per run\n",
+               bitInterval, accesses);
+        for (unsigned int frames = 16; frames <= (1u << 20); frames <<= 2) {
+            benchEviction(frames, accesses, bitInterval);
+        }
+    }
+
+    if (run("aging")) {
+        printf("\nAging\n");
+        for (unsigned int frames = 16; frames <= (1u << 20); frames <<= 2) {
+            benchAging(frames, 64);
+        }
+    }
+
+    if (run("walk")) {
+        printf("\nPage table walk, %u accesses per run\n", accesses);
+        const unsigned int walk888[] = {8, 8, 8};
+        const unsigned int walk668[] = {6, 6, 8};
+        const unsigned int walk4412[] = {4, 4, 12};
+        const unsigned int walk44444[] = {4, 4, 4, 4, 4};
+        for (unsigned int pages = 4096; pages <= (1u << 20); pages <<= 8) {
+            printf("%u mapped pages\n", pages);
+            benchWalk(3, walk888, pages, accesses);
+            benchWalk(3, walk668, pages, accesses);
+            benchWalk(3, walk4412, pages, accesses);
+            benchWalk(5, walk44444, pages, accesses);
+        }
+    }
+
+    if (run("synthetic")) {
+        // The aging sweep has its own section; keep it from dominating here
+        const unsigned int bitInterval = 100;
+        printf("\nSynthetic workloads, -b %u, %u accesses per run\n",
+               bitInterval, accesses);
+        benchSynthetic(accesses, bitInterval);
+    }
+    return 0;
+}
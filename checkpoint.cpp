@@ -0,0 +1,449 @@
+#include "checkpoint.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pagetable.h"
+#include "pagetable_walk.h"
+#include "replacement.h"
+#include "tlb.h"
+
+// Sections start at multiples of this
+static const uint64_t CHECKPOINT_SECTION_ALIGN = 64;
+
+bool parseCheckpointSpec(const char *spec, CheckpointSchedule &schedule)
+{
+    char *end;
+    unsigned long every = strtoul(spec, &end, 10);
+    if (end == spec || every == 0 || *end != ':' || end[1] == '\0') {
+        return false;
+    }
+    schedule.everyAddresses = every;
+    schedule.path = end + 1;
+    return true;
+}
+
+void initCheckpointSchedule(CheckpointSchedule &cs, const Simulator &sim)
+{
+    cs.untilNext = cs.everyAddresses -
+                   sim.stats.addressesProcessed % cs.everyAddresses;
+}
+
+bool checkpointAdvance(CheckpointSchedule &cs, const Simulator &sim, size_t processed)
+{
+    cs.untilNext -= processed;
+    if (cs.untilNext > 0) return true;
+    cs.untilNext = cs.everyAddresses;
+    return writeCheckpoint(sim, cs.path);
+}
+
+// Settings of sim that a checkpoint has to match
+static void checkpointConfig(const Simulator &sim, CheckpointConfig &c)
+{
+    memset(&c, 0, sizeof(c));
+    const PageTable *pt = sim.pt;
+    c.levelCount = pt->levelCount;
+    for (unsigned int i = 0; i < pt->levelCount && i < 32; i++) {
+        c.levelBits[i] = pt->levelBits[i];
+    }
+    c.addressBits = pt->addressBits;
+    c.backend = pageTableBackend(pt);
+    c.hugePages = pt->hugePages;
+    c.maxFrames = sim.rs.maxFrames;
+    c.bitInterval = sim.rs.bitstringInterval;
+    strncpy(c.policy, sim.rs.policy->name, sizeof(c.policy) - 1);
+    c.tlbEntries = sim.tlb ? sim.tlb->entryCount : 0;
+    c.tlbWays = sim.tlb ? sim.tlb->ways : 0;
+    c.perProcess = sim.procs != nullptr;
+    c.preferClean = sim.rs.preferClean;
+    if (sim.prefetch) {
+        strncpy(c.prefetch, sim.prefetch->policy->name, sizeof(c.prefetch) - 1);
+        c.prefetchDepth = sim.prefetch->depth;
+    }
+}
+
+// Writer
+
+struct CheckpointWriter {
+    FILE *out;
+    std::vector<CheckpointSection> sections;
+    bool failed;
+};
+
+// Pad the file to the next section boundary and start a section there
+static void beginSection(CheckpointWriter &w, uint32_t kind, uint32_t index)
+{
+    static const char zeros[CHECKPOINT_SECTION_ALIGN] = {0};
+    off_t at = ftello(w.out);
+    size_t pad = (size_t)((CHECKPOINT_SECTION_ALIGN - at % CHECKPOINT_SECTION_ALIGN) %
+                          CHECKPOINT_SECTION_ALIGN);
+    if (at < 0 || fwrite(zeros, 1, pad, w.out) != pad) w.failed = true;
+    w.sections.push_back(CheckpointSection{kind, index, (uint64_t)(at + pad), 0});
+}
+
+static void endSection(CheckpointWriter &w)
+{
+    CheckpointSection &s = w.sections.back();
+    s.bytes = (uint64_t)ftello(w.out) - s.offset;
+}
+
+static void writeSection(CheckpointWriter &w, uint32_t kind, const void *data, size_t bytes)
+{
+    beginSection(w, kind, 0);
+    // An empty vector's data() may be nullptr; the section stays, empty
+    if (bytes > 0 && fwrite(data, 1, bytes, w.out) != bytes) w.failed = true;
+    endSection(w);
+}
+
+template <typename T>
+static void writeVector(CheckpointWriter &w, uint32_t kind, const std::vector<T> &v)
+{
+    writeSection(w, kind, v.data(), v.size() * sizeof(T));
+}
+
+static void writeSections(CheckpointWriter &w, const Simulator &sim)
+{
+    CheckpointConfig config;
+    checkpointConfig(sim, config);
+    writeSection(w, CK_CONFIG, &config, sizeof(config));
+    writeSection(w, CK_STATS, &sim.stats, sizeof(sim.stats));
+
+    const ReplacementState &rs = sim.rs;
+    CheckpointReplacement r;
+    memset(&r, 0, sizeof(r));
+    r.accessesSinceAging = rs.accessesSinceAging;
+    r.currentTime = rs.currentTime;
+    r.nextFreeFrame = rs.nextFreeFrame;
+    r.dirtyEvictions = rs.dirtyEvictions;
+    r.hand = rs.hand;
+    r.arcTarget = rs.arcTarget;
+    r.arcToFrequent = rs.arcToFrequent;
+    r.residentHashShift = rs.residentIndex.hashShift;
+    r.residentCount = rs.residentIndex.count;
+    r.ghostHashShift = rs.arcGhosts.index.hashShift;
+    r.ghostCount = rs.arcGhosts.index.count;
+    r.agingEpoch = rs.agingEpoch;
+    r.recency[0] = rs.recency[0];
+    r.recency[1] = rs.recency[1];
+    r.ghostLists[0] = rs.arcGhosts.lists[0];
+    r.ghostLists[1] = rs.arcGhosts.lists[1];
+    writeSection(w, CK_REPLACEMENT, &r, sizeof(r));
+    writeVector(w, CK_FRAME_VPN, rs.frameVPN);
+    writeVector(w, CK_AGE_BITS, rs.ageBits);
+    writeVector(w, CK_AGE_EPOCH, rs.ageEpoch);
+    writeVector(w, CK_LAST_ACCESS, rs.lastAccessTime);
+    writeVector(w, CK_ACCESSED_BITS, rs.accessedBits);
+    writeVector(w, CK_DIRTY_BITS, rs.dirtyBits);
+    writeVector(w, CK_RESIDENT_INDEX, rs.residentIndex.buckets);
+    writeVector(w, CK_FRAME_PREV, rs.framePrev);
+    writeVector(w, CK_FRAME_NEXT, rs.frameNext);
+    writeVector(w, CK_FRAME_LIST, rs.frameList);
+    writeVector(w, CK_GHOST_VPN, rs.arcGhosts.vpn);
+    writeVector(w, CK_GHOST_PREV, rs.arcGhosts.prev);
+    writeVector(w, CK_GHOST_NEXT, rs.arcGhosts.next);
+    writeVector(w, CK_GHOST_LIST, rs.arcGhosts.list);
+    writeVector(w, CK_GHOST_FREE, rs.arcGhosts.freeNodes);
+    writeVector(w, CK_GHOST_INDEX, rs.arcGhosts.index.buckets);
+
+    if (sim.tlb) {
+        const Tlb *tlb = sim.tlb;
+        CheckpointTlb t = {tlb->useClock, tlb->spanSizes,
+                           tlb->hits, tlb->misses, tlb->largeHits};
+        writeSection(w, CK_TLB, &t, sizeof(t));
+        writeSection(w, CK_TLB_ENTRIES, tlb->entries,
+                     tlb->entryCount * sizeof(TlbEntry));
+    }
+
+    // Table 0 is sim.pt, and in per-process mode the rest follow by slot
+    size_t tableCount = 1;
+    if (sim.procs) {
+        const ProcessTables &pr = *sim.procs;
+        CheckpointProcesses p;
+        memset(&p, 0, sizeof(p));
+        memcpy(p.slotOf, pr.slotOf, sizeof(p.slotOf));
+        p.tableCount = (uint32_t)pr.tables.size();
+        writeSection(w, CK_PROCESSES, &p, sizeof(p));
+        writeVector(w, CK_PROCESS_IDS, pr.procOf);
+        writeVector(w, CK_PROCESS_STATS, pr.stats);
+        if (pr.tables.size() > 1) tableCount = pr.tables.size();
+    }
+    if (sim.prefetch) {
+        const PagePrefetcher &pf = *sim.prefetch;
+        CheckpointPrefetch p;
+        memset(&p, 0, sizeof(p));
+        p.stats = pf.stats;
+        memcpy(p.history, pf.history, sizeof(p.history));
+        writeSection(w, CK_PREFETCH, &p, sizeof(p));
+        writeVector(w, CK_PREFETCH_PENDING, pf.pendingBits);
+        writeVector(w, CK_PREFETCH_MARKOV, pf.markov);
+    }
+    for (size_t slot = 0; slot < tableCount; slot++) {
+        const PageTable *pt = slot ? sim.procs->tables[slot] : sim.pt;
+        beginSection(w, CK_PAGE_TABLE, (uint32_t)slot);
+        if (!writePageTableImage(pt, w.out)) w.failed = true;
+        endSection(w);
+    }
+}
+
+bool writeCheckpoint(const Simulator &sim, const char *path)
+{
+    std::string tmp = std::string(path) + ".tmp";
+    CheckpointWriter w;
+    w.out = fopen(tmp.c_str(), "wb");
+    if (!w.out) return false;
+    w.failed = false;
+
+    CheckpointHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CHECKPOINT_MAGIC, sizeof(hdr.magic));
+    hdr.version = CHECKPOINT_VERSION;
+    hdr.byteOrder = CHECKPOINT_BYTE_ORDER;
+    hdr.vaddrBits = VADDR_BITS;
+    hdr.records = sim.stats.addressesProcessed;
+    if (fwrite(&hdr, 1, sizeof(hdr), w.out) != sizeof(hdr)) w.failed = true;
+
+    writeSections(w, sim);
+
+    // Directory last, then the header that points at it
+    off_t at = ftello(w.out);
+    size_t bytes = w.sections.size() * sizeof(CheckpointSection);
+    if (at < 0 || fwrite(w.sections.data(), 1, bytes, w.out) != bytes) {
+        w.failed = true;
+    }
+    hdr.directoryOffset = (uint64_t)at;
+    hdr.sectionCount = (uint32_t)w.sections.size();
+    if (fseeko(w.out, 0, SEEK_SET) != 0 ||
+        fwrite(&hdr, 1, sizeof(hdr), w.out) != sizeof(hdr) ||
+        fflush(w.out) != 0 || fsync(fileno(w.out)) != 0)
+    {
+        w.failed = true;
+    }
+    if (fclose(w.out) != 0) w.failed = true;
+
+    if (w.failed || rename(tmp.c_str(), path) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Reader
+
+struct CheckpointReader {
+    const char *data;
+    size_t bytes;
+    const CheckpointSection *sections;
+    uint32_t sectionCount;
+};
+
+// Section kind/index, nullptr if the checkpoint has none
+static const CheckpointSection *findSection(const CheckpointReader &r,
+                                            uint32_t kind, uint32_t index = 0)
+{
+    for (uint32_t i = 0; i < r.sectionCount; i++) {
+        const CheckpointSection &s = r.sections[i];
+        if (s.kind == kind && s.index == index) return &s;
+    }
+    return nullptr;
+}
+
+// Section kind if it holds exactly bytes bytes
+static const void *readSection(const CheckpointReader &r, uint32_t kind, size_t bytes)
+{
+    const CheckpointSection *s = findSection(r, kind);
+    if (!s || s->bytes != bytes) return nullptr;
+    return r.data + s->offset;
+}
+
+template <typename T>
+static bool readVector(const CheckpointReader &r, uint32_t kind, std::vector<T> &v)
+{
+    const CheckpointSection *s = findSection(r, kind);
+    if (!s || s->bytes % sizeof(T) != 0) return false;
+    const T *p = reinterpret_cast<const T *>(r.data + s->offset);
+    v.assign(p, p + s->bytes / sizeof(T));
+    return true;
+}
+
+static bool restorePageTable(const CheckpointReader &r, PageTable *pt, uint32_t slot)
+{
+    const CheckpointSection *s = findSection(r, CK_PAGE_TABLE, slot);
+    return s && restorePageTableImage(pt, r.data + s->offset, (size_t)s->bytes);
+}
+
+static bool restoreSections(const CheckpointReader &r, Simulator &sim)
+{
+    const Stats *stats = static_cast<const Stats *>(
+        readSection(r, CK_STATS, sizeof(Stats)));
+    const CheckpointReplacement *cr = static_cast<const CheckpointReplacement *>(
+        readSection(r, CK_REPLACEMENT, sizeof(CheckpointReplacement)));
+    if (!stats || !cr) return false;
+    sim.stats = *stats;
+
+    ReplacementState &rs = sim.rs;
+    rs.accessesSinceAging = cr->accessesSinceAging;
+    rs.currentTime = cr->currentTime;
+    rs.nextFreeFrame = cr->nextFreeFrame;
+    rs.dirtyEvictions = cr->dirtyEvictions;
+    rs.hand = cr->hand;
+    rs.arcTarget = cr->arcTarget;
+    rs.arcToFrequent = cr->arcToFrequent != 0;
+    rs.residentIndex.hashShift = cr->residentHashShift;
+    rs.residentIndex.count = cr->residentCount;
+    rs.arcGhosts.index.hashShift = cr->ghostHashShift;
+    rs.arcGhosts.index.count = cr->ghostCount;
+    rs.agingEpoch = cr->agingEpoch;
+    rs.recency[0] = cr->recency[0];
+    rs.recency[1] = cr->recency[1];
+    rs.arcGhosts.lists[0] = cr->ghostLists[0];
+    rs.arcGhosts.lists[1] = cr->ghostLists[1];
+    if (!readVector(r, CK_FRAME_VPN, rs.frameVPN) ||
+        !readVector(r, CK_AGE_BITS, rs.ageBits) ||
+        !readVector(r, CK_AGE_EPOCH, rs.ageEpoch) ||
+        !readVector(r, CK_LAST_ACCESS, rs.lastAccessTime) ||
+        !readVector(r, CK_ACCESSED_BITS, rs.accessedBits) ||
+        !readVector(r, CK_DIRTY_BITS, rs.dirtyBits) ||
+        !readVector(r, CK_RESIDENT_INDEX, rs.residentIndex.buckets) ||
+        !readVector(r, CK_FRAME_PREV, rs.framePrev) ||
+        !readVector(r, CK_FRAME_NEXT, rs.frameNext) ||
+        !readVector(r, CK_FRAME_LIST, rs.frameList) ||
+        !readVector(r, CK_GHOST_VPN, rs.arcGhosts.vpn) ||
+        !readVector(r, CK_GHOST_PREV, rs.arcGhosts.prev) ||
+        !readVector(r, CK_GHOST_NEXT, rs.arcGhosts.next) ||
+        !readVector(r, CK_GHOST_LIST, rs.arcGhosts.list) ||
+        !readVector(r, CK_GHOST_FREE, rs.arcGhosts.freeNodes) ||
+        !readVector(r, CK_GHOST_INDEX, rs.arcGhosts.index.buckets))
+    {
+        return false;
+    }
+    size_t frames = rs.frameVPN.size();
+    if (frames != rs.nextFreeFrame || frames > rs.maxFrames ||
+        rs.ageBits.size() != frames || rs.ageEpoch.size() != frames ||
+        rs.lastAccessTime.size() != frames ||
+        rs.accessedBits.size() != (frames + 63) / 64 ||
+        rs.dirtyBits.size() != (frames + 63) / 64)
+    {
+        return false;
+    }
+
+    if (sim.tlb) {
+        Tlb *tlb = sim.tlb;
+        const CheckpointTlb *t = static_cast<const CheckpointTlb *>(
+            readSection(r, CK_TLB, sizeof(CheckpointTlb)));
+        const void *entries = readSection(r, CK_TLB_ENTRIES,
+                                          tlb->entryCount * sizeof(TlbEntry));
+        if (!t || !entries) return false;
+        memcpy(tlb->entries, entries, tlb->entryCount * sizeof(TlbEntry));
+        tlb->useClock = t->useClock;
+        tlb->spanSizes = t->spanSizes;
+        tlb->hits = t->hits;
+        tlb->misses = t->misses;
+        tlb->largeHits = t->largeHits;
+    }
+
+    if (sim.prefetch) {
+        PagePrefetcher &pf = *sim.prefetch;
+        const CheckpointPrefetch *p = static_cast<const CheckpointPrefetch *>(
+            readSection(r, CK_PREFETCH, sizeof(CheckpointPrefetch)));
+        size_t markovEntries = pf.markov.size();
+        if (!p || !readVector(r, CK_PREFETCH_PENDING, pf.pendingBits) ||
+            !readVector(r, CK_PREFETCH_MARKOV, pf.markov) ||
+            pf.pendingBits.size() > (frames + 63) / 64 ||
+            pf.markov.size() != markovEntries)
+        {
+            return false;
+        }
+        pf.stats = p->stats;
+        memcpy(pf.history, p->history, sizeof(pf.history));
+    }
+
+    if (!restorePageTable(r, sim.pt, 0)) return false;
+    if (!sim.procs) return true;
+
+    // Recreate the other processes' tables as addProcess made them
+    ProcessTables &pr = *sim.procs;
+    const CheckpointProcesses *p = static_cast<const CheckpointProcesses *>(
+        readSection(r, CK_PROCESSES, sizeof(CheckpointProcesses)));
+    if (!p || p->tableCount > pr.maxSlots ||
+        !readVector(r, CK_PROCESS_IDS, pr.procOf) ||
+        !readVector(r, CK_PROCESS_STATS, pr.stats) ||
+        pr.procOf.size() != p->tableCount || pr.stats.size() != p->tableCount)
+    {
+        return false;
+    }
+    memcpy(pr.slotOf, p->slotOf, sizeof(pr.slotOf));
+    for (uint32_t slot = 0; slot < p->tableCount; slot++) {
+        PageTable *pt = sim.pt;
+        if (slot > 0) {
+            pt = createPageTable(sim.pt->levelCount, sim.pt->levelBits,
+                                 pageTableBackend(sim.pt), sim.pt->addressBits);
+            pt->walk = sim.pt->walk;
+            pt->hugePages = sim.pt->hugePages;
+        }
+        pr.tables.push_back(pt);
+        if (slot > 0 && !restorePageTable(r, pt, slot)) return false;
+    }
+    return true;
+}
+
+bool restoreCheckpoint(Simulator &sim, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CheckpointHeader)) {
+        fprintf(stderr, "Unable to read checkpoint %s\n", path);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    size_t bytes = (size_t)st.st_size;
+    void *map = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Unable to read checkpoint %s\n", path);
+        return false;
+    }
+
+    CheckpointReader r;
+    r.data = static_cast<const char *>(map);
+    r.bytes = bytes;
+    const CheckpointHeader *hdr = static_cast<const CheckpointHeader *>(map);
+    bool valid = memcmp(hdr->magic, CHECKPOINT_MAGIC, sizeof(hdr->magic)) == 0 &&
+                 hdr->version == CHECKPOINT_VERSION &&
+                 hdr->byteOrder == CHECKPOINT_BYTE_ORDER &&
+                 hdr->vaddrBits == VADDR_BITS &&
+                 hdr->directoryOffset <= bytes &&
+                 hdr->directoryOffset % alignof(CheckpointSection) == 0 &&
+                 (bytes - hdr->directoryOffset) / sizeof(CheckpointSection) >=
+                     hdr->sectionCount;
+    if (valid) {
+        r.sections = reinterpret_cast<const CheckpointSection *>(
+            r.data + hdr->directoryOffset);
+        r.sectionCount = hdr->sectionCount;
+        for (uint32_t i = 0; i < r.sectionCount && valid; i++) {
+            const CheckpointSection &s = r.sections[i];
+            valid = s.offset % CHECKPOINT_SECTION_ALIGN == 0 &&
+                    s.offset <= bytes && s.bytes <= bytes - s.offset;
+        }
+    }
+
+    CheckpointConfig config;
+    checkpointConfig(sim, config);
+    const void *saved = valid ? readSection(r, CK_CONFIG, sizeof(config)) : nullptr;
+    bool ok = false;
+    if (!saved) {
+        fprintf(stderr, "%s is not a checkpoint from this build\n", path);
+    } else if (memcmp(saved, &config, sizeof(config)) != 0) {
+        fprintf(stderr, "Checkpoint %s was taken with different settings\n", path);
+    } else if (!restoreSections(r, sim)) {
+        fprintf(stderr, "Checkpoint %s is corrupt\n", path);
+    } else {
+        ok = true;
+    }
+    munmap(map, bytes);
+    return ok;
+}
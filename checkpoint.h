@@ -0,0 +1,167 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include "simulator.h"
+#include "vaddr_tracereader.h"
+
+// Checkpoints of a whole simulation (-C, -R): page tables, replacement
+// state, TLB, prefetcher, statistics and how far into the trace the run got. The file
+// is a header, then sections of raw host-order arrays at 64 byte aligned
+// offsets, then a directory of the sections. A restore maps the file and
+// copies every section straight into place; page tables come back from
+// the flat images writePageTableImage makes.
+static const char CHECKPOINT_MAGIC[4] = { 'P', 'T', 'C', 'K' };
+static const uint32_t CHECKPOINT_VERSION = 4;
+static const uint32_t CHECKPOINT_BYTE_ORDER = 0x01020304;
+
+struct CheckpointHeader {
+    char magic[4];              // CHECKPOINT_MAGIC
+    uint32_t version;           // CHECKPOINT_VERSION
+    uint32_t byteOrder;         // CHECKPOINT_BYTE_ORDER as written by the host
+    uint32_t vaddrBits;         // VADDR_BITS of the build that wrote it
+    uint64_t records;           // trace records consumed (addresses processed)
+    uint64_t directoryOffset;   // CheckpointSection[sectionCount]
+    uint32_t sectionCount;
+    uint32_t unused;
+};
+
+// Section contents
+enum CheckpointSectionKind {
+    CK_CONFIG = 1,              // CheckpointConfig
+    CK_STATS,                   // Stats
+    CK_REPLACEMENT,             // CheckpointReplacement
+    CK_FRAME_VPN,               // ReplacementState per-frame arrays
+    CK_AGE_BITS,
+    CK_AGE_EPOCH,
+    CK_LAST_ACCESS,
+    CK_ACCESSED_BITS,
+    CK_DIRTY_BITS,
+    CK_RESIDENT_INDEX,          // ResidentBucket[]
+    CK_FRAME_PREV,              // LRU / ARC lists
+    CK_FRAME_NEXT,
+    CK_FRAME_LIST,
+    CK_GHOST_VPN,               // ARC ghost lists
+    CK_GHOST_PREV,
+    CK_GHOST_NEXT,
+    CK_GHOST_LIST,
+    CK_GHOST_FREE,
+    CK_GHOST_INDEX,
+    CK_TLB,                     // CheckpointTlb
+    CK_TLB_ENTRIES,             // TlbEntry[entryCount]
+    CK_PROCESSES,               // CheckpointProcesses
+    CK_PROCESS_IDS,             // unsigned int[slot], trace proc of each table
+    CK_PROCESS_STATS,           // ProcStats[slot]
+    CK_PREFETCH,                // CheckpointPrefetch
+    CK_PREFETCH_PENDING,        // PagePrefetcher::pendingBits
+    CK_PREFETCH_MARKOV,         // MarkovEntry[], Markov engine only
+    CK_PAGE_TABLE               // page table image; index is the table's slot
+};
+
+struct CheckpointSection {
+    uint32_t kind;              // CheckpointSectionKind
+    uint32_t index;             // page table slot for CK_PAGE_TABLE
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+// Settings a resumed run must share with the one checkpointed
+struct CheckpointConfig {
+    uint32_t levelCount;
+    uint32_t levelBits[32];
+    uint32_t addressBits;
+    uint32_t backend;           // PageTableBackend
+    uint32_t hugePages;
+    uint32_t maxFrames;
+    uint32_t bitInterval;
+    char policy[16];            // ReplacementPolicy::name
+    uint32_t tlbEntries;        // 0 without a TLB
+    uint32_t tlbWays;
+    uint32_t perProcess;
+    uint32_t preferClean;
+    char prefetch[16];          // PagePrefetchPolicy::name, empty without -F
+    uint32_t prefetchDepth;
+    uint32_t unused;
+};
+
+// Replacement state other than its arrays. The aging victim order is not
+// kept; the first eviction after a restore builds it from the frames.
+struct CheckpointReplacement {
+    uint32_t accessesSinceAging;
+    uint32_t currentTime;
+    uint32_t nextFreeFrame;
+    uint32_t dirtyEvictions;
+    uint32_t hand;
+    uint32_t arcTarget;
+    uint32_t arcToFrequent;
+    uint32_t residentHashShift;
+    uint32_t residentCount;
+    uint32_t ghostHashShift;
+    uint32_t ghostCount;
+    uint32_t agingEpoch;
+    IndexList recency[2];
+    IndexList ghostLists[2];
+};
+
+struct CheckpointTlb {
+    uint32_t useClock;
+    uint32_t spanSizes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t largeHits;
+};
+
+// Page prefetching: statistics and what the policy learned per proc
+struct CheckpointPrefetch {
+    PrefetchStats stats;
+    PrefetchHistory history[256];
+};
+
+// Per-process mode: the proc -> slot map and how many tables there are
+struct CheckpointProcesses {
+    int32_t slotOf[256];
+    uint32_t tableCount;
+    uint32_t unused;
+};
+
+// Checkpoints every N addresses. Like snapshots, the main loop processes
+// the trace in segments that end where an interval does, and intervals
+// count from the start of the trace, so a resumed run checkpoints at the
+// same addresses as one that was never interrupted.
+struct CheckpointSchedule {
+    const char *path;
+    unsigned long everyAddresses;
+    unsigned long untilNext;    // addresses left before the next checkpoint
+};
+
+// Parse "<addresses>:<file>" into schedule. Returns false if malformed.
+bool parseCheckpointSpec(const char *spec, CheckpointSchedule &schedule);
+
+// Start checkpointing sim, which may have been restored
+void initCheckpointSchedule(CheckpointSchedule &cs, const Simulator &sim);
+
+// How many of the available records to process before calling
+// checkpointAdvance, so an interval is never overrun
+inline size_t checkpointSegment(const CheckpointSchedule &cs, size_t available)
+{
+    return cs.untilNext < available ? cs.untilNext : available;
+}
+
+// Account for processed records and write a checkpoint if one is due.
+// Returns false if writing it failed.
+bool checkpointAdvance(CheckpointSchedule &cs, const Simulator &sim, size_t processed);
+
+// Write sim to path. The file is written beside path and renamed over
+// it, so an interrupted write leaves the previous checkpoint intact.
+// Returns false on error.
+bool writeCheckpoint(const Simulator &sim, const char *path);
+
+// Restore a checkpoint into sim, which must have been created (and set
+// up for huge pages, clean-first replacement and prefetching) with the
+// same settings. Prints the problem and returns false if the file cannot
+// be read or was taken with other settings. The trace is not moved: skip
+// the restored sim.stats.addressesProcessed records before simulating on.
+bool restoreCheckpoint(Simulator &sim, const char *path);
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,386 @@
+#include <stdlib.h>
+#include <string.h>
+#include "compressed_trace.h"
+
+/* Little-endian field helpers */
+
+static void put_le(unsigned char *p, uint64_t v, int bytes) {
+  int i;
+  for (i = 0; i < bytes; i++)
+    p[i] = (unsigned char) (v >> (8 * i));
+}
+
+static uint64_t get_le(const unsigned char *p, int bytes) {
+  uint64_t v = 0;
+  int i;
+  for (i = 0; i < bytes; i++)
+    v |= (uint64_t) p[i] << (8 * i);
+  return v;
+}
+
+static uint64_t zigzag(int64_t v) {
+  return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+  return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+/* Append a varint to buf, returning its length */
+static int put_varint(unsigned char *buf, uint64_t v) {
+  int len = 0;
+  while (v >= 0x80) {
+    buf[len++] = (unsigned char) (v | 0x80);
+    v >>= 7;
+  }
+  buf[len++] = (unsigned char) v;
+  return len;
+}
+
+/* Read a varint at *pos, returns 0 if it runs past end */
+static int get_varint(const unsigned char *data, size_t end, size_t *pos,
+                      uint64_t *out) {
+  uint64_t v = 0;
+  int shift = 0;
+  size_t p = *pos;
+
+  while (1) {
+    unsigned char b;
+    if (p >= end || shift > 63)
+      return 0;
+    b = data[p++];
+    v |= (uint64_t) (b & 0x7f) << shift;
+    if (!(b & 0x80))
+      break;
+    shift += 7;
+  }
+  *pos = p;
+  *out = v;
+  return 1;
+}
+
+/* Recent pages */
+
+/* Slot holding page, or -1 */
+static int recent_find(const PtrRecentPages *r, uint64_t page) {
+  unsigned int i;
+  for (i = 0; i < r->count; i++)
+    if (r->page[i] == page)
+      return (int) i;
+  return -1;
+}
+
+/* Move slot i to the front, then give it a new offset */
+static void recent_touch(PtrRecentPages *r, unsigned int i, uint32_t offset) {
+  uint64_t page = r->page[i];
+  memmove(&r->page[1], &r->page[0], i * sizeof(r->page[0]));
+  memmove(&r->offset[1], &r->offset[0], i * sizeof(r->offset[0]));
+  r->page[0] = page;
+  r->offset[0] = offset;
+}
+
+/* Insert a page at the front, evicting the least recent if full */
+static void recent_insert(PtrRecentPages *r, uint64_t page, uint32_t offset) {
+  if (r->count < PTR_RECENT_PAGES)
+    r->count++;
+  r->page[r->count - 1] = page;
+  recent_touch(r, r->count - 1, offset);
+}
+
+/* Header */
+
+int PtrIsCompressed(const unsigned char *data, size_t len) {
+  return len >= 4 && memcmp(data, PTR_MAGIC, 4) == 0;
+}
+
+int PtrParseHeader(const unsigned char *data, size_t len, PtrHeader *hdr) {
+
+  if (len < PTR_HEADER_BYTES || !PtrIsCompressed(data, len))
+    return 0;
+
+  hdr->version = data[4];
+  hdr->addrBits = data[5];
+  hdr->offsetBits = data[6];
+  hdr->flags = data[7];
+  hdr->blockRecords = (uint32_t) get_le(data + 8, 4);
+  hdr->recordCount = get_le(data + 16, 8);
+  hdr->indexOffset = get_le(data + 24, 8);
+
+  if (hdr->version != PTR_VERSION || hdr->blockRecords == 0 ||
+      (hdr->addrBits != 32 && hdr->addrBits != VADDR_BITS) ||
+      hdr->offsetBits >= hdr->addrBits ||
+      hdr->indexOffset < PTR_HEADER_BYTES || hdr->indexOffset > len)
+    return 0;
+  return 1;
+}
+
+static void encode_header(unsigned char *p, const PtrHeader *hdr) {
+  memset(p, 0, PTR_HEADER_BYTES);
+  memcpy(p, PTR_MAGIC, 4);
+  p[4] = (unsigned char) hdr->version;
+  p[5] = (unsigned char) hdr->addrBits;
+  p[6] = (unsigned char) hdr->offsetBits;
+  p[7] = (unsigned char) hdr->flags;
+  put_le(p + 8, hdr->blockRecords, 4);
+  put_le(p + 16, hdr->recordCount, 8);
+  put_le(p + 24, hdr->indexOffset, 8);
+}
+
+/* Decoder */
+
+void PtrDecoderInit(PtrDecoder *dec, const unsigned char *data, size_t len,
+                    const PtrHeader *hdr) {
+  dec->hdr = *hdr;
+  dec->data = data;
+  dec->fileLen = len;
+  dec->len = hdr->indexOffset;  /* records end where the index starts */
+  dec->pos = PTR_HEADER_BYTES;
+  dec->next = 0;
+  dec->recent.count = 0;
+  dec->reqtype = MEMREAD;
+  dec->proc = 0;
+}
+
+size_t PtrDecode(PtrDecoder *dec, p2AddrTr *out, size_t max) {
+
+  const unsigned char *data = dec->data;
+  PtrRecentPages *recent = &dec->recent;
+  unsigned int offsetBits = dec->hdr.offsetBits;
+  uint64_t offsetLimit = 1ull << offsetBits;
+  int meta = (dec->hdr.flags & PTR_FLAG_META) != 0;
+  size_t n = 0;
+
+  while (n < max && dec->next < dec->hdr.recordCount) {
+    uint64_t v, page, offset;
+    int metaFollows = 0;
+    p2AddrTr *rec = &out[n];
+
+    /* each block starts from an empty recent-page list */
+    if (dec->next % dec->hdr.blockRecords == 0) {
+      recent->count = 0;
+      dec->reqtype = MEMREAD;
+      dec->proc = 0;
+    }
+
+    if (!get_varint(data, dec->len, &dec->pos, &v))
+      goto malformed;
+
+    if (meta) {
+      metaFollows = (int) ((v >> 1) & 1);
+    }
+
+    if ((v & 1) == 0) {
+      /* recent page */
+      unsigned int slot;
+      v >>= 1 + meta;
+      slot = (unsigned int) (v & (PTR_RECENT_PAGES - 1));
+      v >>= PTR_RECENT_BITS;
+      if (slot >= recent->count)
+        goto malformed;
+      page = recent->page[slot];
+      offset = recent->offset[slot] + (uint64_t) unzigzag(v);
+      if (offset >= offsetLimit)
+        goto malformed;
+      recent_touch(recent, slot, (uint32_t) offset);
+    } else {
+      /* other page, delta from the most recent one */
+      uint64_t d;
+      offset = v >> (1 + meta);
+      if (offset >= offsetLimit ||
+          !get_varint(data, dec->len, &dec->pos, &d))
+        goto malformed;
+      page = (recent->count ? recent->page[0] : 0) + (uint64_t) unzigzag(d);
+      recent_insert(recent, page, (uint32_t) offset);
+    }
+
+    if (metaFollows) {
+      if (dec->len - dec->pos < 2)
+        goto malformed;
+      dec->reqtype = data[dec->pos];
+      dec->proc = data[dec->pos + 1];
+      dec->pos += 2;
+    }
+
+    rec->addr = (vaddr_t) ((page << offsetBits) | offset);
+    rec->reqtype = dec->reqtype;
+    rec->size = 0;
+    rec->attr = 0;
+    rec->proc = dec->proc;
+    rec->time = 0;
+
+    n++;
+    dec->next++;
+  }
+  return n;
+
+ malformed:
+  fprintf(stderr, "Compressed trace is truncated or corrupt at record %llu\n",
+          (unsigned long long) dec->next);
+  dec->next = dec->hdr.recordCount;  /* stop decoding */
+  return n;
+}
+
+int PtrDecoderSeek(PtrDecoder *dec, uint64_t record) {
+
+  uint64_t block, blockCount, off;
+  const unsigned char *index = dec->data + dec->hdr.indexOffset;
+  p2AddrTr skip[256];
+
+  if (record > dec->hdr.recordCount ||
+      dec->fileLen - dec->hdr.indexOffset < 4)
+    return 0;
+
+  /* jump to the start of the record's block, then decode forward */
+  block = record / dec->hdr.blockRecords;
+  blockCount = get_le(index, 4);
+  if (block < blockCount &&
+      (dec->fileLen - dec->hdr.indexOffset - 4) / 8 > block) {
+    off = get_le(index + 4 + 8 * block, 8);
+    if (off < PTR_HEADER_BYTES || off > dec->len)
+      return 0;
+    dec->pos = (size_t) off;
+    dec->next = block * dec->hdr.blockRecords;
+  }
+
+  while (dec->next < record) {
+    uint64_t left = record - dec->next;
+    if (PtrDecode(dec, skip, left < 256 ? (size_t) left : 256) == 0)
+      return 0;
+  }
+  return 1;
+}
+
+/* Encoder */
+
+struct PtrWriter {
+  FILE *out;
+  PtrHeader hdr;
+  uint64_t pos;           /* bytes written so far */
+  PtrRecentPages recent;
+  unsigned char reqtype;  /* last reqtype/proc written (PTR_FLAG_META) */
+  unsigned char proc;
+  uint64_t *blocks;       /* byte offset of each block */
+  size_t blockCount;
+  size_t blockCapacity;
+  int failed;
+};
+
+PtrWriter *PtrOpenWriter(FILE *out, unsigned int offsetBits, int keepMeta,
+                         uint32_t blockRecords) {
+
+  unsigned char header[PTR_HEADER_BYTES];
+  PtrWriter *w;
+
+  if (offsetBits >= 32 || blockRecords == 0)
+    return NULL;
+
+  w = (PtrWriter *) calloc(1, sizeof(PtrWriter));
+  if (w == NULL)
+    return NULL;
+  w->out = out;
+  w->hdr.version = PTR_VERSION;
+  w->hdr.addrBits = VADDR_BITS;
+  w->hdr.offsetBits = offsetBits;
+  w->hdr.flags = keepMeta ? PTR_FLAG_META : 0;
+  w->hdr.blockRecords = blockRecords;
+  w->reqtype = MEMREAD;
+  w->proc = 0;
+
+  /* placeholder header, rewritten by PtrCloseWriter */
+  encode_header(header, &w->hdr);
+  if (fwrite(header, 1, sizeof(header), out) != sizeof(header))
+    w->failed = 1;
+  w->pos = sizeof(header);
+  return w;
+}
+
+int PtrWriteRecord(PtrWriter *w, const p2AddrTr *rec) {
+
+  unsigned char buf[32];
+  int len = 0;
+  unsigned int offsetBits = w->hdr.offsetBits;
+  uint64_t page = (uint64_t) rec->addr >> offsetBits;
+  uint32_t offset = (uint32_t) (rec->addr & ((1ull << offsetBits) - 1));
+  int meta = (w->hdr.flags & PTR_FLAG_META) != 0;
+  uint64_t metaBit = 0;
+  int slot;
+
+  if (w->hdr.recordCount % w->hdr.blockRecords == 0) {
+    /* start a new block */
+    if (w->blockCount == w->blockCapacity) {
+      size_t cap = w->blockCapacity ? 2 * w->blockCapacity : 64;
+      uint64_t *grown = (uint64_t *) realloc(w->blocks, cap * sizeof(uint64_t));
+      if (grown == NULL) {
+        w->failed = 1;
+        return 0;
+      }
+      w->blocks = grown;
+      w->blockCapacity = cap;
+    }
+    w->blocks[w->blockCount++] = w->pos;
+    w->recent.count = 0;
+    w->reqtype = MEMREAD;
+    w->proc = 0;
+  }
+
+  if (meta && (rec->reqtype != w->reqtype || rec->proc != w->proc))
+    metaBit = 2;
+
+  slot = recent_find(&w->recent, page);
+  if (slot >= 0) {
+    int64_t delta = (int64_t) offset - (int64_t) w->recent.offset[slot];
+    uint64_t v = (zigzag(delta) << PTR_RECENT_BITS) | (uint64_t) slot;
+    len += put_varint(buf, (v << (1 + meta)) | metaBit);
+    recent_touch(&w->recent, (unsigned int) slot, offset);
+  } else {
+    uint64_t base = w->recent.count ? w->recent.page[0] : 0;
+    len += put_varint(buf, ((uint64_t) offset << (1 + meta)) | metaBit | 1);
+    len += put_varint(buf + len, zigzag((int64_t) (page - base)));
+    recent_insert(&w->recent, page, offset);
+  }
+
+  if (metaBit) {
+    buf[len++] = rec->reqtype;
+    buf[len++] = rec->proc;
+    w->reqtype = rec->reqtype;
+    w->proc = rec->proc;
+  }
+
+  if (fwrite(buf, 1, (size_t) len, w->out) != (size_t) len) {
+    w->failed = 1;
+    return 0;
+  }
+  w->pos += (uint64_t) len;
+  w->hdr.recordCount++;
+  return 1;
+}
+
+int PtrCloseWriter(PtrWriter *w) {
+
+  unsigned char buf[PTR_HEADER_BYTES];
+  size_t i;
+  int ok;
+
+  /* block index */
+  w->hdr.indexOffset = w->pos;
+  put_le(buf, w->blockCount, 4);
+  if (fwrite(buf, 1, 4, w->out) != 4)
+    w->failed = 1;
+  for (i = 0; i < w->blockCount; i++) {
+    put_le(buf, w->blocks[i], 8);
+    if (fwrite(buf, 1, 8, w->out) != 8)
+      w->failed = 1;
+  }
+
+  /* final header */
+  encode_header(buf, &w->hdr);
+  if (fseek(w->out, 0, SEEK_SET) != 0 ||
+      fwrite(buf, 1, sizeof(buf), w->out) != sizeof(buf) ||
+      fflush(w->out) != 0)
+    w->failed = 1;
+
+  ok = !w->failed;
+  free(w->blocks);
+  free(w);
+  return ok;
+}
@@ -0,0 +1,117 @@
+#ifndef COMPRESSED_TRACE_H
+#define COMPRESSED_TRACE_H
+
+/*
+ * Compressed page trace (.ptr) format
+ *
+ * The paging simulator only needs the address of each record, so a .ptr
+ * file keeps the address split into a page and an offset at a fixed
+ * offsetBits (independent of the page size a later run uses).  Traces
+ * interleave a handful of hot pages, so both sides track the
+ * PTR_RECENT_PAGES most recently used pages (move-to-front) along with
+ * the last offset seen in each.  Every record starts with a varint whose
+ * low bits are a tag:
+ *
+ *   bit 0        0 = recent page, 1 = other page
+ *   bit 1        only with PTR_FLAG_META: reqtype and proc bytes follow
+ *   recent page  next PTR_RECENT_BITS bits pick the page, the rest is
+ *                the zigzag offset delta from that page's last offset
+ *   other page   the rest is the offset, followed by a second varint:
+ *                the zigzag page delta from the most recent page
+ *
+ * Records are grouped in blocks of blockRecords; the recent-page list and
+ * the last reqtype/proc are reset at each block, so every block decodes on its own.  The index
+ * at the end of the file holds the byte offset of each block.
+ *
+ *   header    PTR_HEADER_BYTES, little-endian fields below
+ *   blocks    records
+ *   index     uint32 blockCount, blockCount x uint64 block offsets
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include "vaddr_tracereader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PTR_MAGIC "PTRC"
+#define PTR_VERSION 1
+#define PTR_HEADER_BYTES 32
+#define PTR_DEFAULT_BLOCK_RECORDS 65536
+#define PTR_RECENT_BITS 3
+#define PTR_RECENT_PAGES (1 << PTR_RECENT_BITS)
+
+/* header flags */
+#define PTR_FLAG_META 0x01  /* records carry reqtype and proc */
+
+typedef struct {
+  unsigned int version;
+  unsigned int addrBits;      /* width of the traced addresses: 32, or 64
+                               * (read by PAGING_VA64 builds only) */
+  unsigned int offsetBits;    /* page/offset split used for encoding */
+  unsigned int flags;         /* PTR_FLAG_* */
+  uint32_t blockRecords;      /* records per block */
+  uint64_t recordCount;       /* records in the file */
+  uint64_t indexOffset;       /* byte offset of the block index */
+} PtrHeader;
+
+/* Most recently used pages, shared by the encoder and decoder */
+typedef struct {
+  uint64_t page[PTR_RECENT_PAGES];
+  uint32_t offset[PTR_RECENT_PAGES];  /* last offset seen in the page */
+  unsigned int count;
+} PtrRecentPages;
+
+/* PtrIsCompressed - true if data starts with the .ptr magic */
+int PtrIsCompressed(const unsigned char *data, size_t len);
+
+/* PtrParseHeader - decode the header, returns 0 if it is not valid */
+int PtrParseHeader(const unsigned char *data, size_t len, PtrHeader *hdr);
+
+/* Streaming decoder over an in-memory .ptr image */
+typedef struct {
+  PtrHeader hdr;
+  const unsigned char *data;  /* whole file */
+  size_t fileLen;             /* bytes in data */
+  size_t len;                 /* end of the record area */
+  size_t pos;                 /* next byte to decode */
+  uint64_t next;              /* index of the next record */
+  PtrRecentPages recent;
+  unsigned char reqtype;      /* last reqtype/proc (PTR_FLAG_META) */
+  unsigned char proc;
+} PtrDecoder;
+
+/* PtrDecoderInit - start decoding at the first record */
+void PtrDecoderInit(PtrDecoder *dec, const unsigned char *data, size_t len,
+                    const PtrHeader *hdr);
+
+/* PtrDecode - decode up to max records into out, returns how many.
+ * Returns 0 at the end of the trace or on malformed data.
+ */
+size_t PtrDecode(PtrDecoder *dec, p2AddrTr *out, size_t max);
+
+/* PtrDecoderSeek - position the decoder at a record using the block
+ * index; returns 0 if the record is out of range.
+ */
+int PtrDecoderSeek(PtrDecoder *dec, uint64_t record);
+
+/* Encoder writing a .ptr file */
+typedef struct PtrWriter PtrWriter;
+
+/* PtrOpenWriter - start a .ptr file on out (which must be seekable) */
+PtrWriter *PtrOpenWriter(FILE *out, unsigned int offsetBits, int keepMeta,
+                         uint32_t blockRecords);
+
+/* PtrWriteRecord - append one record, returns 0 on a write error */
+int PtrWriteRecord(PtrWriter *w, const p2AddrTr *rec);
+
+/* PtrCloseWriter - write the index and final header, returns 0 on error */
+int PtrCloseWriter(PtrWriter *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPRESSED_TRACE_H */
@@ -0,0 +1,139 @@
+#include "event_log.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Staging buffer size; a multiple of the block size O_DIRECT needs
+static const size_t EVENT_LOG_BUFFER_BYTES = 4u << 20;
+
+// Write len bytes at offset. If O_DIRECT turns out not to be supported
+// for this file, drop it and retry with ordinary buffered writes.
+static bool writeAt(EventLog *log, const void *data, size_t len, uint64_t offset)
+{
+    const char *p = (const char *) data;
+    while (len > 0) {
+        ssize_t n = pwrite(log->fd, p, len, (off_t) offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+#ifdef O_DIRECT
+            if (errno == EINVAL && log->direct) {
+                int flags = fcntl(log->fd, F_GETFL);
+                if (flags >= 0 && fcntl(log->fd, F_SETFL, flags & ~O_DIRECT) == 0) {
+                    log->direct = false;
+                    continue;
+                }
+            }
+#endif
+            return false;
+        }
+        p += n;
+        len -= (size_t) n;
+        offset += (uint64_t) n;
+    }
+    return true;
+}
+
+// Header block, written from the aligned buffer so O_DIRECT accepts it
+static bool writeHeader(EventLog *log, void *block)
+{
+    memset(block, 0, EVENT_LOG_HEADER_BYTES);
+    log->header.recordCount = log->recordCount;
+    memcpy(block, &log->header, sizeof(log->header));
+    return writeAt(log, block, EVENT_LOG_HEADER_BYTES, 0);
+}
+
+EventLog *openEventLog(const char *path, const PageTable *pageTable)
+{
+    int fd = -1;
+    bool direct = false;
+#ifdef O_DIRECT
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    direct = fd >= 0;
+#endif
+    if (fd < 0) {
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return nullptr;
+        }
+    }
+
+    void *buffer = nullptr;
+    if (posix_memalign(&buffer, EVENT_LOG_HEADER_BYTES, EVENT_LOG_BUFFER_BYTES) != 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    EventLog *log = new EventLog;
+    log->fd = fd;
+    log->buffer = (EventRecord *) buffer;
+    log->capacity = EVENT_LOG_BUFFER_BYTES / sizeof(EventRecord);
+    log->used = 0;
+    log->recordCount = 0;
+    log->fileOffset = EVENT_LOG_HEADER_BYTES;
+    log->direct = direct;
+    log->failed = false;
+
+    EventLogHeader &h = log->header;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, EVENT_LOG_MAGIC, sizeof(h.magic));
+    h.version = EVENT_LOG_VERSION;
+    h.byteOrder = EVENT_LOG_BYTE_ORDER;
+    h.headerBytes = EVENT_LOG_HEADER_BYTES;
+    h.recordBytes = sizeof(EventRecord);
+    h.offsetBits = pageTable->offsetBits;
+    h.levelCount = pageTable->levelCount;
+    for (unsigned int i = 0; i < pageTable->levelCount && i < 32; i++) {
+        h.levelBits[i] = pageTable->levelBits[i];
+    }
+    h.vaddrBits = VADDR_BITS;
+
+    // A zero count marks a log that was never closed
+    if (!writeHeader(log, log->buffer)) {
+        log->failed = true;
+    }
+    return log;
+}
+
+void flushEventLog(EventLog *log)
+{
+    size_t bytes = log->used * sizeof(EventRecord);
+    if (!log->failed && !writeAt(log, log->buffer, bytes, log->fileOffset)) {
+        log->failed = true;
+    }
+    log->fileOffset += bytes;
+    log->used = 0;
+}
+
+bool closeEventLog(EventLog *log)
+{
+    if (log->used > 0 && !log->failed) {
+        // O_DIRECT writes whole blocks: pad the tail, then trim the file
+        size_t bytes = log->used * sizeof(EventRecord);
+        size_t padded = bytes;
+        if (log->direct) {
+            padded = (bytes + EVENT_LOG_HEADER_BYTES - 1) &
+                     ~(size_t) (EVENT_LOG_HEADER_BYTES - 1);
+            memset((char *) log->buffer + bytes, 0, padded - bytes);
+        }
+        if (!writeAt(log, log->buffer, padded, log->fileOffset) ||
+            ftruncate(log->fd, (off_t) (log->fileOffset + bytes)) != 0) {
+            log->failed = true;
+        }
+        log->fileOffset += bytes;
+        log->used = 0;
+    }
+
+    if (!log->failed && !writeHeader(log, log->buffer)) {
+        log->failed = true;
+    }
+    if (close(log->fd) != 0) {
+        log->failed = true;
+    }
+
+    bool ok = !log->failed;
+    free(log->buffer);
+    delete log;
+    return ok;
+}
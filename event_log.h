@@ -0,0 +1,85 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include "pagetable.h"
+#include "simulator.h"
+
+// Binary per-access event log (-e). The file is one EVENT_LOG_HEADER_BYTES
+// header block followed by fixed-width EventRecords in host byte order, so
+// analysis tools can mmap it and index record i directly at
+// headerBytes + i * recordBytes instead of parsing text.
+static const char EVENT_LOG_MAGIC[4] = { 'P', 'T', 'E', 'V' };
+static const uint32_t EVENT_LOG_VERSION = 1;
+static const uint32_t EVENT_LOG_BYTE_ORDER = 0x01020304;
+static const uint32_t EVENT_LOG_HEADER_BYTES = 4096;
+
+// EventRecord::flags
+static const uint16_t EVENT_HIT = 1;      // page was already mapped
+static const uint16_t EVENT_EVICTED = 2;  // evictedVPN/evictedAgeBits are set
+
+struct EventLogHeader {
+    char magic[4];              // EVENT_LOG_MAGIC
+    uint32_t version;           // EVENT_LOG_VERSION
+    uint32_t byteOrder;         // EVENT_LOG_BYTE_ORDER as written by the host
+    uint32_t headerBytes;       // offset of the first record
+    uint32_t recordBytes;       // sizeof(EventRecord)
+    uint32_t offsetBits;        // page size is 1 << offsetBits
+    uint64_t recordCount;       // filled in when the log is closed
+    uint32_t levelCount;
+    uint32_t levelBits[32];     // [levelCount] bits for each level
+    uint32_t vaddrBits;         // width of va and evictedVPN: 32, or 64 in a
+                                // PAGING_VA64 build
+};
+
+struct EventRecord {
+    vaddr_t va;                 // virtual address from the trace
+    uint32_t pfn;               // frame the page is mapped to
+    vaddr_t evictedVPN;         // full VPN of the page replaced, if any
+    uint16_t evictedAgeBits;    // its aging bit string when replaced
+    uint16_t flags;             // EVENT_HIT | EVENT_EVICTED
+};
+
+// Records are staged in one page aligned buffer and written a buffer at a
+// time, with O_DIRECT where the file system allows it.
+struct EventLog {
+    int fd;
+    EventRecord *buffer;        // capacity records, page aligned
+    size_t capacity;
+    size_t used;
+    uint64_t recordCount;       // records written or staged
+    uint64_t fileOffset;        // where the next full buffer goes
+    bool direct;                // fd is open with O_DIRECT
+    bool failed;                // a write failed, the log is incomplete
+    EventLogHeader header;
+};
+
+// Create (truncate) the log at path for a simulation of pageTable.
+// Returns nullptr if the file cannot be opened.
+EventLog *openEventLog(const char *path, const PageTable *pageTable);
+
+// Write the staged records; called when the buffer fills
+void flushEventLog(EventLog *log);
+
+// Append one access
+inline void logEvent(EventLog *log, vaddr_t va, const AccessResult &res)
+{
+    if (log->used == log->capacity) {
+        flushEventLog(log);
+    }
+    EventRecord &r = log->buffer[log->used++];
+    r.va = va;
+    r.pfn = (uint32_t) res.pfn;
+    r.evictedVPN = res.didEvict ? res.evictedVPN : 0;
+    r.evictedAgeBits = res.didEvict ? res.evictedAgeBits : 0;
+    r.flags = (uint16_t) ((res.hit ? EVENT_HIT : 0) |
+                          (res.didEvict ? EVENT_EVICTED : 0));
+    log->recordCount++;
+}
+
+// Write the remaining records and the final header, then close the file.
+// Returns false if any write failed.
+bool closeEventLog(EventLog *log);
+
+#endif // EVENT_LOG_H
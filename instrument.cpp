@@ -0,0 +1,107 @@
+#include "instrument.h"
+
+#ifdef PAGING_INSTRUMENT
+
+#include <mutex>
+#include <vector>
+
+static const char *const counterNames[IC_COUNTER_COUNT] = {
+    "walk_lookups",
+    "walk_levels",
+    "interior_nodes",
+    "leaf_nodes",
+    "child_arrays",
+    "sparse_blocks",
+    "map_arrays",
+    "victim_choices",
+    "victim_scan_steps",
+    "victim_heap_rebuilds",
+    "aging_passes",
+};
+
+static const char *const timerNames[IT_TIMER_COUNT] = {
+    "trace_read",
+    "walk",
+    "replacement",
+    "logging",
+};
+
+// Live threads, and the totals of threads that have exited
+static std::mutex registryLock;
+static std::vector<InstrumentThread *> liveThreads;
+static InstrumentCounts retired;    // trivially destructible, outlives threads
+
+thread_local InstrumentThread instrumentThread;
+
+static void clearCounts(InstrumentCounts &t)
+{
+    for (auto &c : t.counts) c = 0;
+    for (auto &c : t.cycles) c = 0;
+    for (auto &c : t.calls) c = 0;
+}
+
+static void addCounts(InstrumentCounts &to, const InstrumentCounts &from)
+{
+    for (int i = 0; i < IC_COUNTER_COUNT; i++) to.counts[i] += from.counts[i];
+    for (int i = 0; i < IT_TIMER_COUNT; i++) {
+        to.cycles[i] += from.cycles[i];
+        to.calls[i] += from.calls[i];
+    }
+}
+
+InstrumentThread::InstrumentThread()
+{
+    clearCounts(*this);
+    std::lock_guard<std::mutex> guard(registryLock);
+    liveThreads.push_back(this);
+}
+
+InstrumentThread::~InstrumentThread()
+{
+    std::lock_guard<std::mutex> guard(registryLock);
+    for (size_t i = 0; i < liveThreads.size(); i++) {
+        if (liveThreads[i] == this) {
+            liveThreads.erase(liveThreads.begin() + i);
+            break;
+        }
+    }
+    addCounts(retired, *this);
+}
+
+static double ratio(uint64_t num, uint64_t den)
+{
+    return den ? (double)num / (double)den : 0.0;
+}
+
+void logInstrumentation(FILE *out)
+{
+    std::lock_guard<std::mutex> guard(registryLock);
+    InstrumentCounts total = retired;
+    for (const InstrumentThread *t : liveThreads) {
+        addCounts(total, *t);
+    }
+
+    fprintf(out, "{\"instrumentation\": {\"counters\": {");
+    for (int i = 0; i < IC_COUNTER_COUNT; i++) {
+        fprintf(out, "%s\"%s\": %llu", i ? ", " : "", counterNames[i],
+                (unsigned long long)total.counts[i]);
+    }
+    fprintf(out, "}, \"levels_per_lookup\": %.4f, \"scan_steps_per_victim\": %.4f",
+            ratio(total.counts[IC_WALK_LEVELS], total.counts[IC_WALK_LOOKUPS]),
+            ratio(total.counts[IC_VICTIM_SCAN_STEPS], total.counts[IC_VICTIM_CHOICES]));
+#if defined(__x86_64__) || defined(__i386__)
+    fprintf(out, ", \"timer_unit\": \"tsc\", \"timers\": {");
+#else
+    fprintf(out, ", \"timer_unit\": \"ns\", \"timers\": {");
+#endif
+    for (int i = 0; i < IT_TIMER_COUNT; i++) {
+        fprintf(out, "%s\"%s\": {\"calls\": %llu, \"ticks\": %llu}",
+                i ? ", " : "", timerNames[i],
+                (unsigned long long)total.calls[i],
+                (unsigned long long)total.cycles[i]);
+    }
+    fprintf(out, "}}}\n");
+    fflush(out);
+}
+
+#endif // PAGING_INSTRUMENT
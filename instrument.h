@@ -0,0 +1,90 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+// Opt-in hot path instrumentation. Build every C++ file with
+// -DPAGING_INSTRUMENT to enable it; otherwise the INSTRUMENT_* macros
+// compile to nothing and the hot paths are unchanged.
+//
+// Counts and timers are kept per thread, so sweep workers never share a
+// cache line, and are summed over all threads when dumped.
+
+#include <cstdint>
+#include <cstdio>
+
+enum InstrumentCounter {
+    IC_WALK_LOOKUPS,        // page table searches
+    IC_WALK_LEVELS,         // levels visited by those searches
+    IC_INTERIOR_NODES,      // non-leaf levels allocated
+    IC_LEAF_NODES,          // leaf levels allocated
+    IC_CHILD_ARRAYS,        // next level pointer arrays allocated
+    IC_SPARSE_BLOCKS,       // sparse child blocks allocated, first or grown
+    IC_MAP_ARRAYS,          // leaf map arrays allocated
+    IC_VICTIM_CHOICES,      // evictions
+    IC_VICTIM_SCAN_STEPS,   // heap entries (aging) or bitmap words (clock) examined
+    IC_VICTIM_HEAP_REBUILDS,
+    IC_AGING_PASSES,
+    IC_COUNTER_COUNT
+};
+
+enum InstrumentTimer {
+    IT_TRACE_READ,          // fetching trace batches
+    IT_WALK,                // page table searches in the simulator
+    IT_REPLACEMENT,         // ensureResidentPage on a fault
+    IT_LOGGING,             // per-address output
+    IT_TIMER_COUNT
+};
+
+#ifdef PAGING_INSTRUMENT
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+struct InstrumentCounts {
+    uint64_t counts[IC_COUNTER_COUNT];
+    uint64_t cycles[IT_TIMER_COUNT];
+    uint64_t calls[IT_TIMER_COUNT];
+};
+
+struct InstrumentThread : InstrumentCounts {
+    InstrumentThread();     // registers the thread for dumps
+    ~InstrumentThread();    // folds its counts into the retired totals
+};
+
+extern thread_local InstrumentThread instrumentThread;
+
+// Time stamp counter where there is one, nanoseconds elsewhere
+inline uint64_t instrumentCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Print every thread's counts and timers, summed, as one JSON object
+void logInstrumentation(FILE *out);
+
+#define INSTRUMENT_COUNT(c) (instrumentThread.counts[c]++)
+#define INSTRUMENT_ADD(c, n) (instrumentThread.counts[c] += (n))
+#define INSTRUMENT_TIMER_START(name) uint64_t name = instrumentCycles()
+#define INSTRUMENT_TIMER_STOP(t, name) \
+    (instrumentThread.cycles[t] += instrumentCycles() - (name), \
+     instrumentThread.calls[t]++)
+#define INSTRUMENT_DUMP(out) logInstrumentation(out)
+
+#else
+
+#define INSTRUMENT_COUNT(c) ((void)0)
+#define INSTRUMENT_ADD(c, n) ((void)0)
+#define INSTRUMENT_TIMER_START(name)
+#define INSTRUMENT_TIMER_STOP(t, name) ((void)0)
+#define INSTRUMENT_DUMP(out) ((void)0)
+
+#endif // PAGING_INSTRUMENT
+
+#endif // INSTRUMENT_H
@@ -9,13 +9,72 @@
 using namespace std;
 #endif
 
+/* stdout buffer installed by log_init_output, so per-address lines
+ * are written out in large blocks instead of once per line
+ */
+#define LOG_OUTPUT_BUFFER_BYTES (1 << 20)
+static char log_output_buffer[LOG_OUTPUT_BUFFER_BYTES];
+
+/* Uppercase hex digits of value, at least width digits (like %0*X) */
+static char *put_hex(char *p, vaddr_t value, int width) {
+  static const char digits[] = "0123456789ABCDEF";
+  char tmp[16];
+  int n = 0;
+
+  do {
+    tmp[n++] = digits[value & 0xF];
+    value >>= 4;
+  } while (value);
+  while (n < width)
+    tmp[n++] = '0';
+  while (n)
+    *p++ = tmp[--n];
+  return p;
+}
+
+/* Signed decimal digits of value (like %d) */
+static char *put_dec(char *p, int value) {
+  char tmp[10];
+  int n = 0;
+  uint32_t mag = value < 0 ? 0u - (uint32_t) value : (uint32_t) value;
+
+  if (value < 0)
+    *p++ = '-';
+  do {
+    tmp[n++] = (char) ('0' + mag % 10);
+    mag /= 10;
+  } while (mag);
+  while (n)
+    *p++ = tmp[--n];
+  return p;
+}
+
+static char *put_str(char *p, const char *s) {
+  while (*s)
+    *p++ = *s++;
+  return p;
+}
+
+/**
+ * @brief Give stdout a large, fully buffered output buffer. The
+ *        per-address loggers do not flush; everything pending is
+ *        written when the buffer fills, by the summary loggers, or
+ *        at exit. Must be called before anything is written to stdout.
+ */
+void log_init_output(void) {
+  setvbuf(stdout, log_output_buffer, _IOFBF, sizeof(log_output_buffer));
+}
+
 /**
  * @brief Print out a number in hex, one per line
  * @param number 
  */
 void print_num_inHex(uint32_t number) {
-  printf("%08X\n", number);
-  fflush(stdout);
+  char line[16];
+  char *p = put_hex(line, number, 8);
+
+  *p++ = '\n';
+  fwrite(line, 1, (size_t) (p - line), stdout);
 }
 
 /**
@@ -24,11 +83,11 @@ void print_num_inHex(uint32_t number) {
  * @param levels - Number of levels
  * @param masks - Pointer to array of bitmasks
  */
-void log_bitmasks(int levels, uint32_t *masks) {
+void log_bitmasks(int levels, vaddr_t *masks) {
   printf("Bitmasks\n");
   for (int idx = 0; idx < levels; idx++) 
     /* show mask entry and move to next */
-    printf("level %d mask %08X\n", idx, masks[idx]);
+    printf("level %d mask %08llX\n", idx, (unsigned long long) masks[idx]);
 
   fflush(stdout);
 }
@@ -40,9 +99,14 @@ void log_bitmasks(int levels, uint32_t *masks) {
  * @param va 
  * @param pa 
  */
-void log_va2pa(uint32_t va, uint32_t pa) {
-  fprintf(stdout, "%08X -> %08X\n", va, pa);
-  fflush(stdout);
+void log_va2pa(vaddr_t va, vaddr_t pa) {
+  char line[48];
+  char *p = put_hex(line, va, 8);
+
+  p = put_str(p, " -> ");
+  p = put_hex(p, pa, 8);
+  *p++ = '\n';
+  fwrite(line, 1, (size_t) (p - line), stdout);
 }
 
 /**
@@ -82,8 +146,6 @@ void log_mapping(uint32_t src, uint32_t dest,
   else {
     fprintf(stdout, "\n");
   }
-
-  fflush(stdout);
 }
 
 /**
@@ -95,13 +157,20 @@ void log_mapping(uint32_t src, uint32_t dest,
  * @param frame - page is mapped to specified physical frame
  */
 void log_vpns_pfn(int levels, uint32_t *vpns, uint32_t frame) {
+  /* at most 32 levels of 8 digits and a space, then the frame */
+  char line[32 * 9 + 16];
+  char *p = line;
+
   /* output pages */
-  for (int idx=0; idx < levels; idx++)
-    printf("%X ", vpns[idx]);
+  for (int idx=0; idx < levels; idx++) {
+    p = put_hex(p, vpns[idx], 1);
+    *p++ = ' ';
+  }
   /* output frame */
-  printf("-> %X\n", frame);
-
-  fflush(stdout);
+  p = put_str(p, "-> ");
+  p = put_hex(p, frame, 1);
+  *p++ = '\n';
+  fwrite(line, 1, (size_t) (p - line), stdout);
 }
 
 /**
@@ -138,25 +207,221 @@ void log_summary(unsigned int page_size,
   fflush(stdout);
 }
 
+/**
+ * @brief log TLB statistics, printed after the summary when a TLB is used.
+ *
+ * @param tlbEntries - Number of TLB entries
+ * @param tlbWays - Associativity of the TLB
+ * @param tlbHits - Number of translations served by the TLB
+ * @param tlbMisses - Number of translations that walked the page table
+ */
+void log_tlb_summary(unsigned int tlbEntries,
+                     unsigned int tlbWays,
+                     unsigned long int tlbHits,
+                     unsigned long int tlbMisses) {
+  unsigned long int lookups = tlbHits + tlbMisses;
+  double hit_percent = lookups
+    ? (double) tlbHits / (double) lookups * 100.0
+    : 0.0;
+
+  printf("TLB entries: %u, %u-way\n", tlbEntries, tlbWays);
+  printf("TLB hits: %lu, TLB misses: %lu\n", tlbHits, tlbMisses);
+  printf("TLB hit percentage: %.2f%%, miss percentage: %.2f%%\n",
+         hit_percent, lookups ? 100 - hit_percent : 0.0);
+
+  fflush(stdout);
+}
+
+/**
+ * @brief log huge page statistics, printed after the summary when huge
+ *        page promotion is enabled.
+ *
+ * @param promotions - Number of levels promoted to large mappings
+ * @param demotions - Number of large mappings split by an eviction
+ * @param tableBytes - Page table bytes in use at the end of the run
+ * @param tlbEntries - Number of TLB entries, 0 if no TLB is modelled
+ * @param tlbLargeHits - Number of TLB hits on large page entries
+ * @param tlbReachPages - Pages covered by the TLB at the end of the run
+ */
+void log_huge_page_summary(unsigned long int promotions,
+                           unsigned long int demotions,
+                           unsigned long int tableBytes,
+                           unsigned int tlbEntries,
+                           unsigned long int tlbLargeHits,
+                           unsigned long int tlbReachPages) {
+  printf("Huge page promotions: %lu, demotions: %lu, page table bytes: %lu\n",
+         promotions, demotions, tableBytes);
+  if (tlbEntries) {
+    printf("TLB large page hits: %lu, TLB reach: %lu pages\n",
+           tlbLargeHits, tlbReachPages);
+  }
+
+  fflush(stdout);
+}
+
+/**
+ * @brief log write statistics and the estimated memory stall time, printed
+ *        after the summary when the write-back cost model is enabled.
+ *
+ * @param writes - Number of MEMWRITE accesses
+ * @param dirtyReplaces - Number of replaced pages that had been written
+ * @param cleanReplaces - Number of replaced pages that had not
+ * @param writebackBytes - Bytes written back for the dirty replacements
+ * @param faultMillis - Stall time reading pages in on misses
+ * @param writebackMillis - Stall time writing dirty pages back
+ */
+void log_writeback_summary(unsigned int writes,
+                           unsigned int dirtyReplaces,
+                           unsigned int cleanReplaces,
+                           unsigned long long int writebackBytes,
+                           double faultMillis,
+                           double writebackMillis) {
+  printf("Writes: %u, dirty page replacements: %u, clean page replacements: %u\n",
+         writes, dirtyReplaces, cleanReplaces);
+  printf("Write-back volume: %llu bytes\n", writebackBytes);
+  printf("Estimated memory stall: %.3f ms (faults: %.3f ms, write-backs: %.3f ms)\n",
+         faultMillis + writebackMillis, faultMillis, writebackMillis);
+
+  fflush(stdout);
+}
+
+/**
+ * @brief log one process's share of the run, printed after the summary in
+ *        per-process page table mode.
+ *
+ * @param proc - Process id from the trace
+ * @param numOfAddresses - Number of addresses the process accessed
+ * @param pageTableHits - Number of those that hit
+ * @param evictionsCaused - Number of page replaces the process's misses caused
+ * @param pagesEvicted - Number of the process's pages that were replaced
+ * @param pgtableEntries - Number of entries in the process's page table
+ */
+void log_proc_summary(unsigned int proc,
+                      unsigned int numOfAddresses,
+                      unsigned int pageTableHits,
+                      unsigned int evictionsCaused,
+                      unsigned int pagesEvicted,
+                      unsigned long int pgtableEntries) {
+  double hit_percent = numOfAddresses
+    ? (double) pageTableHits / (double) numOfAddresses * 100.0
+    : 0.0;
+
+  printf("Process %u: addresses: %u, hits: %u (%.2f%%), misses: %u, "
+         "replaces caused: %u, pages replaced: %u, page table entries: %lu\n",
+         proc, numOfAddresses, pageTableHits, hit_percent,
+         numOfAddresses - pageTableHits, evictionsCaused, pagesEvicted,
+         pgtableEntries);
+
+  fflush(stdout);
+}
+
+/**
+ * @brief log trace prefetch statistics, printed after the summary when
+ *        the trace is read on a separate thread.
+ *
+ * @param waits - Number of times the consumer found no filled buffer
+ * @param waitSeconds - Total time the consumer spent waiting
+ */
+void log_prefetch_summary(unsigned long int waits, double waitSeconds) {
+  printf("Trace prefetch waits: %lu, wait time: %.3f ms\n",
+         waits, waitSeconds * 1000.0);
+
+  fflush(stdout);
+}
+
+/**
+ * @brief log page prefetching statistics, printed after the summary when
+ *        a prefetch policy is used.
+ *
+ * @param policy - Name of the prefetch policy
+ * @param depth - Pages the policy proposes per trigger
+ * @param issued - Number of pages prefetched
+ * @param useful - Number of prefetched pages accessed while resident
+ * @param unused - Number of prefetched pages replaced before any access
+ * @param evictions - Number of page replaces prefetching caused
+ * @param misses - Number of demand misses left
+ */
+void log_page_prefetch_summary(const char *policy,
+                               unsigned int depth,
+                               unsigned long int issued,
+                               unsigned long int useful,
+                               unsigned long int unused,
+                               unsigned long int evictions,
+                               unsigned int misses) {
+  /* accuracy: prefetches that were used; coverage: the misses they took
+     off what the faults would have been */
+  double accuracy = issued
+    ? (double) useful / (double) issued * 100.0
+    : 0.0;
+  double coverage = useful + misses
+    ? (double) useful / (double) (useful + misses) * 100.0
+    : 0.0;
+
+  printf("Prefetch policy: %s, pages per trigger: %u\n", policy, depth);
+  printf("Prefetched pages: %lu, used: %lu, replaced unused: %lu, replaces caused: %lu\n",
+         issued, useful, unused, evictions);
+  printf("Prefetch accuracy: %.2f%%, coverage: %.2f%%\n", accuracy, coverage);
+
+  fflush(stdout);
+}
+
+void log_sweep_config(unsigned int index, const char *config) {
+  printf("Config %u: %s\n", index, config);
+
+  fflush(stdout);
+}
+
+void log_mrc_header(unsigned int page_size,
+                    unsigned long int numOfAddresses,
+                    unsigned long int distinctPages,
+                    double sampleRate) {
+  printf("LRU miss ratio curve, page size: %d bytes\n", page_size);
+  printf("Addresses processed: %lu, distinct pages: %lu\n",
+         numOfAddresses, distinctPages);
+  if (sampleRate < 1.0)
+    printf("Sampled %.4g%% of pages\n", sampleRate * 100.0);
+  printf("Frames Miss ratio\n");
+
+  fflush(stdout);
+}
+
+void log_mrc_point(unsigned long int frames, double missRatio) {
+  printf("%lu %.6f\n", frames, missRatio);
+}
+
 // Additional functions needed by main.cpp
-void log_vpn2pfn(uint32_t va, const void *pt, int pfn, bool hit) {
+void log_vpn2pfn(vaddr_t va, const void *pt, int pfn, bool hit) {
   // Simple implementation - just show the mapping
-  printf("%08X -> %d (%s)\n", va, pfn, hit ? "HIT" : "MISS");
-  fflush(stdout);
+  char line[48];
+  char *p = put_hex(line, va, 8);
+
+  p = put_str(p, " -> ");
+  p = put_dec(p, pfn);
+  p = put_str(p, hit ? " (HIT)\n" : " (MISS)\n");
+  fwrite(line, 1, (size_t) (p - line), stdout);
 }
 
-void log_vpn2pfn_pr(uint32_t va, const void *pt, int pfn, bool hit, 
-                    bool didEvict, uint32_t evictedVPN, 
+void log_vpn2pfn_pr(vaddr_t va, const void *pt, int pfn, bool hit, 
+                    bool didEvict, vaddr_t evictedVPN, 
                     uint16_t evictedAgeBits, uint32_t offsetBits) {
   // Extract VPN from virtual address
-  uint32_t vpn = va >> offsetBits;
+  vaddr_t vpn = va >> offsetBits;
   
   // Implementation with page replacement info
-  printf("%08X -> %08X, pagetable %s", vpn, (uint32_t)pfn, hit ? "hit" : "miss");
+  char line[128];
+  char *p = put_hex(line, vpn, 8);
+
+  p = put_str(p, " -> ");
+  p = put_hex(p, (uint32_t)pfn, 8);
+  p = put_str(p, hit ? ", pagetable hit" : ", pagetable miss");
   if (didEvict) {
-    printf(", %08X page (with bitstring %04X) was replaced", evictedVPN, evictedAgeBits);
+    p = put_str(p, ", ");
+    p = put_hex(p, evictedVPN, 8);
+    p = put_str(p, " page (with bitstring ");
+    p = put_hex(p, evictedAgeBits, 4);
+    p = put_str(p, ") was replaced");
   }
-  printf("\n");
-  fflush(stdout);
+  *p++ = '\n';
+  fwrite(line, 1, (size_t) (p - line), stdout);
 }
 
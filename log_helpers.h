@@ -24,6 +24,7 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #endif 
+#include "vaddr_tracereader.h" /* vaddr_t */
 
 /*
  * structure that can be used to maintain which output types are enabled.
@@ -41,6 +42,14 @@ typedef struct {
   bool summary; /* summary statistics */
 } LogOptionsType;
 
+/**
+ * @brief Give stdout a large, fully buffered output buffer. The
+ *        per-address loggers do not flush; everything pending is
+ *        written when the buffer fills, by the summary loggers, or
+ *        at exit. Must be called before anything is written to stdout.
+ */
+void log_init_output(void);
+
 /**
  * @brief Print out a number in hex, one per line
  * @param number 
@@ -53,7 +62,7 @@ void print_num_inHex(uint32_t number);
  * @param levels - Number of levels
  * @param masks - Pointer to array of bitmasks
  */
-void log_bitmasks(int levels, uint32_t *masks);
+void log_bitmasks(int levels, vaddr_t *masks);
 
 /**
  * @brief Given a pair of numbers, output a line: 
@@ -87,7 +96,7 @@ void log_mapping(uint32_t src, uint32_t dest,
  * @param va 
  * @param pa 
  */
-void log_va2pa(uint32_t va, uint32_t pa);
+void log_va2pa(vaddr_t va, vaddr_t pa);
 
 /**
  * @brief log vpns at all levels and the mapped physical frame number
@@ -116,10 +125,135 @@ void log_summary(unsigned int page_size,
                  unsigned int numOfFramesAllocated,
                  unsigned long int pgtableEntries);
 
+/**
+ * @brief log TLB statistics, printed after the summary when a TLB is used.
+ *
+ * @param tlbEntries - Number of TLB entries
+ * @param tlbWays - Associativity of the TLB
+ * @param tlbHits - Number of translations served by the TLB
+ * @param tlbMisses - Number of translations that walked the page table
+ */
+void log_tlb_summary(unsigned int tlbEntries,
+                     unsigned int tlbWays,
+                     unsigned long int tlbHits,
+                     unsigned long int tlbMisses);
+
+/**
+ * @brief log huge page statistics, printed after the summary when huge
+ *        page promotion is enabled.
+ *
+ * @param promotions - Number of levels promoted to large mappings
+ * @param demotions - Number of large mappings split by an eviction
+ * @param tableBytes - Page table bytes in use at the end of the run
+ * @param tlbEntries - Number of TLB entries, 0 if no TLB is modelled
+ * @param tlbLargeHits - Number of TLB hits on large page entries
+ * @param tlbReachPages - Pages covered by the TLB at the end of the run
+ */
+void log_huge_page_summary(unsigned long int promotions,
+                           unsigned long int demotions,
+                           unsigned long int tableBytes,
+                           unsigned int tlbEntries,
+                           unsigned long int tlbLargeHits,
+                           unsigned long int tlbReachPages);
+
+/**
+ * @brief log write statistics and the estimated memory stall time, printed
+ *        after the summary when the write-back cost model is enabled.
+ *
+ * @param writes - Number of MEMWRITE accesses
+ * @param dirtyReplaces - Number of replaced pages that had been written
+ * @param cleanReplaces - Number of replaced pages that had not
+ * @param writebackBytes - Bytes written back for the dirty replacements
+ * @param faultMillis - Stall time reading pages in on misses
+ * @param writebackMillis - Stall time writing dirty pages back
+ */
+void log_writeback_summary(unsigned int writes,
+                           unsigned int dirtyReplaces,
+                           unsigned int cleanReplaces,
+                           unsigned long long int writebackBytes,
+                           double faultMillis,
+                           double writebackMillis);
+
+/**
+ * @brief log one process's share of the run, printed after the summary in
+ *        per-process page table mode.
+ *
+ * @param proc - Process id from the trace
+ * @param numOfAddresses - Number of addresses the process accessed
+ * @param pageTableHits - Number of those that hit
+ * @param evictionsCaused - Number of page replaces the process's misses caused
+ * @param pagesEvicted - Number of the process's pages that were replaced
+ * @param pgtableEntries - Number of entries in the process's page table
+ */
+void log_proc_summary(unsigned int proc,
+                      unsigned int numOfAddresses,
+                      unsigned int pageTableHits,
+                      unsigned int evictionsCaused,
+                      unsigned int pagesEvicted,
+                      unsigned long int pgtableEntries);
+
+/**
+ * @brief log trace prefetch statistics, printed after the summary when
+ *        the trace is read on a separate thread.
+ *
+ * @param waits - Number of times the consumer found no filled buffer
+ * @param waitSeconds - Total time the consumer spent waiting
+ */
+void log_prefetch_summary(unsigned long int waits, double waitSeconds);
+
+/**
+ * @brief log page prefetching statistics, printed after the summary when
+ *        a prefetch policy is used.
+ *
+ * @param policy - Name of the prefetch policy
+ * @param depth - Pages the policy proposes per trigger
+ * @param issued - Number of pages prefetched
+ * @param useful - Number of prefetched pages accessed while resident
+ * @param unused - Number of prefetched pages replaced before any access
+ * @param evictions - Number of page replaces prefetching caused
+ * @param misses - Number of demand misses left
+ */
+void log_page_prefetch_summary(const char *policy,
+                               unsigned int depth,
+                               unsigned long int issued,
+                               unsigned long int useful,
+                               unsigned long int unused,
+                               unsigned long int evictions,
+                               unsigned int misses);
+
+/**
+ * @brief log the configuration whose summary follows, in sweep mode.
+ *
+ * @param index - Position of the configuration in the sweep file, from 1
+ * @param config - Configuration as written in the sweep file
+ */
+void log_sweep_config(unsigned int index, const char *config);
+
+/**
+ * @brief log the header of an LRU miss ratio curve (mrc log mode).
+ *
+ * @param page_size - Number of bytes per page
+ * @param numOfAddresses - Number of addresses processed
+ * @param distinctPages - Number of distinct pages (estimated when sampled)
+ * @param sampleRate - Fraction of pages sampled, 1 when exact
+ */
+void log_mrc_header(unsigned int page_size,
+                    unsigned long int numOfAddresses,
+                    unsigned long int distinctPages,
+                    double sampleRate);
+
+/**
+ * @brief log one point of an LRU miss ratio curve.
+ *
+ * @param frames - Number of frames
+ * @param missRatio - Fraction of accesses that miss with that many frames
+ */
+void log_mrc_point(unsigned long int frames, double missRatio);
+
 // Additional functions needed by main.cpp
-void log_vpn2pfn(uint32_t va, const void *pt, int pfn, bool hit);
-void log_vpn2pfn_pr(uint32_t va, const void *pt, int pfn, bool hit, 
-                    bool didEvict, uint32_t evictedVPN, 
+void log_vpn2pfn(vaddr_t va, const void *pt, int pfn, bool hit);
+void log_vpn2pfn_pr(vaddr_t va, const void *pt, int pfn, bool hit, 
+                    bool didEvict, vaddr_t evictedVPN, 
                     uint16_t evictedAgeBits, uint32_t offsetBits);
 
 
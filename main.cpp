@@ -7,89 +7,83 @@
 #include <cstdint>
 #include <cerrno>
 #include <climits>
+#include <thread>
 #include <unistd.h>
+#include "checkpoint.h"
+#include "event_log.h"
+#include "instrument.h"
+#include "page_prefetch.h"
 #include "pagetable.h"
 #include "replacement.h"
+#include "shard.h"
+#include "simulator.h"
+#include "snapshot.h"
+#include "stack_distance.h"
+#include "sweep.h"
+#include "tlb.h"
+#include "trace_prefetch.h"
+#include "vaddr_tracereader.h"
 
 // Forward declarations for C functions
 extern "C" {
-    typedef struct {
-        unsigned int addr;
-        unsigned char reqtype;
-        unsigned char size;
-        unsigned char attr;
-        unsigned char proc;
-        unsigned int time;
-    } p2AddrTr;
-
-    int NextAddress(FILE *traceFile, p2AddrTr *outAddr);
-
-    void log_summary(unsigned int page_size, 
-                     unsigned int numOfPageReplaces,
-                     unsigned int pageTableHits, 
-                     unsigned int numOfAddresses, 
-                     unsigned int numOfFramesAllocated,
-                     unsigned long int pgtableEntries);
-    void log_bitmasks(int levels, uint32_t *masks);
-    void log_va2pa(unsigned int va, unsigned int pa);
+    void log_prefetch_summary(unsigned long int waits, double waitSeconds);
+    void log_bitmasks(int levels, vaddr_t *masks);
+    void log_va2pa(vaddr_t va, vaddr_t pa);
     void log_vpns_pfn(int levels, uint32_t *vpns, uint32_t frame);
-    void log_vpn2pfn(unsigned int va,
+    void log_vpn2pfn(vaddr_t va,
                      const PageTable *pt,
                      int pfn,
                      bool hit);
-    void log_vpn2pfn_pr(unsigned int va,
+    void log_vpn2pfn_pr(vaddr_t va,
                         const PageTable *pt,
                         int pfn,
                         bool hit,
                         bool didEvict,
-                        unsigned int evictedVPN,
+                        vaddr_t evictedVPN,
                         uint16_t evictedAgeBits,
                         unsigned int offsetBits);
     void print_num_inHex(unsigned int num);
+    void log_init_output(void);
 }
 
-// Simulation statistics
-struct Stats {
-    unsigned int addressesProcessed;
-    unsigned int hits;
-    unsigned int misses;
-    unsigned int evictions;
+// Records requested from the trace reader per batch
+static const size_t TRACE_BATCH_RECORDS = 4096;
+
+// Ring used by the -a prefetch thread
+static const size_t PREFETCH_BUFFER_RECORDS = 65536;
+static const unsigned int PREFETCH_BUFFER_COUNT = 4;
+
+// Output selected by -l, resolved once from its name
+enum LogMode {
+    LOG_NONE,       // unrecognized name: simulate without output
+    LOG_SUMMARY,
+    LOG_BITMASKS,
+    LOG_MRC,
+    LOG_VA2PA,
+    LOG_OFFSET,
+    LOG_VPN2PFN,
+    LOG_VPN2PFN_PR,
+    LOG_VPNS_PFN
 };
 
-static void initStats(Stats &s) {
-    s.addressesProcessed = 0;
-    s.hits = 0;
-    s.misses = 0;
-    s.evictions = 0;
-}
-
-// Count the number of page table entries recursively
-static unsigned int countEntriesRecursiveLocal(PageTable *pt, Level *lvl)
+static LogMode parseLogMode(const char *name)
 {
-    if (!lvl) return 0;
-
-    bool leaf = (lvl->depth == pt->levelCount - 1);
-
-    unsigned int sum = 0;
-    if (leaf) {
-        if (lvl->mapArray) {
-            // Count all allocated entries in leaf level
-            sum = lvl->entryCount;
-        }
-    } else {
-        if (lvl->nextLevelArray) {
-            for (unsigned int i = 0; i < lvl->entryCount; i++) {
-                if (lvl->nextLevelArray[i] != nullptr) {
-                    sum += 1; 
-                }
-            }
-            // Recurse into each child
-            for (unsigned int i = 0; i < lvl->entryCount; i++) {
-                sum += countEntriesRecursiveLocal(pt, lvl->nextLevelArray[i]);
-            }
+    static const struct { const char *name; LogMode mode; } modes[] = {
+        { "summary",    LOG_SUMMARY },
+        { "bitmasks",   LOG_BITMASKS },
+        { "mrc",        LOG_MRC },
+        { "va2pa",      LOG_VA2PA },
+        { "offset",     LOG_OFFSET },
+        { "vpn2pfn",    LOG_VPN2PFN },
+        { "vpn2pfn_pr", LOG_VPN2PFN_PR },
+        { "vpns_pfn",   LOG_VPNS_PFN },
+    };
+    for (const auto &m : modes) {
+        if (strcmp(name, m.name) == 0) {
+            return m.mode;
         }
     }
-    return sum;
+    return LOG_NONE;
 }
 
 // Main
@@ -101,10 +95,30 @@ int main(int argc, char **argv)
     unsigned int haveF = 0;
     unsigned int bitInterval = 10;      // -b
     unsigned int haveB = 0;
-    const char* logMode = "summary";    // -l
+    LogMode logMode = LOG_SUMMARY;      // -l
+    unsigned int tlbEntries = 0;        // -t, 0 means no TLB
+    unsigned int tlbWays = 4;
+    bool asyncRead = false;             // -a
+    const char* sweepPath = nullptr;    // -s
+    unsigned int sweepThreads = std::thread::hardware_concurrency(); // -j
+    double sampleRate = 1.0;            // -r, mrc page sampling
+    const char* eventPath = nullptr;    // -e, binary event log
+    unsigned long snapshotAddresses = 0; // -i, snapshot every N addresses
+    double snapshotSeconds = 0;         // -I, snapshot every T seconds
+    bool perProcess = false;            // -P, a page table per trace proc
+    const char* shardSpec = nullptr;    // -S, sharded parallel simulation
+    WriteBackModel writeBack = {false, 0, 0}; // -w, write-back cost model
+    bool preferClean = false;           // -c, aging evicts clean pages first
+    bool hugePages = false;             // -H, promote full levels to large pages
+    PageTableBackend backend = PT_RADIX; // -B, page table organisation
+    unsigned int addressBits = VADDR_BITS; // -A, translated address width
+    CheckpointSchedule checkpoints = {nullptr, 0, 0}; // -C, periodic checkpoints
+    const char* resumePath = nullptr;   // -R, checkpoint to resume from
+    PagePrefetcher *pagePrefetch = nullptr; // -F, pages brought in with a fault
+    const ReplacementPolicy *policy = &agingPolicy; // -p
 
     int opt;
-    while ( (opt = getopt(argc, argv, "n:f:b:l:")) != -1 ) {
+    while ( (opt = getopt(argc, argv, "n:f:b:l:p:t:as:j:r:e:i:I:PS:w:cHB:A:C:R:F:")) != -1 ) {
         switch(opt) {
         case 'n':
             limitN = (unsigned int) atoi(optarg);
@@ -122,6 +136,11 @@ int main(int argc, char **argv)
                         "Number of available frames must be a number and greater than 0\n");
                 return 1;
             }
+            if (strtoul(optarg, nullptr, 10) > PTE_FRAME_COUNT) {
+                fprintf(stderr,
+                        "Number of available frames can be at most %u\n", PTE_FRAME_COUNT);
+                return 1;
+            }
             haveF = 1;
             break;
         case 'b':
@@ -134,7 +153,135 @@ int main(int argc, char **argv)
             haveB = 1;
             break;
         case 'l':
-            logMode = optarg;
+            logMode = parseLogMode(optarg);
+            break;
+        case 'p':
+            policy = findReplacementPolicy(optarg);
+            if (!policy) {
+                fprintf(stderr, "Unknown replacement policy %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 't':
+            // -t <entries>[:<ways>]
+            if (!parseTlbSpec(optarg, tlbEntries, tlbWays)) {
+                fprintf(stderr,
+                        "TLB entries must be a power-of-two multiple of its ways\n");
+                return 1;
+            }
+            break;
+        case 'a':
+            asyncRead = true;
+            break;
+        case 's':
+            sweepPath = optarg;
+            break;
+        case 'j':
+            sweepThreads = (unsigned int) atoi(optarg);
+            if (sweepThreads < 1) {
+                fprintf(stderr,
+                        "Number of sweep threads must be a number and greater than 0\n");
+                return 1;
+            }
+            break;
+        case 'r':
+            sampleRate = atof(optarg);
+            if (!(sampleRate > 0 && sampleRate <= 1)) {
+                fprintf(stderr,
+                        "Sampling rate must be greater than 0 and at most 1\n");
+                return 1;
+            }
+            break;
+        case 'e':
+            eventPath = optarg;
+            break;
+        case 'i':
+            snapshotAddresses = strtoul(optarg, nullptr, 10);
+            if (snapshotAddresses < 1) {
+                fprintf(stderr,
+                        "Snapshot interval must be a number and greater than 0\n");
+                return 1;
+            }
+            break;
+        case 'I':
+            snapshotSeconds = atof(optarg);
+            if (!(snapshotSeconds > 0)) {
+                fprintf(stderr,
+                        "Snapshot interval must be a number and greater than 0\n");
+                return 1;
+            }
+            break;
+        case 'P':
+            perProcess = true;
+            break;
+        case 'S':
+            shardSpec = optarg;
+            break;
+        case 'w': {
+            // -w <fault_us>[:<writeback_us>], write-back defaults to the fault
+            char *end;
+            writeBack.faultMicros = strtod(optarg, &end);
+            writeBack.writebackMicros = writeBack.faultMicros;
+            if (*end == ':') {
+                writeBack.writebackMicros = strtod(end + 1, &end);
+            }
+            if (*end != '\0' || !(writeBack.faultMicros >= 0) ||
+                !(writeBack.writebackMicros >= 0))
+            {
+                fprintf(stderr,
+                        "Latencies must be numbers of microseconds, at least 0\n");
+                return 1;
+            }
+            writeBack.enabled = true;
+            break;
+        }
+        case 'c':
+            preferClean = true;
+            break;
+        case 'H':
+            hugePages = true;
+            break;
+        case 'B':
+            if (strcmp(optarg, "radix") == 0) {
+                backend = PT_RADIX;
+            } else if (strcmp(optarg, "sparse") == 0) {
+                backend = PT_SPARSE;
+            } else if (strcmp(optarg, "hash") == 0) {
+                backend = PT_HASHED;
+            } else {
+                fprintf(stderr, "Page table backend must be radix, sparse or hash\n");
+                return 1;
+            }
+            break;
+        case 'A':
+            addressBits = (unsigned int) atoi(optarg);
+            if (addressBits < 8 || addressBits > VADDR_BITS) {
+                fprintf(stderr, "Address width must be between 8 and %d bits\n",
+                        VADDR_BITS);
+                return 1;
+            }
+            break;
+        case 'C':
+            // -C <addresses>:<file>
+            if (!parseCheckpointSpec(optarg, checkpoints)) {
+                fprintf(stderr,
+                        "Checkpoints must be given as <addresses>:<file>, every at least 1 address\n");
+                return 1;
+            }
+            break;
+        case 'R':
+            resumePath = optarg;
+            break;
+        case 'F':
+            // -F <policy>[:<pages>]
+            destroyPagePrefetcher(pagePrefetch);
+            pagePrefetch = createPagePrefetcher(optarg);
+            if (!pagePrefetch) {
+                fprintf(stderr,
+                        "Prefetching must be seq, stride or markov, with at most %u pages (%u for markov)\n",
+                        PREFETCH_MAX_DEPTH, MARKOV_SUCCESSORS);
+                return 1;
+            }
             break;
         default:
             fprintf(stderr, "Bad argument\n");
@@ -143,22 +290,71 @@ int main(int argc, char **argv)
     }
     int idx = optind;
 
+    // Per-address modes write one line per record; buffer them
+    log_init_output();
+
+    if (eventPath && (sweepPath || logMode == LOG_MRC)) {
+        fprintf(stderr, "Event log is not available in sweep or mrc mode\n");
+        return 1;
+    }
+    if ((snapshotAddresses || snapshotSeconds > 0) &&
+        (sweepPath || logMode == LOG_MRC)) {
+        fprintf(stderr, "Snapshots are not available in sweep or mrc mode\n");
+        return 1;
+    }
+    if ((writeBack.enabled || preferClean) &&
+        (sweepPath || shardSpec || logMode == LOG_MRC))
+    {
+        fprintf(stderr, "Write-back modelling is not available in sweep, sharded or mrc mode\n");
+        return 1;
+    }
+    if (hugePages && (sweepPath || shardSpec || logMode == LOG_MRC)) {
+        fprintf(stderr, "Huge pages are not available in sweep, sharded or mrc mode\n");
+        return 1;
+    }
+    if (backend != PT_RADIX && (sweepPath || shardSpec || logMode == LOG_MRC)) {
+        fprintf(stderr, "The sparse and hashed page tables are not available in sweep, sharded or mrc mode\n");
+        return 1;
+    }
+    if (hugePages && backend == PT_HASHED) {
+        fprintf(stderr, "Huge pages need the radix page table\n");
+        return 1;
+    }
+    if (addressBits != VADDR_BITS && (sweepPath || shardSpec)) {
+        fprintf(stderr, "The address width is not available in sweep or sharded mode\n");
+        return 1;
+    }
+    if ((checkpoints.path || resumePath) &&
+        (sweepPath || shardSpec || logMode == LOG_MRC))
+    {
+        fprintf(stderr, "Checkpoints are not available in sweep, sharded or mrc mode\n");
+        return 1;
+    }
+    if (pagePrefetch && (sweepPath || shardSpec || logMode == LOG_MRC)) {
+        fprintf(stderr, "Page prefetching is not available in sweep, sharded or mrc mode\n");
+        return 1;
+    }
+    if (perProcess && (sweepPath || logMode == LOG_MRC)) {
+        fprintf(stderr, "Per-process page tables are not available in sweep or mrc mode\n");
+        return 1;
+    }
+
     if (idx >= argc) {
         fprintf(stderr, "Missing trace file\n");
         return 1;
     }
 
     const char* tracePath = argv[idx++];
-    FILE *traceFile = fopen(tracePath, "rb");
-    if (!traceFile) {
+    TraceReader *reader = OpenTraceReader(tracePath);
+    if (!reader) {
         fprintf(stderr, "Unable to open %s\n", tracePath);
         return 1;
     }
 
-    // Remaining args are level bits
-    if (idx >= argc) {
+    // Remaining args are level bits (sweep lines may supply their own)
+    if (idx >= argc && !sweepPath) {
         fprintf(stderr, "Missing level bits\n");
-        fclose(traceFile);
+        CloseTraceReader(reader);
         return 1;
     }
 
@@ -173,7 +369,7 @@ int main(int argc, char **argv)
             fprintf(stderr,
                     "Level %u page table must be at least 1 bit\n",
                     levelCount);
-            fclose(traceFile);
+            CloseTraceReader(reader);
             return 1;
         }
         tempBits[levelCount] = bits;
@@ -182,135 +378,341 @@ int main(int argc, char **argv)
         idx++;
     }
 
-    if (sumBits > 28) {
+    // Leave at least a 16 byte page, and no more than 2^31 bytes so page
+    // sizes and offsets still fit 32 bits
+    if (sumBits > addressBits - 4) {
         fprintf(stderr, "Too many bits used in page tables\n");
-        fclose(traceFile);
+        CloseTraceReader(reader);
         return 1;
     }
+    if (addressBits - sumBits > 31) {
+        fprintf(stderr, "Too few bits used in page tables\n");
+        CloseTraceReader(reader);
+        return 1;
+    }
+
+    // Sweep mode: every configuration in the file shares one trace pass
+    if (sweepPath) {
+        if (logMode != LOG_SUMMARY) {
+            fprintf(stderr, "Sweep mode only supports summary logging\n");
+            CloseTraceReader(reader);
+            return 1;
+        }
 
-    // Build page table
-    PageTable *pt = createPageTable(levelCount, tempBits);
+        // Command line settings are the defaults for each line
+        SweepConfig defaults;
+        defaults.maxFrames = maxFrames;
+        defaults.bitInterval = bitInterval;
+        defaults.policy = policy;
+        defaults.tlbEntries = tlbEntries;
+        defaults.tlbWays = tlbWays;
+        defaults.levelBits.assign(tempBits, tempBits + levelCount);
+
+        std::vector<SweepConfig> configs;
+        if (!loadSweepConfigs(sweepPath, defaults, configs)) {
+            CloseTraceReader(reader);
+            return 1;
+        }
+
+        TracePrefetcher *prefetch = nullptr;
+        if (asyncRead) {
+            prefetch = startTracePrefetch(reader, PREFETCH_BUFFER_RECORDS,
+                                          PREFETCH_BUFFER_COUNT);
+        }
+        runSweep(reader, prefetch, configs,
+                 sweepThreads ? sweepThreads : 1,
+                 haveLimitN ? limitN : 0);
+        INSTRUMENT_DUMP(stdout);
+        if (prefetch) {
+            log_prefetch_summary(prefetchWaitCount(prefetch),
+                                 prefetchWaitSeconds(prefetch));
+            stopTracePrefetch(prefetch);
+        }
+        CloseTraceReader(reader);
+        return 0;
+    }
+
+    // Sharded mode: independent shards simulated on worker threads
+    if (shardSpec) {
+        ShardConfig shardConfig;
+        if (!parseShardSpec(shardSpec, shardConfig)) {
+            fprintf(stderr, "Shards must be proc or vpn:<count>\n");
+            CloseTraceReader(reader);
+            return 1;
+        }
+        if (logMode != LOG_SUMMARY || eventPath || perProcess ||
+            snapshotAddresses || snapshotSeconds > 0)
+        {
+            fprintf(stderr, "Sharded mode only supports summary logging\n");
+            CloseTraceReader(reader);
+            return 1;
+        }
+        if (shardConfig.mode == SHARD_VPN && maxFrames != UINT_MAX &&
+            maxFrames < shardConfig.shards)
+        {
+            fprintf(stderr, "Every shard needs at least one frame\n");
+            CloseTraceReader(reader);
+            return 1;
+        }
+        shardConfig.levelCount = levelCount;
+        shardConfig.levelBits = tempBits;
+        shardConfig.maxFrames = maxFrames;
+        shardConfig.bitInterval = bitInterval;
+        shardConfig.policy = policy;
+        shardConfig.tlbEntries = tlbEntries;
+        shardConfig.tlbWays = tlbWays;
+
+        TracePrefetcher *prefetch = nullptr;
+        if (asyncRead) {
+            prefetch = startTracePrefetch(reader, PREFETCH_BUFFER_RECORDS,
+                                          PREFETCH_BUFFER_COUNT);
+        }
+        runSharded(reader, prefetch, shardConfig,
+                   sweepThreads ? sweepThreads : 1,
+                   haveLimitN ? limitN : 0);
+        INSTRUMENT_DUMP(stdout);
+        if (prefetch) {
+            log_prefetch_summary(prefetchWaitCount(prefetch),
+                                 prefetchWaitSeconds(prefetch));
+            stopTracePrefetch(prefetch);
+        }
+        CloseTraceReader(reader);
+        return 0;
+    }
+
+    // Build page table, replacement state and TLB (validated above)
+    Simulator *sim = createSimulator(levelCount, tempBits, maxFrames,
+                                     bitInterval, policy,
+                                     tlbEntries, tlbWays, perProcess,
+                                     backend, addressBits);
+    sim->writeBack = writeBack;
+    sim->rs.preferClean = preferClean;
+    sim->pt->hugePages = hugePages;
+    sim->prefetch = pagePrefetch;
+    PageTable *pt = sim->pt;
 
     // If mode is just "bitmasks", we only print bitmask info then exit
-    if (strcmp(logMode, "bitmasks") == 0) {
+    if (logMode == LOG_BITMASKS) {
         // instructor helper
         log_bitmasks(pt->levelCount, pt->levelMask);
-        destroyPageTable(pt);
-        fclose(traceFile);
+        destroySimulator(sim);
+        CloseTraceReader(reader);
         return 0;
     }
 
-    // Initialize replacement state
-    ReplacementState rs;
-    initReplacementState(rs, maxFrames, bitInterval);
-
-    Stats stats;
-    initStats(stats);
-
-    // Main loop: read addresses
-    p2AddrTr rec;
-    while (1) {
-        if (haveLimitN && stats.addressesProcessed >= limitN) {
-            break;  // Reached -n
+    // Pick up where a checkpointed run left off: restore its state and skip
+    // the records it had already simulated
+    if (resumePath) {
+        if (!restoreCheckpoint(*sim, resumePath)) {
+            destroySimulator(sim);
+            CloseTraceReader(reader);
+            return 1;
+        }
+        size_t skip = sim->stats.addressesProcessed;
+        if (SkipAddresses(reader, skip) != skip) {
+            fprintf(stderr, "%s is shorter than the run checkpointed in %s\n",
+                    tracePath, resumePath);
+            destroySimulator(sim);
+            CloseTraceReader(reader);
+            return 1;
         }
+    }
+    if (checkpoints.path) {
+        initCheckpointSchedule(checkpoints, *sim);
+    }
 
-        int ok = NextAddress(traceFile, &rec);
-        if (!ok) break; // EOF
+    // Per-access binary records, alongside any text logging
+    EventLog *events = nullptr;
+    if (eventPath) {
+        events = openEventLog(eventPath, pt);
+        if (!events) {
+            fprintf(stderr, "Unable to open %s\n", eventPath);
+            destroySimulator(sim);
+            CloseTraceReader(reader);
+            return 1;
+        }
+    }
 
-        unsigned int va = rec.addr;
-        stats.addressesProcessed++;
+    // Read ahead on a producer thread if asked
+    TracePrefetcher *prefetch = nullptr;
+    if (asyncRead) {
+        prefetch = startTracePrefetch(reader, PREFETCH_BUFFER_RECORDS,
+                                      PREFETCH_BUFFER_COUNT);
+    }
 
-        // Tick time / maybe aging update
-        tickReplacementClock(rs);
+    // Miss ratio curve: LRU stack distances instead of the aging simulation
+    if (logMode == LOG_MRC) {
+        StackDistance *sd = createStackDistance(sampleRate);
+        const p2AddrTr *batch;
+        size_t batchCount;
+        unsigned long processed = 0;
+        while (!haveLimitN || processed < limitN) {
+            size_t want = prefetch ? SIZE_MAX : TRACE_BATCH_RECORDS;
+            if (haveLimitN && limitN - processed < want) {
+                want = limitN - processed;
+            }
+            INSTRUMENT_TIMER_START(readStart);
+            batchCount = nextTraceBatch(reader, prefetch, want, &batch);
+            INSTRUMENT_TIMER_STOP(IT_TRACE_READ, readStart);
+            if (batchCount == 0) break; // EOF
+            for (size_t r = 0; r < batchCount; r++) {
+                stackDistanceAccess(sd, getFullVPN(pt, batch[r].addr));
+            }
+            processed += batchCount;
+        }
+        stopTracePrefetch(prefetch);
 
-        // Look up in page table
-        Map *m = searchMappedPfn(pt, va);
+        logMissRatioCurve(sd, 1u << pt->offsetBits);
+        INSTRUMENT_DUMP(stdout);
+        destroyStackDistance(sd);
+        destroySimulator(sim);
+        CloseTraceReader(reader);
+        return 0;
+    }
 
-        bool hit = (m != nullptr);
-        bool didFault = false;
-        bool didEvict = false;
-        unsigned int evictedVPN = 0;
-        uint16_t evictedAgeBits = 0;
+    // Modes without per-access output can batch their walks
+    bool batchedWalks = !events && (logMode == LOG_SUMMARY || logMode == LOG_NONE);
 
-        int pfn = -1;
+    SnapshotReporter reporter;
+    bool snapshots = snapshotAddresses > 0 || snapshotSeconds > 0;
+    if (snapshots) {
+        initSnapshotReporter(reporter, stderr, snapshotAddresses,
+                             snapshotSeconds, *sim);
+    }
 
-        unsigned int fullVPN = getFullVPN(pt, va);
+    // Trace address bits above the translated width are ignored
+    const vaddr_t addressMask = addressBits < VADDR_BITS
+        ? ((vaddr_t)1 << addressBits) - 1u : ~(vaddr_t)0;
 
-        if (hit) {
-            // Page hit
-            pfn = m->frameNumber;
-            stats.hits++;
-        } else {
-            // Miss / demand paging
-            stats.misses++;
+    // Main loop: consume the trace in batches of records
+    const p2AddrTr *batch;
+    size_t batchCount;
+    while (1) {
+        // The prefetcher hands out whole buffers; only -n trims them
+        size_t want = prefetch ? SIZE_MAX : TRACE_BATCH_RECORDS;
+        if (haveLimitN) {
+            if (sim->stats.addressesProcessed >= limitN) {
+                break;  // Reached -n
+            }
+            if (limitN - sim->stats.addressesProcessed < want) {
+                want = limitN - sim->stats.addressesProcessed;
+            }
+        }
 
-            // EnsureResidentPage also updates pageTable for us
-            pfn = ensureResidentPage(pt,
-                                     rs,
-                                     va,
-                                     fullVPN,
-                                     didFault,
-                                     didEvict,
-                                     evictedVPN,
-                                     evictedAgeBits);
+        INSTRUMENT_TIMER_START(readStart);
+        batchCount = nextTraceBatch(reader, prefetch, want, &batch);
+        INSTRUMENT_TIMER_STOP(IT_TRACE_READ, readStart);
+        if (batchCount == 0) break; // EOF
+
+        // Snapshots and checkpoints split the batch so an address
+        // interval ends exactly at a segment boundary
+        size_t done = 0;
+        while (done < batchCount) {
+            size_t segment = snapshots
+                ? snapshotSegment(reporter, batchCount - done)
+                : batchCount - done;
+            if (checkpoints.path) {
+                segment = checkpointSegment(checkpoints, segment);
+            }
 
-            if (didEvict) {
-                stats.evictions++;
+            if (batchedWalks) {
+                simulateBatch(*sim, batch + done, segment);
+            } else {
+                for (size_t r = done; r < done + segment; r++) {
+                    vaddr_t va = batch[r].addr & addressMask;
+
+                    AccessResult res;
+                    simulateAccess(*sim, va, res, batch[r].proc,
+                                   batch[r].reqtype == MEMWRITE);
+                    int pfn = res.pfn;
+
+                    if (events) {
+                        logEvent(events, va, res);
+                    }
+
+                    // Compute PA / offset for logging
+                    unsigned int offset = getOffsetFromVA(pt, va);
+                    vaddr_t pa = composePhysicalAddress(pt, pfn, offset);
+
+                    // Logging per-address depending on logMode
+                    INSTRUMENT_TIMER_START(logStart);
+                    switch (logMode) {
+                    case LOG_VA2PA:
+                        log_va2pa(va, pa);
+                        break;
+                    case LOG_OFFSET:
+                        print_num_inHex(offset);
+                        break;
+                    case LOG_VPN2PFN:
+                        // Simple mapping info, no eviction details
+                        log_vpn2pfn(va, pt, pfn, res.hit);
+                        break;
+                    case LOG_VPN2PFN_PR:
+                        // With page replacement info
+                        log_vpn2pfn_pr(va,
+                                       pt,
+                                       pfn,
+                                       res.hit,
+                                       res.didEvict,
+                                       res.evictedVPN,
+                                       res.evictedAgeBits,
+                                       pt->offsetBits);
+                        break;
+                    case LOG_VPNS_PFN: {
+                        // VPNs for each level and frame number (levels are
+                        // bounded like tempBits, so the buffer stays on the stack)
+                        unsigned int vpns[32];
+                        for (unsigned int i = 0; i < pt->levelCount; i++) {
+                            vpns[i] = extractVPNFromVirtualAddress(va, pt->levelMask[i], pt->levelShift[i]);
+                        }
+                        log_vpns_pfn(pt->levelCount, vpns, pfn);
+                        break;
+                    }
+                    default:
+                        break;
+                    }
+                    INSTRUMENT_TIMER_STOP(IT_LOGGING, logStart);
+                }
             }
-        }
 
-        // Track access in replacement state
-        noteFrameAccess(rs, fullVPN, pfn);
-
-        // Compute PA / offset for logging
-        unsigned int offset = getOffsetFromVA(pt, va);
-        unsigned int pa = composePhysicalAddress(pt, pfn, offset);
-
-        // Logging per-address depending on logMode
-        if (strcmp(logMode, "va2pa") == 0) {
-            log_va2pa(va, pa);
-        } else if (strcmp(logMode, "offset") == 0) {
-            print_num_inHex(offset);
-        } else if (strcmp(logMode, "vpn2pfn") == 0) {
-            // Simple mapping info, no eviction details
-            log_vpn2pfn(va, pt, pfn, hit);
-        } else if (strcmp(logMode, "vpn2pfn_pr") == 0) {
-            // With page replacement info
-            log_vpn2pfn_pr(va,
-                           pt,
-                           pfn,
-                           hit,
-                           didEvict,
-                           evictedVPN,
-                           evictedAgeBits,
-                           pt->offsetBits);
-        } else if (strcmp(logMode, "vpns_pfn") == 0) {
-            // VPNs for each level and frame number
-            unsigned int *vpns = new unsigned int[pt->levelCount];
-            for (unsigned int i = 0; i < pt->levelCount; i++) {
-                vpns[i] = extractVPNFromVirtualAddress(va, pt->levelMask[i], pt->levelShift[i]);
+            done += segment;
+            if (snapshots) {
+                snapshotAdvance(reporter, *sim, segment);
+            }
+            if (checkpoints.path &&
+                !checkpointAdvance(checkpoints, *sim, segment))
+            {
+                fprintf(stderr, "Unable to write checkpoint %s\n", checkpoints.path);
             }
-            log_vpns_pfn(pt->levelCount, vpns, pfn);
-            delete[] vpns;
-        } else {
-            // "Summary" mode doesn't log per-line
         }
     }
 
+    // Stop the producer before the reader goes away
+    unsigned long prefetchWaits = 0;
+    double prefetchWaitSec = 0;
+    if (prefetch) {
+        prefetchWaits = prefetchWaitCount(prefetch);
+        prefetchWaitSec = prefetchWaitSeconds(prefetch);
+        stopTracePrefetch(prefetch);
+    }
+
+    if (events && !closeEventLog(events)) {
+        fprintf(stderr, "Unable to write %s\n", eventPath);
+        destroySimulator(sim);
+        CloseTraceReader(reader);
+        return 1;
+    }
+
     // End of trace, produce summary if mode == summary
-    if (strcmp(logMode, "summary") == 0) {
-        unsigned int pageTableEntries =
-            countEntriesRecursiveLocal(pt, pt->rootLevel);
-        
-        // Calculate page size from offset bits
-        unsigned int pageSize = 1u << pt->offsetBits;
-        
-        // Call log_summary with proper parameters
-        log_summary(pageSize, stats.evictions, stats.hits, 
-                   stats.addressesProcessed, rs.nextFreeFrame, pageTableEntries);
+    if (logMode == LOG_SUMMARY) {
+        logSimulatorSummary(*sim);
+        if (asyncRead) {
+            log_prefetch_summary(prefetchWaits, prefetchWaitSec);
+        }
     }
+    INSTRUMENT_DUMP(stdout);
 
-    destroyPageTable(pt);
-    fclose(traceFile);
+    destroySimulator(sim);
+    CloseTraceReader(reader);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,143 @@
+#include "page_prefetch.h"
+#include "pagetable.h"
+#include <cstdlib>
+#include <cstring>
+
+// Sequential read-ahead: the depth pages after the trigger
+
+static unsigned int sequentialPredict(PagePrefetcher &pf, const PrefetchHistory &h,
+                                      vaddr_t tag, vaddr_t vpn, vaddr_t *out)
+{
+    (void)h;
+    (void)tag;
+    for (unsigned int i = 0; i < pf.depth; i++) {
+        out[i] = vpn + 1 + i;
+    }
+    return pf.depth;
+}
+
+// Stride: once the proc's last two triggers were the same distance apart,
+// the depth pages further along that stride, in either direction
+
+static unsigned int stridePredict(PagePrefetcher &pf, const PrefetchHistory &h,
+                                  vaddr_t tag, vaddr_t vpn, vaddr_t *out)
+{
+    (void)tag;
+    vaddr_t stride = vpn - h.lastVPN;
+    if (h.triggers < 2 || stride != h.stride || stride == 0) return 0;
+
+    vaddr_t next = vpn;
+    for (unsigned int i = 0; i < pf.depth; i++) {
+        next += stride;
+        out[i] = next;
+    }
+    return pf.depth;
+}
+
+// Markov: a table from each trigger page to the pages that triggered next
+// (in the same proc's stream), most recent first. Direct mapped; a page
+// whose slot another took over starts again with no successors.
+
+static MarkovEntry &markovSlot(PagePrefetcher &pf, vaddr_t page)
+{
+    uint32_t h = (foldVPN(page) * 2654435761u) >> (32 - MARKOV_TABLE_BITS);
+    return pf.markov[h];
+}
+
+static unsigned int markovPredict(PagePrefetcher &pf, const PrefetchHistory &h,
+                                  vaddr_t tag, vaddr_t vpn, vaddr_t *out)
+{
+    // Learn the transition that led here
+    if (h.triggers > 0 && h.lastVPN != vpn) {
+        MarkovEntry &e = markovSlot(pf, tag | h.lastVPN);
+        if (e.count == 0 || e.page != (tag | h.lastVPN)) {
+            e.page = tag | h.lastVPN;
+            e.count = 0;
+        }
+        unsigned int j = 0;
+        while (j < e.count && e.next[j] != vpn) j++;
+        if (j == e.count && e.count < MARKOV_SUCCESSORS) e.count++;
+        if (j == MARKOV_SUCCESSORS) j--;
+        for (; j > 0; j--) {
+            e.next[j] = e.next[j - 1];
+        }
+        e.next[0] = vpn;
+    }
+
+    const MarkovEntry &e = markovSlot(pf, tag | vpn);
+    if (e.count == 0 || e.page != (tag | vpn)) return 0;
+    unsigned int n = e.count < pf.depth ? e.count : pf.depth;
+    for (unsigned int i = 0; i < n; i++) {
+        out[i] = e.next[i];
+    }
+    return n;
+}
+
+const PagePrefetchPolicy sequentialPrefetch = {
+    "seq", 4, PREFETCH_MAX_DEPTH, sequentialPredict
+};
+
+const PagePrefetchPolicy stridePrefetch = {
+    "stride", 4, PREFETCH_MAX_DEPTH, stridePredict
+};
+
+const PagePrefetchPolicy markovPrefetch = {
+    "markov", 2, MARKOV_SUCCESSORS, markovPredict
+};
+
+// Parse "<policy>[:<pages>]"
+PagePrefetcher *createPagePrefetcher(const char *spec)
+{
+    static const PagePrefetchPolicy *const policies[] = {
+        &sequentialPrefetch, &stridePrefetch, &markovPrefetch
+    };
+    const char *colon = strchr(spec, ':');
+    size_t nameLength = colon ? (size_t)(colon - spec) : strlen(spec);
+
+    const PagePrefetchPolicy *policy = nullptr;
+    for (const PagePrefetchPolicy *p : policies) {
+        if (strlen(p->name) == nameLength && strncmp(p->name, spec, nameLength) == 0) {
+            policy = p;
+        }
+    }
+    if (!policy) return nullptr;
+
+    unsigned int depth = policy->defaultDepth;
+    if (colon) {
+        char *end;
+        unsigned long pages = strtoul(colon + 1, &end, 10);
+        if (end == colon + 1 || *end != '\0' || pages < 1 || pages > policy->maxDepth) {
+            return nullptr;
+        }
+        depth = (unsigned int)pages;
+    }
+
+    PagePrefetcher *pf = new PagePrefetcher;
+    pf->policy = policy;
+    pf->depth = depth;
+    pf->stats = PrefetchStats{0, 0, 0, 0};
+    memset(pf->history, 0, sizeof(pf->history));
+    if (policy == &markovPrefetch) {
+        pf->markov.assign((size_t)1 << MARKOV_TABLE_BITS, MarkovEntry());
+    }
+    return pf;
+}
+
+// Destroy a prefetcher
+void destroyPagePrefetcher(PagePrefetcher *pf)
+{
+    delete pf;
+}
+
+// Run the policy on a trigger and record it in the proc's history
+unsigned int predictPrefetches(PagePrefetcher &pf, unsigned int proc,
+                               vaddr_t tag, vaddr_t vpn, vaddr_t *out)
+{
+    PrefetchHistory &h = pf.history[proc & 0xFF];
+    unsigned int n = pf.policy->predict(pf, h, tag, vpn, out);
+
+    h.stride = vpn - h.lastVPN;
+    h.lastVPN = vpn;
+    if (h.triggers < 2) h.triggers++;
+    return n;
+}
@@ -0,0 +1,122 @@
+#ifndef PAGE_PREFETCH_H
+#define PAGE_PREFETCH_H
+
+#include <cstdint>
+#include <vector>
+#include "vaddr_tracereader.h" // for vaddr_t
+
+// Page prefetching (-F): besides the page a fault asks for, bring in the
+// pages a policy expects to be wanted next, the way OS read-ahead does.
+// A policy is run on a trigger: a demand fault, or the first access to a
+// page that was prefetched, so a stream that prefetching keeps from
+// faulting still moves the window along. Prefetched pages are loaded after
+// the triggering access, through ensureResidentPage like any other, and
+// are tagged by frame until they are first accessed (a useful prefetch) or
+// replaced without ever being accessed.
+
+struct PagePrefetcher;
+
+// A trace proc's recent triggers, which the policies learn from
+struct PrefetchHistory {
+    vaddr_t lastVPN;            // page of the last trigger
+    vaddr_t stride;             // lastVPN less the page before it
+    uint32_t triggers;          // triggers seen, saturating at 2
+    uint32_t unused;
+};
+
+// Markov prediction: the pages that triggered next after a page, most
+// recent first
+static const unsigned int MARKOV_SUCCESSORS = 4;
+static const unsigned int MARKOV_TABLE_BITS = 16;
+
+struct MarkovEntry {
+    vaddr_t page;               // tagged page the successors followed
+    vaddr_t next[MARKOV_SUCCESSORS]; // untagged, in page's table
+    uint32_t count;             // successors held, 0 for an empty entry
+    uint32_t unused;
+};
+
+// Prefetch policy engine. The simulator owns loading and tagging; an
+// engine only learns from triggers and proposes pages.
+struct PagePrefetchPolicy {
+    const char *name;
+    unsigned int defaultDepth;  // pages proposed per trigger without :<pages>
+    unsigned int maxDepth;
+
+    // Page vpn of the table whose pages are keyed tag | VPN triggered in
+    // the stream h (still holding the trigger before). Write at most
+    // pf.depth pages of that table to prefetch to out, return how many.
+    unsigned int (*predict)(PagePrefetcher &pf, const PrefetchHistory &h,
+                            vaddr_t tag, vaddr_t vpn, vaddr_t *out);
+};
+
+// Built-in engines: read-ahead of the next pages, a per-proc stride once
+// two strides in a row agree, and the pages that followed this one before
+extern const PagePrefetchPolicy sequentialPrefetch;
+extern const PagePrefetchPolicy stridePrefetch;
+extern const PagePrefetchPolicy markovPrefetch;
+
+// Most pages any engine proposes per trigger
+static const unsigned int PREFETCH_MAX_DEPTH = 64;
+
+struct PrefetchStats {
+    unsigned long issued;       // pages loaded by prefetching
+    unsigned long useful;       // of those, accessed while still resident
+    unsigned long unused;       // replaced before they were ever accessed
+    unsigned long evictions;    // pages replaced to make room for prefetches
+};
+
+struct PagePrefetcher {
+    const PagePrefetchPolicy *policy;
+    unsigned int depth;
+    PrefetchStats stats;
+    std::vector<uint64_t> pendingBits; // 1 bit per frame, prefetched and not yet accessed
+    PrefetchHistory history[256];      // [proc]
+    std::vector<MarkovEntry> markov;   // [hash of page], Markov engine only
+};
+
+// Parse "<policy>[:<pages>]". Returns nullptr if the policy is unknown or
+// pages is out of range for it.
+PagePrefetcher *createPagePrefetcher(const char *spec);
+
+// Destroy a prefetcher
+void destroyPagePrefetcher(PagePrefetcher *pf);
+
+// Whether the page in a frame was prefetched and has not been accessed
+inline bool framePrefetched(const PagePrefetcher &pf, int frame)
+{
+    size_t w = (size_t)frame >> 6;
+    return w < pf.pendingBits.size() && ((pf.pendingBits[w] >> (frame & 63)) & 1u);
+}
+
+// A page was loaded into a frame, by prefetching or on demand. A prefetched
+// page the frame held and nobody accessed counts as unused.
+inline void notePrefetchFrameLoaded(PagePrefetcher &pf, int frame, bool prefetched)
+{
+    size_t w = (size_t)frame >> 6;
+    uint64_t bit = 1ull << (frame & 63);
+    if (w >= pf.pendingBits.size()) {
+        if (!prefetched) return;
+        pf.pendingBits.resize(w + 1, 0);
+    }
+    if (pf.pendingBits[w] & bit) pf.stats.unused++;
+    if (prefetched) {
+        pf.pendingBits[w] |= bit;
+    } else {
+        pf.pendingBits[w] &= ~bit;
+    }
+}
+
+// First access to a prefetched page: count it useful and untag it
+inline void notePrefetchFrameUsed(PagePrefetcher &pf, int frame)
+{
+    pf.pendingBits[(size_t)frame >> 6] &= ~(1ull << (frame & 63));
+    pf.stats.useful++;
+}
+
+// Run the policy on a trigger of proc at page vpn: fill out with the pages
+// to prefetch and record the trigger. Returns how many there are.
+unsigned int predictPrefetches(PagePrefetcher &pf, unsigned int proc,
+                               vaddr_t tag, vaddr_t vpn, vaddr_t *out);
+
+#endif // PAGE_PREFETCH_H
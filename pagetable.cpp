@@ -1,30 +1,307 @@
 #include "pagetable.h"
+#include "pagetable_walk.h"
+#include "instrument.h"
+#include "replacement.h"
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
+#include <vector>
+
+// Arena
+
+static const size_t ARENA_FIRST_SLAB_BYTES = 64 * 1024;
+static const size_t ARENA_MAX_SLAB_BYTES = 16 * 1024 * 1024;
+static const size_t ARENA_ALIGN = alignof(std::max_align_t);
+
+static void initArena(LevelArena &a)
+{
+    a.slabs = nullptr;
+    a.nextSlabBytes = ARENA_FIRST_SLAB_BYTES;
+    a.bytesReserved = 0;
+    for (unsigned int c = 0; c < ARENA_BLOCK_CLASSES; c++) {
+        a.freeBlocks[c] = nullptr;
+    }
+    a.bytesFree = 0;
+}
+
+// Slab header padded so the payload keeps the arena alignment
+static const size_t ARENA_SLAB_HEADER =
+    (sizeof(ArenaSlab) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+static char *slabPayload(ArenaSlab *slab)
+{
+    return reinterpret_cast<char *>(slab) + ARENA_SLAB_HEADER;
+}
+
+// Bytes an allocation takes up in a slab
+static size_t arenaRound(size_t bytes)
+{
+    return (bytes + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+// Make a new, empty slab of capacity bytes the arena's current one
+static ArenaSlab *pushSlab(LevelArena &a, size_t capacity)
+{
+    ArenaSlab *slab = static_cast<ArenaSlab *>(malloc(ARENA_SLAB_HEADER + capacity));
+    if (!slab) {
+        fprintf(stderr, "Out of memory allocating page table\n");
+        exit(1);
+    }
+    slab->next = a.slabs;
+    slab->used = 0;
+    slab->capacity = capacity;
+    a.slabs = slab;
+    return slab;
+}
+
+// Bump-allocate bytes from the arena, starting a new slab when full.
+// Slabs double in size up to a cap, so the slab count stays small.
+static void *arenaAlloc(LevelArena &a, size_t bytes)
+{
+    bytes = arenaRound(bytes);
+
+    ArenaSlab *slab = a.slabs;
+    if (!slab || slab->capacity - slab->used < bytes) {
+        size_t capacity = a.nextSlabBytes;
+        if (capacity < bytes) capacity = bytes;
+        if (a.nextSlabBytes < ARENA_MAX_SLAB_BYTES) a.nextSlabBytes *= 2;
+
+        slab = pushSlab(a, capacity);
+        a.bytesReserved += capacity;
+    }
+
+    void *p = slabPayload(slab) + slab->used;
+    slab->used += bytes;
+    return p;
+}
+
+// Smallest block size class holding bytes
+static size_t blockClassBytes(size_t bytes)
+{
+    size_t classBytes = ARENA_ALIGN;
+    while (classBytes < bytes) classBytes <<= 1;
+    return classBytes;
+}
+
+// Allocate a block of a size class, reusing a released one if there is one
+static void *arenaAllocBlock(LevelArena &a, size_t classBytes)
+{
+    unsigned int c = (unsigned int)__builtin_ctzll(classBytes);
+    void *p = a.freeBlocks[c];
+    if (!p) return arenaAlloc(a, classBytes);
+    a.freeBlocks[c] = *static_cast<void **>(p);
+    a.bytesFree -= classBytes;
+    return p;
+}
+
+// Put a block of a size class on the arena's free list
+static void arenaFreeBlock(LevelArena &a, void *p, size_t classBytes)
+{
+    unsigned int c = (unsigned int)__builtin_ctzll(classBytes);
+    *static_cast<void **>(p) = a.freeBlocks[c];
+    a.freeBlocks[c] = p;
+    a.bytesFree += classBytes;
+}
+
+static void destroyArena(LevelArena &a)
+{
+    ArenaSlab *slab = a.slabs;
+    while (slab) {
+        ArenaSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    initArena(a);
+}
+
+// Hashed backend: fullVPN -> frame in an open-addressing index (the same
+// one the replacement state uses for residency), and one Map per frame in
+// fixed-size chunks, so an entry stays put while its page is resident
+struct HashedMaps {
+    ResidentIndex index;
+    std::vector<Map *> chunks;      // [frame >> HASH_CHUNK_BITS], from arenas[0]
+};
+
+static const unsigned int HASH_CHUNK_BITS = 10;
+static const unsigned int HASH_CHUNK_MASK = (1u << HASH_CHUNK_BITS) - 1;
 
 // Allocate a new level
-Level *allocateLevel(unsigned int depth,
-                   unsigned int entryCount)
+Level *allocateLevel(PageTable *pt,
+                     unsigned int depth,
+                     unsigned int entryCount)
 {
-    Level *lvl = new Level;
+    INSTRUMENT_COUNT(depth + 1 < pt->levelCount ? IC_INTERIOR_NODES : IC_LEAF_NODES);
+    Level *lvl = static_cast<Level *>(
+        arenaAlloc(pt->arenas[depth], sizeof(Level)));
+    // Every level below the root is stored in its parent's child array
+    pt->nodeCount++;
+    if (depth > 0) pt->entryCount++;
     lvl->depth = depth;
     lvl->entryCount = entryCount;
     lvl->nextLevelArray = nullptr;
     lvl->mapArray = nullptr;
+    lvl->filled = 0;
+    lvl->large.pte = 0;
     return lvl;
 }
 
+// Allocate a level's child pointer array, all null
+Level **allocateNextLevelArray(PageTable *pt, Level *lvl)
+{
+    INSTRUMENT_COUNT(IC_CHILD_ARRAYS);
+    lvl->nextLevelArray = static_cast<Level **>(arenaAlloc(
+        pt->arenas[lvl->depth], lvl->entryCount * sizeof(Level *)));
+    for (unsigned int i = 0; i < lvl->entryCount; i++) {
+        lvl->nextLevelArray[i] = nullptr;
+    }
+    return lvl->nextLevelArray;
+}
+
+// Bytes of a sparse block ahead of the children: the bitmap, then the
+// running count for each word, padded to keep the children aligned
+static size_t sparseHeaderBytes(unsigned int entryCount)
+{
+    size_t words = (entryCount + 63) >> 6;
+    return words * sizeof(uint64_t) +
+           ((words * sizeof(uint32_t) + sizeof(Level *) - 1) & ~(sizeof(Level *) - 1));
+}
+
+// Children in a sparse block: the last word's running count plus its bits
+static unsigned int sparseChildCount(const Level *lvl)
+{
+    size_t last = ((lvl->entryCount + 63) >> 6) - 1;
+    const uint32_t *ranks = reinterpret_cast<const uint32_t *>(
+        lvl->childBits + last + 1);
+    return ranks[last] + bitCount(lvl->childBits[last]);
+}
+
+// Size class of a sparse block holding count children. A block is only
+// replaced when it is full, so this is always the class it was given.
+static size_t sparseBlockBytes(unsigned int entryCount, unsigned int count)
+{
+    if (count == 0) count = 1;
+    return blockClassBytes(sparseHeaderBytes(entryCount) + count * sizeof(Level *));
+}
+
+// Move lvl's count children (if any) into a sparse block with room for
+// one more, or into a full array if the table has no sparse levels, lvl
+// is the root or that block would be no smaller. The block outgrown goes
+// back to the arena.
+static void resizeLevelChildren(PageTable *pt, Level *lvl, unsigned int count)
+{
+    LevelArena &a = pt->arenas[lvl->depth];
+    size_t words = (lvl->entryCount + 63) >> 6;
+    size_t header = sparseHeaderBytes(lvl->entryCount);
+    size_t bytes = sparseBlockBytes(lvl->entryCount, count + 1);
+    uint64_t *oldBits = lvl->childBits;
+    Level **oldChildren = lvl->nextLevelArray;
+    size_t oldBytes = sparseBlockBytes(lvl->entryCount, count);
+
+    if (!pt->sparseLevels || lvl->depth == 0 ||
+        bytes >= lvl->entryCount * sizeof(Level *))
+    {
+        allocateNextLevelArray(pt, lvl);
+        if (oldBits) {
+            unsigned int k = 0;
+            for (size_t w = 0; w < words; w++) {
+                for (uint64_t b = oldBits[w]; b; b &= b - 1) {
+                    lvl->nextLevelArray[w * 64 + __builtin_ctzll(b)] = oldChildren[k++];
+                }
+            }
+            arenaFreeBlock(a, oldBits, oldBytes);
+        }
+        lvl->childBits = nullptr;
+        return;
+    }
+
+    INSTRUMENT_COUNT(IC_SPARSE_BLOCKS);
+    uint64_t *bits = static_cast<uint64_t *>(arenaAllocBlock(a, bytes));
+    Level **children = reinterpret_cast<Level **>(
+        reinterpret_cast<char *>(bits) + header);
+    if (oldBits) {
+        memcpy(bits, oldBits, header);
+        memcpy(children, oldChildren, count * sizeof(Level *));
+        arenaFreeBlock(a, oldBits, oldBytes);
+    } else {
+        memset(bits, 0, header);
+    }
+    lvl->childBits = bits;
+    lvl->nextLevelArray = children;
+}
+
+// Allocate a child level at idx and link it in, growing a sparse block
+// that is full first
+Level *addLevelChild(PageTable *pt, Level *lvl, unsigned int idx)
+{
+    unsigned int depth = lvl->depth;
+    Level *child = allocateLevel(pt, depth + 1, 1u << pt->levelBits[depth + 1]);
+
+    unsigned int count = 0;
+    if (!lvl->nextLevelArray) {
+        resizeLevelChildren(pt, lvl, 0);
+    } else if (lvl->childBits) {
+        count = sparseChildCount(lvl);
+        if (sparseBlockBytes(lvl->entryCount, count + 1) !=
+            sparseBlockBytes(lvl->entryCount, count))
+        {
+            resizeLevelChildren(pt, lvl, count);
+        }
+    }
+    if (!lvl->childBits) {
+        lvl->nextLevelArray[idx] = child;
+        return child;
+    }
+
+    // Shift the children above idx up a slot and count the new one in
+    // every later word's running count
+    unsigned int words = (lvl->entryCount + 63) >> 6;
+    unsigned int word = idx >> 6;
+    uint64_t bit = 1ull << (idx & 63);
+    uint32_t *ranks = reinterpret_cast<uint32_t *>(lvl->childBits + words);
+    unsigned int pos = ranks[word] +
+        bitCount(lvl->childBits[word] & (bit - 1));
+    Level **children = lvl->nextLevelArray;
+    memmove(&children[pos + 1], &children[pos],
+            (count - pos) * sizeof(Level *));
+    children[pos] = child;
+    lvl->childBits[word] |= bit;
+    for (unsigned int w = word + 1; w < words; w++) {
+        ranks[w]++;
+    }
+    return child;
+}
+
+// Allocate a leaf level's map array, all unmapped. Arrays released by
+// huge page promotion are reused first; every leaf array is the same size.
+Map *allocateMapArray(PageTable *pt, Level *lvl)
+{
+    INSTRUMENT_COUNT(IC_MAP_ARRAYS);
+    if (pt->freeMapArrays) {
+        lvl->mapArray = pt->freeMapArrays;
+        pt->freeMapArrays = *reinterpret_cast<Map **>(lvl->mapArray);
+        pt->freeBytes -= lvl->entryCount * sizeof(Map);
+    } else {
+        lvl->mapArray = static_cast<Map *>(arenaAlloc(
+            pt->arenas[lvl->depth], lvl->entryCount * sizeof(Map)));
+    }
+    memset(lvl->mapArray, 0, lvl->entryCount * sizeof(Map));
+    pt->entryCount += lvl->entryCount;
+    return lvl->mapArray;
+}
+
 // Create a new page table
 PageTable *createPageTable(unsigned int levelCount,
-                          const unsigned int levelBitsArray[])
+                          const unsigned int levelBitsArray[],
+                          PageTableBackend backend,
+                          unsigned int addressBits)
 {
     PageTable *pt = new PageTable;
     pt->levelCount = levelCount;
+    pt->addressBits = addressBits;
 
     // Allocate arrays
     pt->levelBits  = new unsigned int[levelCount];
-    pt->levelMask  = new unsigned int[levelCount];
+    pt->levelMask  = new vaddr_t[levelCount];
     pt->levelShift = new unsigned int[levelCount];
 
     unsigned int sumBits = 0;
@@ -32,23 +309,26 @@ PageTable *createPageTable(unsigned int levelCount,
         pt->levelBits[i] = levelBitsArray[i];
         sumBits += levelBitsArray[i];
     }
-    pt->offsetBits = 32 - sumBits;
-    pt->offsetMask = (pt->offsetBits == 32)
-        ? 0xFFFFFFFFu
-        : ((1u << pt->offsetBits) - 1u);
+    pt->offsetBits = addressBits - sumBits;
+    pt->offsetMask = (pt->offsetBits == VADDR_BITS)
+        ? ~(vaddr_t)0
+        : (((vaddr_t)1 << pt->offsetBits) - 1u);
+    pt->vpnMask = (sumBits == VADDR_BITS)
+        ? ~(vaddr_t)0
+        : (((vaddr_t)1 << sumBits) - 1u);
 
     // Calculate level masks and shifts
     unsigned int accumulated = 0;
     for (unsigned int i = 0; i < levelCount; i++) {
         unsigned int hiBits = accumulated + pt->levelBits[i];
-        unsigned int shift = 32 - hiBits;
+        unsigned int shift = addressBits - hiBits;
         unsigned int bits = pt->levelBits[i];
 
-        unsigned int mask;
-        if (bits == 32) {
-            mask = 0xFFFFFFFFu;
+        vaddr_t mask;
+        if (bits == VADDR_BITS) {
+            mask = ~(vaddr_t)0;
         } else {
-            mask = ((1u << bits) - 1u) << shift;
+            mask = (((vaddr_t)1 << bits) - 1u) << shift;
         }
 
         pt->levelShift[i] = shift;
@@ -57,44 +337,47 @@ PageTable *createPageTable(unsigned int levelCount,
         accumulated += bits;
     }
 
-    // Allocate root level (depth 0)
-    unsigned int rootEntries = 1u << pt->levelBits[0];
-    pt->rootLevel = allocateLevel(0, rootEntries);
-
-    return pt;
-}
-
-// Destroy a level
-static void destroyLevel(PageTable *pt, Level *lvl)
-{
-    if (lvl == nullptr) return;
+    // One arena per level
+    pt->arenas = new LevelArena[levelCount];
+    for (unsigned int i = 0; i < levelCount; i++) {
+        initArena(pt->arenas[i]);
+    }
 
-    bool leaf = (lvl->depth == (pt->levelCount - 1));
+    // Allocate root level (depth 0)
+    pt->entryCount = 0;
+    pt->nodeCount = 0;
+    pt->hugePages = false;
+    pt->promotions = 0;
+    pt->demotions = 0;
+    pt->freeMapArrays = nullptr;
+    pt->freeBytes = 0;
+    pt->walk = nullptr;
+    pt->sparseLevels = (backend == PT_SPARSE);
+    pt->hashed = nullptr;
 
-    if (leaf) {
-        // Leaf has mapArray
-        if (lvl->mapArray != nullptr) {
-            delete [] lvl->mapArray;
-            lvl->mapArray = nullptr;
-        }
-    } else {
-        // Interior has nextLevelArray
-        if (lvl->nextLevelArray != nullptr) {
-            for (unsigned int i = 0; i < lvl->entryCount; i++) {
-                destroyLevel(pt, lvl->nextLevelArray[i]);
-            }
-            delete [] lvl->nextLevelArray;
-            lvl->nextLevelArray = nullptr;
-        }
+    if (backend == PT_HASHED) {
+        pt->hashed = new HashedMaps;
+        residentIndexInit(pt->hashed->index, 0);
+        pt->rootLevel = nullptr;
+        return pt;
     }
 
-    delete lvl;
+    unsigned int rootEntries = 1u << pt->levelBits[0];
+    pt->rootLevel = allocateLevel(pt, 0, rootEntries);
+
+    return pt;
 }
 
+// Destroy a page table: every node lives in the arenas, so this only
+// releases slabs
 void destroyPageTable(PageTable *pt)
 {
     if (!pt) return;
-    destroyLevel(pt, pt->rootLevel);
+    for (unsigned int i = 0; i < pt->levelCount; i++) {
+        destroyArena(pt->arenas[i]);
+    }
+    delete [] pt->arenas;
+    delete pt->hashed;
 
     delete [] pt->levelBits;
     delete [] pt->levelMask;
@@ -105,20 +388,74 @@ void destroyPageTable(PageTable *pt)
 // Core ops
 
 unsigned int extractVPNFromVirtualAddress(
-    unsigned int virtualAddress,
-    unsigned int mask,
+    vaddr_t virtualAddress,
+    vaddr_t mask,
     unsigned int shift)
 {
-    unsigned int part = (virtualAddress & mask) >> shift;
+    unsigned int part = (unsigned int)((virtualAddress & mask) >> shift);
     return part;
 }
 
+// Hashed backend
+
+static Map &hashedMap(HashedMaps &h, int frameNumber)
+{
+    return h.chunks[frameNumber >> HASH_CHUNK_BITS][frameNumber & HASH_CHUNK_MASK];
+}
+
+static Map *searchHashed(PageTable *pt, vaddr_t virtualAddress)
+{
+    INSTRUMENT_COUNT(IC_WALK_LEVELS);
+    int frame = residentIndexFind(pt->hashed->index, getFullVPN(pt, virtualAddress));
+    return frame < 0 ? nullptr : &hashedMap(*pt->hashed, frame);
+}
+
+static void insertHashed(PageTable *pt, vaddr_t virtualAddress, int frameNumber)
+{
+    HashedMaps &h = *pt->hashed;
+    vaddr_t vpn = getFullVPN(pt, virtualAddress);
+
+    if (frameNumber < 0) {
+        // Invalidate mapping - used during eviction
+        int frame = residentIndexFind(h.index, vpn);
+        if (frame < 0) return;
+        hashedMap(h, frame).pte = 0;
+        residentIndexErase(h.index, vpn);
+        return;
+    }
+
+    size_t chunk = (size_t)frameNumber >> HASH_CHUNK_BITS;
+    if (chunk >= h.chunks.size()) {
+        h.chunks.resize(chunk + 1, nullptr);
+    }
+    if (!h.chunks[chunk]) {
+        INSTRUMENT_COUNT(IC_MAP_ARRAYS);
+        size_t bytes = (HASH_CHUNK_MASK + 1) * sizeof(Map);
+        h.chunks[chunk] = static_cast<Map *>(arenaAlloc(pt->arenas[0], bytes));
+        memset(h.chunks[chunk], 0, bytes);
+        pt->entryCount += HASH_CHUNK_MASK + 1;
+    }
+
+    hashedMap(h, frameNumber).pte =
+        PTE_VALID | ((uint32_t)frameNumber & PTE_FRAME_MASK);
+    residentIndexInsert(h.index, vpn, frameNumber);
+}
+
 // Search for the mapped physical frame number in the page table
-Map* searchMappedPfn(PageTable *pageTable, unsigned int virtualAddress)
+Map* searchMappedPfn(PageTable *pageTable, vaddr_t virtualAddress)
 {
+    INSTRUMENT_COUNT(IC_WALK_LOOKUPS);
+    if (pageTable->hashed) {
+        return searchHashed(pageTable, virtualAddress);
+    }
+    if (pageTable->walk) {
+        return pageTable->walk->search(pageTable, virtualAddress);
+    }
+
     Level *curr = pageTable->rootLevel;
 
     for (unsigned int d = 0; d < pageTable->levelCount; d++) {
+        INSTRUMENT_COUNT(IC_WALK_LEVELS);
         unsigned int idx = extractVPNFromVirtualAddress(
             virtualAddress,
             pageTable->levelMask[d],
@@ -130,24 +467,280 @@ Map* searchMappedPfn(PageTable *pageTable, unsigned int virtualAddress)
         if (leaf) {
             if (!curr->mapArray) return nullptr;
             Map &m = curr->mapArray[idx];
-            if (!m.valid || m.frameNumber < 0) {
+            if (!mapIsValid(m)) {
                 return nullptr;
             }
             return &m;
         } else {
-            if (!curr->nextLevelArray) return nullptr;
-            Level *next = curr->nextLevelArray[idx];
+            Level *next = levelChild(curr, idx);
             if (!next) return nullptr;
+            if (mapIsValid(next->large)) return &next->large;
             curr = next;
         }
     }
     return nullptr; 
 }
 
+// Addresses walked together; larger batches are split
+static const size_t WALK_BATCH_MAX = 64;
+
+// Direct-mapped table spotting repeated VPNs within a batch
+static const unsigned int WALK_SEEN_BITS = 6;
+
+#if defined(__GNUC__)
+#define PREFETCH_READ(p) __builtin_prefetch((p), 0, 3)
+#else
+#define PREFETCH_READ(p) ((void)(p))
+#endif
+
+// Search for many addresses at once. Each level takes two passes over
+// the batch: the first prefetches every address's slot in its node's
+// array, the second loads the slots and prefetches the child nodes, so
+// one address's miss hides behind the others'.
+void searchMappedPfnBatch(PageTable *pageTable,
+                          const vaddr_t *vas,
+                          size_t n,
+                          Map **out)
+{
+    // One probe each, nothing to overlap level by level
+    if (pageTable->hashed) {
+        INSTRUMENT_ADD(IC_WALK_LOOKUPS, n);
+        for (size_t i = 0; i < n; i++) {
+            out[i] = searchHashed(pageTable, vas[i]);
+        }
+        return;
+    }
+
+    while (n > WALK_BATCH_MAX) {
+        searchMappedPfnBatch(pageTable, vas, WALK_BATCH_MAX, out);
+        vas += WALK_BATCH_MAX;
+        out += WALK_BATCH_MAX;
+        n -= WALK_BATCH_MAX;
+    }
+
+    Level *curr[WALK_BATCH_MAX];
+    unsigned int first[WALK_BATCH_MAX];  // first address with the same VPN
+    unsigned int live[WALK_BATCH_MAX];   // addresses still being walked
+    unsigned int liveCount = 0;
+
+    // Walk each distinct VPN once
+    vaddr_t seenVPN[1u << WALK_SEEN_BITS];
+    unsigned int seenIdx[1u << WALK_SEEN_BITS];
+    uint64_t seenValid = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        vaddr_t vpn = getFullVPN(pageTable, vas[i]);
+        unsigned int h = (foldVPN(vpn) * 2654435769u) >> (32 - WALK_SEEN_BITS);
+        out[i] = nullptr;
+        if (((seenValid >> h) & 1) && seenVPN[h] == vpn) {
+            first[i] = seenIdx[h];
+            continue;
+        }
+        seenValid |= 1ull << h;
+        seenVPN[h] = vpn;
+        seenIdx[h] = i;
+        first[i] = i;
+        curr[i] = pageTable->rootLevel;
+        live[liveCount++] = i;
+    }
+
+    INSTRUMENT_ADD(IC_WALK_LOOKUPS, n);
+
+    unsigned int lastDepth = pageTable->levelCount - 1;
+    for (unsigned int d = 0; d <= lastDepth; d++) {
+        vaddr_t mask = pageTable->levelMask[d];
+        unsigned int shift = pageTable->levelShift[d];
+        INSTRUMENT_ADD(IC_WALK_LEVELS, liveCount);
+
+        if (d < lastDepth) {
+            for (unsigned int k = 0; k < liveCount; k++) {
+                unsigned int i = live[k];
+                if (curr[i]->nextLevelArray) {
+                    PREFETCH_READ(levelChildHint(curr[i], (vas[i] & mask) >> shift));
+                }
+            }
+
+            // Drop addresses whose path ends here
+            unsigned int kept = 0;
+            for (unsigned int k = 0; k < liveCount; k++) {
+                unsigned int i = live[k];
+                Level *next = levelChild(curr[i], (vas[i] & mask) >> shift);
+                if (next && mapIsValid(next->large)) {
+                    out[i] = &next->large;
+                } else if (next) {
+                    PREFETCH_READ(next);
+                    curr[i] = next;
+                    live[kept++] = i;
+                }
+            }
+            liveCount = kept;
+        } else {
+            for (unsigned int k = 0; k < liveCount; k++) {
+                unsigned int i = live[k];
+                if (curr[i]->mapArray) {
+                    PREFETCH_READ(&curr[i]->mapArray[(vas[i] & mask) >> shift]);
+                }
+            }
+            for (unsigned int k = 0; k < liveCount; k++) {
+                unsigned int i = live[k];
+                if (!curr[i]->mapArray) continue;
+                Map &m = curr[i]->mapArray[(vas[i] & mask) >> shift];
+                if (mapIsValid(m)) {
+                    out[i] = &m;
+                }
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+        out[i] = out[first[i]];
+    }
+}
+
+// Huge pages
+
+// Pages covered by a level at depth, as a power of two
+static unsigned int levelSpanBits(const PageTable *pt, unsigned int depth)
+{
+    return pt->levelShift[depth] + pt->levelBits[depth] - pt->offsetBits;
+}
+
+// Base frame of a large mapping
+static uint32_t largeBaseFrame(const Map &m)
+{
+    uint32_t f = m.pte & PTE_FRAME_MASK;
+    return f & ~(f ^ (f + 1));
+}
+
+// Promote lvl (below the root) to a large mapping if its subtree is fully
+// mapped to one aligned run of frames. A promoted leaf releases its map
+// array; an interior level keeps its children, which are all large.
+static bool tryPromoteLevel(PageTable *pt, Level *lvl, unsigned int depth)
+{
+    if (lvl->filled != lvl->entryCount) return false;
+
+    unsigned int spanBits = levelSpanBits(pt, depth);
+    bool leaf = (depth == pt->levelCount - 1);
+    uint32_t base;
+    if (leaf) {
+        base = (uint32_t)mapFrameNumber(lvl->mapArray[0]);
+        for (unsigned int i = 1; i < lvl->entryCount; i++) {
+            if ((uint32_t)mapFrameNumber(lvl->mapArray[i]) != base + i) return false;
+        }
+    } else {
+        unsigned int childBits = levelSpanBits(pt, depth + 1);
+        base = largeBaseFrame(levelChild(lvl, 0)->large);
+        for (unsigned int i = 1; i < lvl->entryCount; i++) {
+            if (largeBaseFrame(levelChild(lvl, i)->large) !=
+                base + (i << childBits))
+            {
+                return false;
+            }
+        }
+    }
+    if (spanBits > PTE_FRAME_BITS || (base & ((1u << spanBits) - 1)) != 0) return false;
+
+    lvl->large.pte = PTE_VALID | PTE_LARGE | (base | ((1u << (spanBits - 1)) - 1));
+    if (leaf) {
+        *reinterpret_cast<Map **>(lvl->mapArray) = pt->freeMapArrays;
+        pt->freeMapArrays = lvl->mapArray;
+        pt->freeBytes += lvl->entryCount * sizeof(Map);
+        pt->entryCount -= lvl->entryCount;
+        lvl->mapArray = nullptr;
+    }
+    pt->promotions++;
+    return true;
+}
+
+// Split the large mapping at path[from] and every one below it on the
+// path, giving the leaf its map array back; the other subtrees stay large
+static void demoteLevels(PageTable *pt, Level **path, unsigned int from)
+{
+    unsigned int last = pt->levelCount - 1;
+    for (unsigned int d = from; d <= last; d++) {
+        Level *lvl = path[d];
+        if (d == last) {
+            uint32_t base = largeBaseFrame(lvl->large);
+            allocateMapArray(pt, lvl);
+            for (unsigned int i = 0; i < lvl->entryCount; i++) {
+                lvl->mapArray[i].pte = PTE_VALID | (base + i);
+            }
+        }
+        lvl->large.pte = 0;
+        path[d - 1]->filled--;
+    }
+    pt->demotions++;
+}
+
+// Insert or drop a mapping with huge pages enabled, promoting the levels
+// a new mapping completes and demoting any large mapping a drop falls in
+static void insertMapHuge(PageTable *pt, vaddr_t virtualAddress, int frameNumber)
+{
+    Level *path[32];
+    unsigned int last = pt->levelCount - 1;
+    Level *curr = pt->rootLevel;
+
+    for (unsigned int d = 0; d < last; d++) {
+        path[d] = curr;
+        unsigned int idx = extractVPNFromVirtualAddress(
+            virtualAddress, pt->levelMask[d], pt->levelShift[d]);
+        Level *next = levelChild(curr, idx);
+        curr = next ? next : addLevelChild(pt, curr, idx);
+    }
+    path[last] = curr;
+
+    if (frameNumber < 0) {
+        for (unsigned int d = 1; d <= last; d++) {
+            if (mapIsValid(path[d]->large)) {
+                demoteLevels(pt, path, d);
+                break;
+            }
+        }
+    }
+
+    if (!curr->mapArray) {
+        allocateMapArray(pt, curr);
+    }
+    Map &m = curr->mapArray[extractVPNFromVirtualAddress(
+        virtualAddress, pt->levelMask[last], pt->levelShift[last])];
+    bool wasValid = mapIsValid(m);
+
+    if (frameNumber < 0) {
+        m.pte = 0;
+        if (wasValid) curr->filled--;
+        return;
+    }
+
+    m.pte = PTE_VALID | ((uint32_t)frameNumber & PTE_FRAME_MASK);
+    if (wasValid) return;
+    curr->filled++;
+    for (unsigned int d = last; d >= 1 && tryPromoteLevel(pt, path[d], d); d--) {
+        path[d - 1]->filled++;
+    }
+}
+
 void insertMapForVpn2Pfn(PageTable *pageTable,
-                         unsigned int virtualAddress,
+                         vaddr_t virtualAddress,
                          int frameNumber)
 {
+    // A frame the entry cannot hold would wrap onto a low frame
+    if (frameNumber >= 0 && (uint32_t)frameNumber > PTE_FRAME_MASK) {
+        fprintf(stderr, "Frame %d does not fit a page table entry, at most %u frames fit\n",
+                frameNumber, PTE_FRAME_COUNT);
+        exit(1);
+    }
+    if (pageTable->hashed) {
+        insertHashed(pageTable, virtualAddress, frameNumber);
+        return;
+    }
+    if (pageTable->hugePages) {
+        insertMapHuge(pageTable, virtualAddress, frameNumber);
+        return;
+    }
+    if (pageTable->walk) {
+        pageTable->walk->insert(pageTable, virtualAddress, frameNumber);
+        return;
+    }
+
     Level *curr = pageTable->rootLevel;
 
     for (unsigned int d = 0; d < pageTable->levelCount; d++) {
@@ -162,108 +755,554 @@ void insertMapForVpn2Pfn(PageTable *pageTable,
         if (leaf) {
             // Ensure mapArray exists
             if (!curr->mapArray) {
-                curr->mapArray = new Map[curr->entryCount];
-                for (unsigned int i = 0; i < curr->entryCount; i++) {
-                    curr->mapArray[i].frameNumber = -1;
-                    curr->mapArray[i].valid = false;
-                }
+                allocateMapArray(pageTable, curr);
             }
 
-            curr->mapArray[idx].frameNumber = frameNumber;
             if (frameNumber >= 0) {
-                curr->mapArray[idx].valid = true;
+                curr->mapArray[idx].pte =
+                    PTE_VALID | ((uint32_t)frameNumber & PTE_FRAME_MASK);
             } else {
                 // Invalidate mapping - used during eviction
-                curr->mapArray[idx].valid = false;
+                curr->mapArray[idx].pte = 0;
             }
         } else {
             // Walk/allocate interior
-            if (!curr->nextLevelArray) {
-                curr->nextLevelArray = new Level*[curr->entryCount];
-                for (unsigned int i = 0; i < curr->entryCount; i++) {
-                    curr->nextLevelArray[i] = nullptr;
-                }
-            }
-
-            if (!curr->nextLevelArray[idx]) {
-                unsigned int childEntries =
-                    1u << pageTable->levelBits[d+1];
-                Level *child = allocateLevel(d+1, childEntries);
-                curr->nextLevelArray[idx] = child;
+            Level *next = levelChild(curr, idx);
+            if (!next) {
+                next = addLevelChild(pageTable, curr, idx);
             }
 
-            curr = curr->nextLevelArray[idx];
+            curr = next;
         }
     }
 }
 
 // Helpers
 
-// Get the full VPN from a virtual address
-unsigned int getFullVPN(PageTable *pt, unsigned int virtualAddress)
+// Get the full VPN from a virtual address; address bits above
+// addressBits are ignored
+vaddr_t getFullVPN(PageTable *pt, vaddr_t virtualAddress)
 {
-    return (pt->offsetBits == 32)
-        ? 0
-        : (virtualAddress >> pt->offsetBits);
+    return (virtualAddress >> pt->offsetBits) & pt->vpnMask;
 }
 
-unsigned int getOffsetFromVA(PageTable *pt, unsigned int virtualAddress)
+unsigned int getOffsetFromVA(PageTable *pt, vaddr_t virtualAddress)
 {
-    return virtualAddress & pt->offsetMask;
+    return (unsigned int)(virtualAddress & pt->offsetMask);
 }
 
-unsigned int composePhysicalAddress(PageTable *pt,
-                                    int frameNumber,
-                                    unsigned int offset)
+vaddr_t composePhysicalAddress(PageTable *pt,
+                               int frameNumber,
+                               unsigned int offset)
 {
-    unsigned int phys = ((unsigned int)frameNumber << pt->offsetBits) | offset;
+    vaddr_t phys = ((vaddr_t)(unsigned int)frameNumber << pt->offsetBits) | offset;
     return phys;
 }
 
-// Count the number of page table entries
-static unsigned int countEntriesRecursive(PageTable *pt, Level *lvl)
+// Bytes of the table's arenas in use
+size_t pageTableBytes(const PageTable *pt)
 {
-    if (!lvl) return 0;
+    size_t total = 0;
+    for (unsigned int i = 0; i < pt->levelCount; i++) {
+        total += pt->arenas[i].bytesReserved - pt->arenas[i].bytesFree;
+    }
+    if (pt->hashed) {
+        total += pt->hashed->index.buckets.size() * sizeof(ResidentBucket);
+    }
+    return total - pt->freeBytes;
+}
 
-    bool leaf = (lvl->depth == pt->levelCount - 1);
+// Number of page table entries
+unsigned long pageTableEntries(const PageTable *pt)
+{
+    if (pt->hashed) {
+        return pt->entryCount + pt->hashed->index.buckets.size();
+    }
+    return pt->entryCount;
+}
 
-    unsigned int sum = 0;
-    if (leaf) {
-        if (lvl->mapArray) {
-            for (unsigned int i = 0; i < lvl->entryCount; i++) {
-                if (lvl->mapArray[i].valid && lvl->mapArray[i].frameNumber >= 0) {
-                    sum += 1;
+// Number of levels allocated
+unsigned long pageTableNodes(const PageTable *pt)
+{
+    return pt->nodeCount;
+}
+
+// Page table images
+//
+// An image is flat and holds no pointers: a header, each arena's
+// accounting, then for every depth its levels in breadth-first order (the
+// children of a level are the next levels one depth down, in index
+// order), their child bitmaps and their leaf maps. Every part is a
+// multiple of 8 bytes, so a mapped image is read in place.
+
+struct PageTableImageHeader {
+    uint32_t levelCount;
+    uint32_t hashed;            // hashed backend image follows the arenas
+    uint64_t entryCount;
+    uint64_t nodeCount;
+    uint64_t promotions;
+    uint64_t demotions;
+    uint64_t freeMapArrays;     // leaf arrays on the huge page free list
+    uint64_t freeBytes;
+};
+
+// Enough of an arena to carry on exactly as it would have: the bytes it
+// reserved, the room left in its current slab, the size of the next slab
+// and its released blocks
+struct ArenaImage {
+    uint64_t bytesReserved;
+    uint64_t nextSlabBytes;
+    uint64_t room;
+    uint64_t bytesFree;
+    uint32_t freeBlocks[ARENA_BLOCK_CLASSES]; // blocks per size class
+};
+
+struct DepthImage {
+    uint64_t levels;
+    uint64_t childWords;        // bitmap words of the levels with children
+    uint64_t maps;              // maps of the leaves with a map array
+};
+
+struct LevelImage {
+    uint32_t flags;             // LEVEL_IMAGE_*
+    uint32_t filled;
+    uint32_t large;
+    uint32_t unused;
+};
+
+static const uint32_t LEVEL_IMAGE_CHILDREN = 1; // has a child array
+static const uint32_t LEVEL_IMAGE_SPARSE = 2;   // ... kept in a sparse block
+static const uint32_t LEVEL_IMAGE_MAPS = 4;     // has a map array
+
+struct HashedImage {
+    uint64_t chunkCount;
+    uint64_t bucketCount;
+    uint32_t hashShift;
+    uint32_t count;
+};
+
+// Pad a part of bytes bytes out to a multiple of 8
+static bool writePadding(FILE *out, size_t bytes)
+{
+    static const char zeros[8] = {0};
+    size_t pad = (8 - bytes % 8) % 8;
+    return fwrite(zeros, 1, pad, out) == pad;
+}
+
+static bool writeImage(FILE *out, const void *p, size_t bytes)
+{
+    return fwrite(p, 1, bytes, out) == bytes && writePadding(out, bytes);
+}
+
+// Bounded reads from an image in memory, 8 bytes aligned like the writes
+struct ImageCursor {
+    const char *p;
+    size_t left;
+};
+
+static const void *readImage(ImageCursor &c, size_t bytes)
+{
+    size_t padded = (bytes + 7) & ~(size_t)7;
+    if (padded > c.left) return nullptr;
+    const void *p = c.p;
+    c.p += padded;
+    c.left -= padded;
+    return p;
+}
+
+static void imageArena(const LevelArena &a, ArenaImage &img)
+{
+    img.bytesReserved = a.bytesReserved;
+    img.nextSlabBytes = a.nextSlabBytes;
+    img.room = a.slabs ? a.slabs->capacity - a.slabs->used : 0;
+    img.bytesFree = a.bytesFree;
+    for (unsigned int c = 0; c < ARENA_BLOCK_CLASSES; c++) {
+        uint32_t n = 0;
+        for (void *p = a.freeBlocks[c]; p; p = *static_cast<void **>(p)) n++;
+        img.freeBlocks[c] = n;
+    }
+}
+
+// Bytes of an arena's released blocks
+static size_t imageFreeBlockBytes(const ArenaImage &img)
+{
+    size_t bytes = 0;
+    for (unsigned int c = 0; c < ARENA_BLOCK_CLASSES; c++) {
+        bytes += (size_t)img.freeBlocks[c] << c;
+    }
+    return bytes;
+}
+
+// Reset an arena to hold contentBytes, and its released blocks after
+// them, in one full slab ahead of a current slab with the image's room.
+// With the image's accounting it then grows as the original would have.
+// Returns the content.
+static char *restoreArena(LevelArena &a, const ArenaImage &img, size_t liveBytes)
+{
+    destroyArena(a);
+    size_t contentBytes = liveBytes + imageFreeBlockBytes(img);
+    char *content = nullptr;
+    if (contentBytes) {
+        ArenaSlab *slab = pushSlab(a, contentBytes);
+        slab->used = contentBytes;
+        content = slabPayload(slab);
+    }
+    if (img.room) {
+        pushSlab(a, img.room);
+    }
+    a.bytesReserved = img.bytesReserved;
+    a.nextSlabBytes = img.nextSlabBytes;
+
+    char *block = content + liveBytes;
+    for (unsigned int c = 0; c < ARENA_BLOCK_CLASSES; c++) {
+        for (uint32_t i = 0; i < img.freeBlocks[c]; i++) {
+            arenaFreeBlock(a, block, (size_t)1 << c);
+            block += (size_t)1 << c;
+        }
+    }
+    a.bytesFree = img.bytesFree;
+    return content;
+}
+
+static bool writeHashedImage(const PageTable *pt, FILE *out)
+{
+    const HashedMaps &h = *pt->hashed;
+    HashedImage img;
+    img.chunkCount = h.chunks.size();
+    img.bucketCount = h.index.buckets.size();
+    img.hashShift = h.index.hashShift;
+    img.count = h.index.count;
+    std::vector<uint64_t> present((h.chunks.size() + 63) / 64, 0);
+    for (size_t i = 0; i < h.chunks.size(); i++) {
+        if (h.chunks[i]) present[i / 64] |= 1ull << (i % 64);
+    }
+
+    if (!writeImage(out, &img, sizeof(img)) ||
+        !writeImage(out, present.data(), present.size() * sizeof(uint64_t)))
+    {
+        return false;
+    }
+    for (Map *chunk : h.chunks) {
+        if (chunk && !writeImage(out, chunk, (HASH_CHUNK_MASK + 1) * sizeof(Map))) {
+            return false;
+        }
+    }
+    return writeImage(out, h.index.buckets.data(),
+                      h.index.buckets.size() * sizeof(ResidentBucket));
+}
+
+bool writePageTableImage(const PageTable *pt, FILE *out)
+{
+    unsigned int levelCount = pt->levelCount;
+    unsigned int freeArrays = 0;
+    for (Map *m = pt->freeMapArrays; m; m = *reinterpret_cast<Map **>(m)) {
+        freeArrays++;
+    }
+
+    PageTableImageHeader hdr;
+    hdr.levelCount = levelCount;
+    hdr.hashed = pt->hashed != nullptr;
+    hdr.entryCount = pt->entryCount;
+    hdr.nodeCount = pt->nodeCount;
+    hdr.promotions = pt->promotions;
+    hdr.demotions = pt->demotions;
+    hdr.freeMapArrays = freeArrays;
+    hdr.freeBytes = pt->freeBytes;
+    std::vector<ArenaImage> arenas(levelCount);
+    for (unsigned int d = 0; d < levelCount; d++) {
+        imageArena(pt->arenas[d], arenas[d]);
+    }
+    if (!writeImage(out, &hdr, sizeof(hdr)) ||
+        !writeImage(out, arenas.data(), levelCount * sizeof(ArenaImage)))
+    {
+        return false;
+    }
+    if (pt->hashed) {
+        return writeHashedImage(pt, out);
+    }
+
+    // Levels of each depth in breadth-first order
+    std::vector<std::vector<const Level *>> levels(levelCount);
+    std::vector<DepthImage> depths(levelCount);
+    levels[0].push_back(pt->rootLevel);
+    for (unsigned int d = 0; d < levelCount; d++) {
+        DepthImage &di = depths[d];
+        di.levels = levels[d].size();
+        di.childWords = 0;
+        di.maps = 0;
+        for (const Level *lvl : levels[d]) {
+            if (d + 1 == levelCount) {
+                if (lvl->mapArray) di.maps += lvl->entryCount;
+                continue;
+            }
+            if (!lvl->nextLevelArray) continue;
+            di.childWords += (lvl->entryCount + 63) >> 6;
+            if (lvl->childBits) {
+                unsigned int count = sparseChildCount(lvl);
+                levels[d + 1].insert(levels[d + 1].end(), lvl->nextLevelArray,
+                                     lvl->nextLevelArray + count);
+            } else {
+                for (unsigned int i = 0; i < lvl->entryCount; i++) {
+                    if (lvl->nextLevelArray[i]) {
+                        levels[d + 1].push_back(lvl->nextLevelArray[i]);
+                    }
                 }
             }
         }
-    } else {
-        if (lvl->nextLevelArray) {
-            for (unsigned int i = 0; i < lvl->entryCount; i++) {
-                if (lvl->nextLevelArray[i] != nullptr) {
-                    sum += 1; 
+    }
+    if (!writeImage(out, depths.data(), levelCount * sizeof(DepthImage))) {
+        return false;
+    }
+
+    std::vector<LevelImage> nodes;
+    std::vector<uint64_t> bits;
+    for (unsigned int d = 0; d < levelCount; d++) {
+        bool leaf = (d + 1 == levelCount);
+        nodes.clear();
+        bits.clear();
+        for (const Level *lvl : levels[d]) {
+            LevelImage li;
+            li.flags = 0;
+            li.filled = lvl->filled;
+            li.large = lvl->large.pte;
+            li.unused = 0;
+            if (leaf) {
+                if (lvl->mapArray) li.flags |= LEVEL_IMAGE_MAPS;
+            } else if (lvl->nextLevelArray) {
+                li.flags |= LEVEL_IMAGE_CHILDREN;
+                size_t words = (lvl->entryCount + 63) >> 6;
+                if (lvl->childBits) {
+                    li.flags |= LEVEL_IMAGE_SPARSE;
+                    bits.insert(bits.end(), lvl->childBits, lvl->childBits + words);
+                } else {
+                    size_t at = bits.size();
+                    bits.resize(at + words, 0);
+                    for (unsigned int i = 0; i < lvl->entryCount; i++) {
+                        if (lvl->nextLevelArray[i]) {
+                            bits[at + i / 64] |= 1ull << (i % 64);
+                        }
+                    }
                 }
             }
-            // Recurse into each child
-            for (unsigned int i = 0; i < lvl->entryCount; i++) {
-                sum += countEntriesRecursive(pt, lvl->nextLevelArray[i]);
-            }
+            nodes.push_back(li);
+        }
+        if (!writeImage(out, nodes.data(), nodes.size() * sizeof(LevelImage)) ||
+            !writeImage(out, bits.data(), bits.size() * sizeof(uint64_t)))
+        {
+            return false;
         }
+        if (!leaf) continue;
+
+        // Leaf maps one array after another, padded once at the end
+        size_t bytes = 0;
+        for (const Level *lvl : levels[d]) {
+            if (!lvl->mapArray) continue;
+            size_t n = lvl->entryCount * sizeof(Map);
+            if (fwrite(lvl->mapArray, 1, n, out) != n) return false;
+            bytes += n;
+        }
+        if (!writePadding(out, bytes)) return false;
     }
-    return sum;
+    return true;
 }
 
-// Count the number of page table entries
-unsigned int countPageTableEntries(Level *lvl,
-                                    bool isLeafLevel,
-                                    unsigned int depth,
-                                    unsigned int lastDepth)
+static bool restoreHashedImage(PageTable *pt, ImageCursor &c, const ArenaImage *arenas)
 {
-    // This function appears to be unused - the actual counting
-    // is done by countEntriesRecursiveLocal in main.cpp
-    (void)lvl;
-    (void)isLeafLevel;
-    (void)depth;
-    (void)lastDepth;
-    return 0;
+    const HashedImage *img = static_cast<const HashedImage *>(
+        readImage(c, sizeof(HashedImage)));
+    if (!img) return false;
+    const uint64_t *present = static_cast<const uint64_t *>(
+        readImage(c, (img->chunkCount + 63) / 64 * sizeof(uint64_t)));
+    if (!present) return false;
+    size_t chunks = 0;
+    for (size_t w = 0; w < (img->chunkCount + 63) / 64; w++) {
+        chunks += bitCount(present[w]);
+    }
+    size_t chunkBytes = (HASH_CHUNK_MASK + 1) * sizeof(Map);
+    const char *maps = static_cast<const char *>(readImage(c, chunks * chunkBytes));
+    const ResidentBucket *buckets = static_cast<const ResidentBucket *>(
+        readImage(c, img->bucketCount * sizeof(ResidentBucket)));
+    if (!maps || !buckets) return false;
+
+    char *content = restoreArena(pt->arenas[0], arenas[0], chunks * chunkBytes);
+    for (unsigned int d = 1; d < pt->levelCount; d++) {
+        restoreArena(pt->arenas[d], arenas[d], 0);
+    }
+
+    HashedMaps &h = *pt->hashed;
+    h.chunks.assign(img->chunkCount, nullptr);
+    for (size_t i = 0; i < img->chunkCount; i++) {
+        if (!((present[i / 64] >> (i % 64)) & 1)) continue;
+        h.chunks[i] = reinterpret_cast<Map *>(content);
+        memcpy(content, maps, chunkBytes);
+        content += chunkBytes;
+        maps += chunkBytes;
+    }
+    h.index.buckets.assign(buckets, buckets + img->bucketCount);
+    h.index.hashShift = img->hashShift;
+    h.index.count = img->count;
+    return true;
 }
 
+// Children marked in a level's bitmap
+static unsigned int imageChildCount(const uint64_t *bits, size_t words)
+{
+    unsigned int count = 0;
+    for (size_t w = 0; w < words; w++) {
+        count += bitCount(bits[w]);
+    }
+    return count;
+}
+
+bool restorePageTableImage(PageTable *pt, const void *image, size_t bytes)
+{
+    ImageCursor c = {static_cast<const char *>(image), bytes};
+    unsigned int levelCount = pt->levelCount;
+    const PageTableImageHeader *hdr = static_cast<const PageTableImageHeader *>(
+        readImage(c, sizeof(PageTableImageHeader)));
+    if (!hdr || hdr->levelCount != levelCount ||
+        (hdr->hashed != 0) != (pt->hashed != nullptr))
+    {
+        return false;
+    }
+    const ArenaImage *arenas = static_cast<const ArenaImage *>(
+        readImage(c, levelCount * sizeof(ArenaImage)));
+    if (!arenas) return false;
+
+    if (pt->hashed) {
+        if (!restoreHashedImage(pt, c, arenas)) return false;
+    } else {
+        const DepthImage *depths = static_cast<const DepthImage *>(
+            readImage(c, levelCount * sizeof(DepthImage)));
+        if (!depths || depths[0].levels != 1) return false;
+
+        // Find each depth's parts and the arena bytes its levels need
+        std::vector<const LevelImage *> nodes(levelCount);
+        std::vector<const uint64_t *> bits(levelCount);
+        std::vector<size_t> liveBytes(levelCount);
+        const Map *maps = nullptr;
+        for (unsigned int d = 0; d < levelCount; d++) {
+            const DepthImage &di = depths[d];
+            bool leaf = (d + 1 == levelCount);
+            unsigned int entries = 1u << pt->levelBits[d];
+            size_t words = (entries + 63) >> 6;
+            nodes[d] = static_cast<const LevelImage *>(
+                readImage(c, di.levels * sizeof(LevelImage)));
+            bits[d] = static_cast<const uint64_t *>(
+                readImage(c, di.childWords * sizeof(uint64_t)));
+            if (leaf) {
+                maps = static_cast<const Map *>(readImage(c, di.maps * sizeof(Map)));
+            }
+            if (!nodes[d] || !bits[d] || (leaf && !maps)) return false;
+
+            size_t live = arenaRound(di.levels * sizeof(Level));
+            uint64_t withChildren = 0, withMaps = 0, children = 0;
+            for (uint64_t i = 0; i < di.levels; i++) {
+                uint32_t flags = nodes[d][i].flags;
+                if (flags & LEVEL_IMAGE_CHILDREN) {
+                    if (leaf || (withChildren + 1) * words > di.childWords) return false;
+                    unsigned int count = imageChildCount(bits[d] + withChildren * words, words);
+                    withChildren++;
+                    children += count;
+                    live += (flags & LEVEL_IMAGE_SPARSE)
+                        ? sparseBlockBytes(entries, count)
+                        : arenaRound(entries * sizeof(Level *));
+                }
+                if (flags & LEVEL_IMAGE_MAPS) {
+                    if (!leaf) return false;
+                    withMaps++;
+                    live += arenaRound(entries * sizeof(Map));
+                }
+            }
+            if (withChildren * words != di.childWords ||
+                (leaf ? withMaps * entries != di.maps : children != depths[d + 1].levels))
+            {
+                return false;
+            }
+            if (leaf) {
+                live += hdr->freeMapArrays * arenaRound(entries * sizeof(Map));
+            }
+            liveBytes[d] = live;
+        }
+
+        // Lay each depth out in bulk: its levels, then their arrays
+        std::vector<Level *> levels(levelCount);
+        std::vector<char *> next(levelCount);
+        for (unsigned int d = 0; d < levelCount; d++) {
+            char *content = restoreArena(pt->arenas[d], arenas[d], liveBytes[d]);
+            levels[d] = reinterpret_cast<Level *>(content);
+            next[d] = content + arenaRound(depths[d].levels * sizeof(Level));
+        }
+        for (unsigned int d = 0; d < levelCount; d++) {
+            unsigned int entries = 1u << pt->levelBits[d];
+            size_t words = (entries + 63) >> 6;
+            const uint64_t *b = bits[d];
+            Level *child = d + 1 < levelCount ? levels[d + 1] : nullptr;
+            char *p = next[d];
+            for (uint64_t i = 0; i < depths[d].levels; i++) {
+                const LevelImage &li = nodes[d][i];
+                Level *lvl = &levels[d][i];
+                lvl->depth = d;
+                lvl->entryCount = entries;
+                lvl->nextLevelArray = nullptr;
+                lvl->mapArray = nullptr;
+                lvl->filled = li.filled;
+                lvl->large.pte = li.large;
+
+                if (li.flags & LEVEL_IMAGE_CHILDREN) {
+                    if (li.flags & LEVEL_IMAGE_SPARSE) {
+                        unsigned int count = imageChildCount(b, words);
+                        size_t header = sparseHeaderBytes(entries);
+                        uint64_t *block = reinterpret_cast<uint64_t *>(p);
+                        p += sparseBlockBytes(entries, count);
+                        memset(block, 0, header);
+                        memcpy(block, b, words * sizeof(uint64_t));
+                        uint32_t *ranks = reinterpret_cast<uint32_t *>(block + words);
+                        unsigned int rank = 0;
+                        for (size_t w = 0; w < words; w++) {
+                            ranks[w] = rank;
+                            rank += bitCount(b[w]);
+                        }
+                        lvl->childBits = block;
+                        lvl->nextLevelArray = reinterpret_cast<Level **>(
+                            reinterpret_cast<char *>(block) + header);
+                        for (unsigned int k = 0; k < count; k++) {
+                            lvl->nextLevelArray[k] = child++;
+                        }
+                    } else {
+                        lvl->nextLevelArray = reinterpret_cast<Level **>(p);
+                        p += arenaRound(entries * sizeof(Level *));
+                        for (unsigned int k = 0; k < entries; k++) {
+                            lvl->nextLevelArray[k] =
+                                ((b[k >> 6] >> (k & 63)) & 1) ? child++ : nullptr;
+                        }
+                    }
+                    b += words;
+                }
+                if (li.flags & LEVEL_IMAGE_MAPS) {
+                    lvl->mapArray = reinterpret_cast<Map *>(p);
+                    p += arenaRound(entries * sizeof(Map));
+                    memcpy(lvl->mapArray, maps, entries * sizeof(Map));
+                    maps += entries;
+                }
+            }
+            if (d + 1 == levelCount) {
+                pt->freeMapArrays = nullptr;
+                for (uint64_t k = 0; k < hdr->freeMapArrays; k++) {
+                    Map *arr = reinterpret_cast<Map *>(p);
+                    p += arenaRound(entries * sizeof(Map));
+                    *reinterpret_cast<Map **>(arr) = pt->freeMapArrays;
+                    pt->freeMapArrays = arr;
+                }
+            }
+        }
+        pt->rootLevel = levels[0];
+    }
+
+    pt->entryCount = hdr->entryCount;
+    pt->nodeCount = hdr->nodeCount;
+    pt->promotions = hdr->promotions;
+    pt->demotions = hdr->demotions;
+    pt->freeBytes = hdr->freeBytes;
+    return true;
+}
@@ -6,41 +6,239 @@
 
 #include <cstddef> // for size_t
 #include <cstdint> // for uint32_t
+#include <cstdio>  // for FILE
+#include "vaddr_tracereader.h" // for vaddr_t
 
+// Leaf entry packed into one 32-bit word: the frame number in the low
+// bits and status flags above it. An all-zero word is an unmapped page.
 struct Map {
-    int frameNumber; // frame number of the page (>=0 valid, -1 invalid)
-    bool valid;      // true if page is mapped
+    uint32_t pte;
 };
 
+static const unsigned int PTE_FRAME_BITS = 30;
+static const uint32_t PTE_VALID      = 1u << 31; // page is mapped
+static const uint32_t PTE_LARGE      = 1u << 30; // maps a level's whole subtree
+static const uint32_t PTE_FRAME_MASK = (1u << PTE_FRAME_BITS) - 1u;
+
+// Frames an entry can name. Replacement states never hand out more, so
+// the "infinite" frame count is this many.
+static const unsigned int PTE_FRAME_COUNT = PTE_FRAME_MASK + 1u;
+
+// A large mapping covers 2^k pages backed by 2^k frames from an aligned
+// base frame. Its frame field holds base | (2^(k-1) - 1), so the run of
+// trailing ones gives the size without spending PTE bits on it.
+
+// True if the entry maps a frame
+inline bool mapIsValid(const Map &m)
+{
+    return (m.pte & PTE_VALID) != 0;
+}
+
+// Frame number of a valid entry
+inline int mapFrameNumber(const Map &m)
+{
+    return (int)(m.pte & PTE_FRAME_MASK);
+}
+
+// Pages a valid entry covers, as a power of two: 0 for a single page
+inline unsigned int mapSpanBits(const Map &m)
+{
+    if (!(m.pte & PTE_LARGE)) return 0;
+    return (unsigned int)__builtin_ctz(~(m.pte & PTE_FRAME_MASK)) + 1;
+}
+
+// Frame backing page fullVPN through a valid entry, large or not
+inline int mapFrameFor(const Map &m, vaddr_t fullVPN)
+{
+    uint32_t f = m.pte & PTE_FRAME_MASK;
+    if (m.pte & PTE_LARGE) {
+        uint32_t spanMask = f ^ (f + 1);
+        f = (f & ~spanMask) | ((uint32_t)fullVPN & spanMask);
+    }
+    return (int)f;
+}
+
 struct Level {
     unsigned int depth;     // which level (0 is root)
     unsigned int entryCount; // number of entries in the level
 
     Level **nextLevelArray; // array of pointers to the next level
-    Map *mapArray; // array of maps
+
+    // A leaf only needs mapArray and an interior level only childBits, so
+    // they share a slot.
+    //
+    // Sparse interior level: a bitmap of the children present, the count
+    // of set bits before each bitmap word, and then nextLevelArray holding
+    // only the present children in index order, all in one block. The
+    // block doubles as children are added and gives way to a full
+    // entryCount array once that would be no bigger. nullptr for a full
+    // (or not yet allocated) array.
+    union {
+        Map *mapArray; // array of maps
+        uint64_t *childBits;
+    };
+
+    // Huge pages: valid maps (leaf) or large children (interior), and the
+    // mapping that stands in for the whole subtree once it is promoted
+    unsigned int filled;
+    Map large;
+};
+
+// Set bits in a word. Without a popcount instruction (x86-64 needs
+// -mpopcnt for one) the builtin is a library call; the SWAR count
+// inlines to a handful of shifts and a multiply instead.
+inline unsigned int bitCount(uint64_t x)
+{
+#if defined(__POPCNT__) || defined(__aarch64__)
+    return (unsigned int)__builtin_popcountll(x);
+#else
+    x -= (x >> 1) & 0x5555555555555555ull;
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (unsigned int)((x * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+// Child of an interior level at idx, nullptr if there is none. A sparse
+// level finds the child's slot by counting the present children below
+// idx: the word's running count plus a popcount within the word.
+inline Level *levelChild(const Level *lvl, unsigned int idx)
+{
+    Level *const *children = lvl->nextLevelArray;
+    if (!children) return nullptr;
+    if (!lvl->childBits) return children[idx];
+
+    unsigned int word = idx >> 6;
+    uint64_t bits = lvl->childBits[word];
+    uint64_t bit = 1ull << (idx & 63);
+    if (!(bits & bit)) return nullptr;
+    const uint32_t *ranks = reinterpret_cast<const uint32_t *>(
+        lvl->childBits + ((lvl->entryCount + 63) >> 6));
+    return children[ranks[word] + bitCount(bits & (bit - 1))];
+}
+
+// Address a lookup of child idx reads first, for prefetching
+inline const void *levelChildHint(const Level *lvl, unsigned int idx)
+{
+    if (lvl->childBits) return &lvl->childBits[idx >> 6];
+    return &lvl->nextLevelArray[idx];
+}
+
+// Slab of memory carved up by a bump pointer; payload follows the header
+struct ArenaSlab {
+    ArenaSlab *next;    // previously filled slab
+    size_t used;        // bytes handed out
+    size_t capacity;    // payload bytes
+};
+
+// Power-of-two block sizes an arena keeps free lists for
+static const unsigned int ARENA_BLOCK_CLASSES = 40;
+
+// Per-level bump allocator: all nodes and arrays of one level come from
+// its slabs and are only released together when the table is destroyed.
+// Sparse child blocks outgrown by their level go on a free list by size
+// and are handed out again before the slabs are bumped.
+struct LevelArena {
+    ArenaSlab *slabs;       // current slab, linked to older ones
+    size_t nextSlabBytes;   // payload size for the next slab
+    size_t bytesReserved;   // total payload across slabs
+    void *freeBlocks[ARENA_BLOCK_CLASSES]; // [log2 bytes] released blocks, linked
+    size_t bytesFree;       // bytes held on those lists
+};
+
+struct PageTableWalk;
+struct HashedMaps;
+
+// How a page table is organised
+enum PageTableBackend {
+    PT_RADIX,       // multilevel tree of levelBits-sized nodes
+    PT_SPARSE,      // the same tree, interior levels below the root sparse until dense
+    PT_HASHED       // open-addressing hash from fullVPN to a per-frame entry
 };
 
 struct PageTable {
     unsigned int levelCount;     // N
     unsigned int *levelBits;     // [N] bits for each level
-    unsigned int *levelMask;     // [N] mask for extracting that level's VPN slice
+    vaddr_t *levelMask;          // [N] mask for extracting that level's VPN slice
     unsigned int *levelShift;    // [N] right shift for that level
+    unsigned int addressBits;    // translated address width, at most VADDR_BITS
     unsigned int offsetBits;     // remaining bits for offset
-    unsigned int offsetMask;     // mask for offset
+    vaddr_t offsetMask;          // mask for offset
+    vaddr_t vpnMask;             // mask for the full VPN once shifted down
     Level *rootLevel;            // level 0
+    LevelArena *arenas;          // [N] node storage for each level
+    const PageTableWalk *walk;   // specialized walk, nullptr for the generic one
+    unsigned long entryCount;    // child pointers set plus leaf map slots allocated
+    unsigned long nodeCount;     // levels allocated, root included
+
+    // Huge pages: a level below the root whose maps are all valid and
+    // backed by one aligned run of frames (or whose children all are
+    // large, in frame order) is promoted to a large mapping and walks
+    // stop there. Evicting a page inside demotes it again.
+    bool hugePages;
+    unsigned long promotions;    // levels turned into large mappings
+    unsigned long demotions;     // large mappings split by an eviction
+    Map *freeMapArrays;          // leaf arrays released by promotion, linked
+    size_t freeBytes;            // bytes held on that list
+
+    // Sparse backend: interior levels below the root keep their children
+    // in sparse blocks (see Level) rather than full arrays
+    bool sparseLevels;
+
+    // Hashed backend: no levels are allocated (rootLevel is nullptr) and
+    // memory grows with resident pages, not with address space spread.
+    // nullptr for the tree.
+    HashedMaps *hashed;
 };
 
+// Whether a fault can move or reuse the entry an earlier search returned.
+// In the tree a leaf entry belongs to one page for good; with huge pages a
+// promoted leaf's array is released, and the hashed backend keeps one
+// entry per frame, handed to each page the frame holds in turn.
+inline bool mapsMayMove(const PageTable *pt)
+{
+    return pt->hugePages || pt->hashed;
+}
+
+// Backend a table was created with, for creating another like it
+inline PageTableBackend pageTableBackend(const PageTable *pt)
+{
+    if (pt->hashed) return PT_HASHED;
+    return pt->sparseLevels ? PT_SPARSE : PT_RADIX;
+}
+
+// Page number folded to 32 bits for hashing
+inline uint32_t foldVPN(vaddr_t vpn)
+{
+#if VADDR_BITS == 64
+    return (uint32_t)vpn ^ (uint32_t)(vpn >> 32);
+#else
+    return vpn;
+#endif
+}
+
 // Extract VPN slice from a virtual address using given mask+shift
-unsigned int extractVPNFromVirtualAddress(unsigned int virtualAddress, unsigned int mask, unsigned int shift);
+unsigned int extractVPNFromVirtualAddress(vaddr_t virtualAddress, vaddr_t mask, unsigned int shift);
 
 // Search for the mapped physical frame number in the page table
-Map* searchMappedPfn(PageTable *pageTable, unsigned int virtualAddress);
+Map* searchMappedPfn(PageTable *pageTable, vaddr_t virtualAddress);
+
+// Search for n addresses at once, walking them level by level in lockstep
+// and prefetching each next level so the cache misses overlap. out[i] is
+// what searchMappedPfn would return for vas[i].
+void searchMappedPfnBatch(PageTable *pageTable, const vaddr_t *vas, size_t n, Map **out);
 
 // Insert a new map for the virtual address to physical frame number
-void insertMapForVpn2Pfn(PageTable *pageTable, unsigned int virtualAddress, int frameNumber);
+// (-1 unmaps it). Exits if the frame is PTE_FRAME_COUNT or above.
+void insertMapForVpn2Pfn(PageTable *pageTable, vaddr_t virtualAddress, int frameNumber);
 
-// Create a new page table
-PageTable *createPageTable(unsigned int levelCount, const unsigned int levelBitsArray[]);
+// Create a new page table for addressBits-wide addresses; the levels take
+// the top bits and the offset the rest. The hashed backend only uses
+// levelBits for the page size (and the per-level VPN slices some log
+// modes print).
+PageTable *createPageTable(unsigned int levelCount, const unsigned int levelBitsArray[],
+                           PageTableBackend backend = PT_RADIX,
+                           unsigned int addressBits = VADDR_BITS);
 
 // Destroy a page table
 void destroyPageTable(PageTable *pt);
@@ -48,18 +246,48 @@ void destroyPageTable(PageTable *pt);
 // Helpers
 
 // Get the full VPN from a virtual address
-unsigned int getFullVPN(PageTable *pt, unsigned int virtualAddress);
+vaddr_t getFullVPN(PageTable *pt, vaddr_t virtualAddress);
 
 // Get the offset from a virtual address
-unsigned int getOffsetFromVA(PageTable *pt, unsigned int virtualAddress);
+unsigned int getOffsetFromVA(PageTable *pt, vaddr_t virtualAddress);
 
 // Compose the physical address from the frame number and offset
-unsigned int composePhysicalAddress(PageTable *pt, int frameNumber, unsigned int offset);
+vaddr_t composePhysicalAddress(PageTable *pt, int frameNumber, unsigned int offset);
+
+// Number of page table entries: every non-null child pointer plus every
+// slot of each allocated leaf map array (for the hashed backend, every
+// index bucket plus every per-frame entry allocated). Kept up to date as levels are
+// allocated, so it can be read at any point of a run.
+unsigned long pageTableEntries(const PageTable *pt);
+
+// Number of levels (nodes) allocated, root included
+unsigned long pageTableNodes(const PageTable *pt);
+
+// Allocate a new level from the table's arena for that depth
+Level *allocateLevel(PageTable *pt, unsigned int depth, unsigned int entryCount);
+
+// Allocate a level's empty child pointer array / leaf map array
+Level **allocateNextLevelArray(PageTable *pt, Level *lvl);
+Map *allocateMapArray(PageTable *pt, Level *lvl);
+
+// Allocate a child level at idx of interior level lvl, which has none
+// there, and link it in. With the sparse backend, levels below the root
+// start sparse and stay so while a sparse block is smaller than the full
+// array.
+Level *addLevelChild(PageTable *pt, Level *lvl, unsigned int idx);
 
-// Count the number of page table entries
-unsigned int countPageTableEntries(Level *lvl, bool isLeafLevel, unsigned int depth, unsigned int lastDepth);
+// Bytes of the table's arenas in use: everything reserved, less leaf
+// arrays released by huge page promotion and sparse child blocks
+// outgrown, both kept for reuse, plus the hashed backend's index
+size_t pageTableBytes(const PageTable *pt);
 
-// Allocate a new level
-Level *allocateLevel(unsigned int depth, unsigned int entryCount);
+// Checkpoints: write a flat image of the table to out, or rebuild a table
+// just created with the same levels and backend from an image in memory
+// (such as a mapped checkpoint). Each depth's levels and arrays are laid
+// out in bulk rather than inserted page by page, and the arenas then grow
+// exactly as the original's would have. Both return false on a write
+// error or an image that does not fit the table.
+bool writePageTableImage(const PageTable *pt, FILE *out);
+bool restorePageTableImage(PageTable *pt, const void *image, size_t bytes);
 
 #endif // PAGETABLE_H
\ No newline at end of file
@@ -0,0 +1,39 @@
+#include "pagetable_walk.h"
+
+// Splits with a specialized walk; anything else uses the generic one
+static const PageTableWalk *const fixedWalks[] = {
+    &FixedWalk<20>::walk,
+    &FixedWalk<10, 10>::walk,
+    &FixedWalk<8, 12>::walk,
+    &FixedWalk<4, 8, 8>::walk,
+    &FixedWalk<6, 6, 8>::walk,
+    &FixedWalk<8, 8, 4>::walk,
+    &FixedWalk<8, 8, 8>::walk,
+    &FixedWalk<4, 4, 10>::walk,
+    &FixedWalk<4, 4, 12>::walk,
+    &FixedWalk<4, 4, 4, 4, 4>::walk,
+#if VADDR_BITS == 64
+    // x86-64 and ARM64 with 4 KB pages: 4-level 48-bit and 5-level 57-bit
+    &FixedWalkFor<48, 9, 9, 9, 9>::walk,
+    &FixedWalkFor<57, 9, 9, 9, 9, 9>::walk,
+#endif
+};
+
+const PageTableWalk *findPageTableWalk(unsigned int levelCount,
+                                       const unsigned int levelBits[],
+                                       unsigned int addressBits)
+{
+    for (const PageTableWalk *w : fixedWalks) {
+        if (w->addressBits != addressBits || w->levelCount != levelCount) continue;
+
+        bool same = true;
+        for (unsigned int i = 0; i < levelCount; i++) {
+            if (w->levelBits[i] != levelBits[i]) {
+                same = false;
+                break;
+            }
+        }
+        if (same) return w;
+    }
+    return nullptr;
+}
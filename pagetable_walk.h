@@ -0,0 +1,122 @@
+#ifndef PAGETABLE_WALK_H
+#define PAGETABLE_WALK_H
+
+#include "pagetable.h"
+#include "instrument.h"
+
+// Page table walks specialized for a fixed level split. The generic walk
+// loads each level's mask and shift from the table and tests for the leaf
+// every iteration; FixedWalk<Bits...> unrolls the walk at compile time so
+// every index is a shift and mask by constants. Both walks operate on the
+// same PageTable nodes and can be mixed freely. FixedWalk is for
+// VADDR_BITS-wide addresses; FixedWalkFor<AddressBits, Bits...> for
+// narrower ones, such as 48-bit x86-64 addresses in a PAGING_VA64 build.
+
+struct PageTableWalk {
+    unsigned int addressBits;       // address width this walk is for
+    unsigned int levelCount;
+    const unsigned int *levelBits;  // [levelCount] split this walk is for
+    Map *(*search)(PageTable *pt, vaddr_t virtualAddress);
+    void (*insert)(PageTable *pt, vaddr_t virtualAddress, int frameNumber);
+};
+
+// Step of a walk at Depth, whose level index sits below bit Top of the
+// address and is Bits wide; Rest are the bits of the levels below.
+template <unsigned int Depth, unsigned int Top, unsigned int Bits,
+          unsigned int... Rest>
+struct WalkStep {
+    static const unsigned int shift = Top - Bits;
+    static const unsigned int mask = (1u << Bits) - 1u;
+
+    typedef WalkStep<Depth + 1, shift, Rest...> Next;
+
+    static Map *search(Level *curr, vaddr_t va)
+    {
+        INSTRUMENT_COUNT(IC_WALK_LEVELS);
+        Level *next = levelChild(curr, (unsigned int)(va >> shift) & mask);
+        if (!next) return nullptr;
+        if (mapIsValid(next->large)) return &next->large;
+        return Next::search(next, va);
+    }
+
+    static void insert(PageTable *pt, Level *curr, vaddr_t va, int frameNumber)
+    {
+        unsigned int idx = (unsigned int)(va >> shift) & mask;
+        Level *next = levelChild(curr, idx);
+        if (!next) {
+            next = addLevelChild(pt, curr, idx);
+        }
+        Next::insert(pt, next, va, frameNumber);
+    }
+
+    static const unsigned int bits = Bits;
+};
+
+// Leaf step
+template <unsigned int Depth, unsigned int Top, unsigned int Bits>
+struct WalkStep<Depth, Top, Bits> {
+    static const unsigned int shift = Top - Bits;
+    static const unsigned int mask = (1u << Bits) - 1u;
+    static const unsigned int bits = Bits;
+
+    static Map *search(Level *curr, vaddr_t va)
+    {
+        INSTRUMENT_COUNT(IC_WALK_LEVELS);
+        if (!curr->mapArray) return nullptr;
+        Map &m = curr->mapArray[(unsigned int)(va >> shift) & mask];
+        return mapIsValid(m) ? &m : nullptr;
+    }
+
+    static void insert(PageTable *pt, Level *curr, vaddr_t va, int frameNumber)
+    {
+        if (!curr->mapArray) {
+            allocateMapArray(pt, curr);
+        }
+        Map &m = curr->mapArray[(unsigned int)(va >> shift) & mask];
+        if (frameNumber >= 0) {
+            m.pte = PTE_VALID | ((uint32_t)frameNumber & PTE_FRAME_MASK);
+        } else {
+            // Invalidate mapping - used during eviction
+            m.pte = 0;
+        }
+    }
+};
+
+template <unsigned int AddressBits, unsigned int... Bits>
+struct FixedWalkFor {
+    typedef WalkStep<0, AddressBits, Bits...> Root;
+
+    static const unsigned int levelBits[sizeof...(Bits)];
+
+    static Map *search(PageTable *pt, vaddr_t va)
+    {
+        return Root::search(pt->rootLevel, va);
+    }
+
+    static void insert(PageTable *pt, vaddr_t va, int frameNumber)
+    {
+        Root::insert(pt, pt->rootLevel, va, frameNumber);
+    }
+
+    static const PageTableWalk walk;
+};
+
+template <unsigned int AddressBits, unsigned int... Bits>
+const unsigned int FixedWalkFor<AddressBits, Bits...>::levelBits[sizeof...(Bits)] = {Bits...};
+
+template <unsigned int AddressBits, unsigned int... Bits>
+const PageTableWalk FixedWalkFor<AddressBits, Bits...>::walk = {
+    AddressBits, sizeof...(Bits), FixedWalkFor<AddressBits, Bits...>::levelBits,
+    FixedWalkFor<AddressBits, Bits...>::search, FixedWalkFor<AddressBits, Bits...>::insert
+};
+
+template <unsigned int... Bits>
+struct FixedWalk : FixedWalkFor<VADDR_BITS, Bits...> {};
+
+// Specialized walk for a level split of addressBits-wide addresses,
+// nullptr if none was compiled in
+const PageTableWalk *findPageTableWalk(unsigned int levelCount,
+                                       const unsigned int levelBits[],
+                                       unsigned int addressBits = VADDR_BITS);
+
+#endif // PAGETABLE_WALK_H
@@ -1,43 +1,353 @@
 #include "replacement.h"
+#include "instrument.h"
+#include "tlb.h"
 #include <limits>
+#include <algorithm>
+
+// Resident index
+
+static unsigned int residentHash(const ResidentIndex &ix, vaddr_t fullVPN)
+{
+    // Fibonacci hashing: top bits of the product pick the bucket
+    return (foldVPN(fullVPN) * 2654435769u) >> ix.hashShift;
+}
+
+void residentIndexInit(ResidentIndex &ix, unsigned int expectedEntries)
+{
+    // Keep the load factor at or below 1/2
+    unsigned int bits = 4;
+    while (bits < 31 && (1u << bits) < 2u * (unsigned long long)expectedEntries) {
+        bits++;
+    }
+
+    ix.buckets.assign(1u << bits, ResidentBucket{0, -1});
+    ix.hashShift = 32 - bits;
+    ix.count = 0;
+}
+
+int residentIndexFind(const ResidentIndex &ix, vaddr_t fullVPN)
+{
+    unsigned int mask = (unsigned int)ix.buckets.size() - 1;
+    unsigned int b = residentHash(ix, fullVPN);
+
+    while (ix.buckets[b].slot >= 0) {
+        if (ix.buckets[b].fullVPN == fullVPN) {
+            return ix.buckets[b].slot;
+        }
+        b = (b + 1) & mask;
+    }
+    return -1;
+}
+
+static void residentIndexGrow(ResidentIndex &ix)
+{
+    std::vector<ResidentBucket> old;
+    old.swap(ix.buckets);
+
+    residentIndexInit(ix, (unsigned int)old.size());
+    for (const auto &bucket : old) {
+        if (bucket.slot >= 0) {
+            residentIndexInsert(ix, bucket.fullVPN, bucket.slot);
+        }
+    }
+}
+
+void residentIndexInsert(ResidentIndex &ix, vaddr_t fullVPN, int slot)
+{
+    if (2 * (ix.count + 1) > ix.buckets.size()) {
+        residentIndexGrow(ix);
+    }
+
+    unsigned int mask = (unsigned int)ix.buckets.size() - 1;
+    unsigned int b = residentHash(ix, fullVPN);
+
+    while (ix.buckets[b].slot >= 0) {
+        if (ix.buckets[b].fullVPN == fullVPN) {
+            ix.buckets[b].slot = slot;
+            return;
+        }
+        b = (b + 1) & mask;
+    }
+    ix.buckets[b].fullVPN = fullVPN;
+    ix.buckets[b].slot = slot;
+    ix.count++;
+}
+
+void residentIndexErase(ResidentIndex &ix, vaddr_t fullVPN)
+{
+    unsigned int mask = (unsigned int)ix.buckets.size() - 1;
+    unsigned int b = residentHash(ix, fullVPN);
+
+    while (ix.buckets[b].slot >= 0 && ix.buckets[b].fullVPN != fullVPN) {
+        b = (b + 1) & mask;
+    }
+    if (ix.buckets[b].slot < 0) return; // not present
+
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    unsigned int hole = b;
+    unsigned int next = (hole + 1) & mask;
+    while (ix.buckets[next].slot >= 0) {
+        unsigned int home = residentHash(ix, ix.buckets[next].fullVPN);
+        // Move next into the hole unless its home lies in (hole, next]
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            ix.buckets[hole] = ix.buckets[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    ix.buckets[hole].slot = -1;
+    ix.count--;
+}
 
 // Initialize the replacement state
+// Most frames initReplacementState sizes the state for before any load
+static const unsigned int PRESIZED_FRAMES = 1u << 16;
+
 void initReplacementState(ReplacementState &rs,
                           unsigned int maxFrames,
-                          unsigned int bitInterval)
+                          unsigned int bitInterval,
+                          const ReplacementPolicy *policy)
 {
-    rs.maxFrames = maxFrames;
+    // Frame numbers have to fit a page table entry
+    rs.maxFrames = maxFrames < PTE_FRAME_COUNT ? maxFrames : PTE_FRAME_COUNT;
     rs.bitstringInterval = bitInterval;
     rs.accessesSinceAging = 0;
     rs.currentTime = 0;
     rs.nextFreeFrame = 0;
-    rs.loaded.clear();
+    rs.frameVPN.clear();
+    rs.ageBits.clear();
+    rs.ageEpoch.clear();
+    rs.agingEpoch = 0;
+    rs.lastAccessTime.clear();
+    rs.accessedBits.clear();
+    rs.dirtyBits.clear();
+    rs.victimHeap.clear();
+    for (AgingBand &b : rs.agingBands) {
+        b.heap.clear();
+        b.ordered = false;
+        b.orderedEpoch = 0;
+    }
+    rs.intervalAccesses.clear();
+    rs.victimHeapValid = false;
+    rs.preferClean = false;
+    rs.dirtyEvictions = 0;
+    rs.tlb = nullptr;
+    rs.tables = nullptr;
+    rs.tableShift = 0;
+
+    rs.policy = policy ? policy : &agingPolicy;
+    rs.hand = 0;
+    rs.framePrev.clear();
+    rs.frameNext.clear();
+    rs.frameList.clear();
+    for (IndexList &l : rs.recency) {
+        l = IndexList{-1, -1, 0};
+    }
+    rs.arcGhosts.vpn.clear();
+    rs.arcGhosts.prev.clear();
+    rs.arcGhosts.next.clear();
+    rs.arcGhosts.list.clear();
+    rs.arcGhosts.freeNodes.clear();
+    for (IndexList &l : rs.arcGhosts.lists) {
+        l = IndexList{-1, -1, 0};
+    }
+    rs.arcTarget = 0;
+    rs.arcToFrequent = false;
+
+    // Size the index and frame arrays up front when the frame count is
+    // bounded, but no further than PRESIZED_FRAMES: past that they grow
+    // with the pages actually loaded, so a large -f costs nothing until
+    // the frames are used
+    unsigned int expected = 0;
+    if (maxFrames != std::numeric_limits<unsigned int>::max()) {
+        expected = std::min(maxFrames, PRESIZED_FRAMES);
+        rs.frameVPN.reserve(expected);
+        rs.ageBits.reserve(expected);
+        rs.ageEpoch.reserve(expected);
+        rs.lastAccessTime.reserve(expected);
+        rs.accessedBits.reserve((expected + 63) / 64);
+        rs.dirtyBits.reserve((expected + 63) / 64);
+    }
+    residentIndexInit(rs.residentIndex, expected);
+    residentIndexInit(rs.arcGhosts.index,
+                      rs.policy == &arcPolicy ? expected : 0);
+}
+
+int findLoadedVPN(const ReplacementState &rs, vaddr_t fullVPN)
+{
+    return residentIndexFind(rs.residentIndex, fullVPN);
+}
+
+// Victim order
+
+// Heap comparator: "a comes out after b", giving a min-heap on the key.
+// The slot breaks ties the same way a front-to-back scan would.
+static bool victimAfter(const VictimHeapEntry &a, const VictimHeapEntry &b)
+{
+    if (a.ageBits != b.ageBits) return a.ageBits > b.ageBits;
+    if (a.dirty != b.dirty) return a.dirty > b.dirty;
+    if (a.lastAccessTime != b.lastAccessTime) {
+        return a.lastAccessTime > b.lastAccessTime;
+    }
+    return a.slot > b.slot;
+}
+
+static VictimHeapEntry victimEntryFor(const ReplacementState &rs, int slot)
+{
+    uint8_t dirty = rs.preferClean && frameDirty(rs, slot);
+    return VictimHeapEntry{frameAgeBits(rs, slot), dirty, rs.lastAccessTime[slot], slot};
 }
 
-int findLoadedVPN(const ReplacementState &rs, unsigned int fullVPN)
+// Pass that shifted in the MSB of a frame's bitstring; false if it is zero
+static bool agingBandOf(const ReplacementState &rs, int slot, unsigned int &band)
 {
-    for (size_t i = 0; i < rs.loaded.size(); i++) {
-        if (rs.loaded[i].fullVPN == fullVPN) {
-            return (int)i;
+    uint16_t age = frameAgeBits(rs, slot);
+    if (age == 0) return false;
+    band = rs.agingEpoch - 15 + (31 - __builtin_clz(age));
+    return true;
+}
+
+static bool inAgingBand(const ReplacementState &rs, int slot, unsigned int band)
+{
+    unsigned int b;
+    return agingBandOf(rs, slot, b) && b == band;
+}
+
+// Sort every frame into its band or the zero heap
+static void rebuildVictimHeap(ReplacementState &rs)
+{
+    rs.victimHeap.clear();
+    for (AgingBand &b : rs.agingBands) {
+        b.heap.clear();
+        b.ordered = false;
+    }
+    rs.intervalAccesses.clear();
+
+    for (size_t i = 0; i < rs.frameVPN.size(); i++) {
+        VictimHeapEntry e = victimEntryFor(rs, (int)i);
+        unsigned int band;
+        if (agingBandOf(rs, (int)i, band)) {
+            rs.agingBands[band % AGING_BANDS].heap.push_back(e);
+        } else {
+            rs.victimHeap.push_back(e);
+        }
+        if (rs.ageEpoch[i] == rs.agingEpoch) {
+            rs.intervalAccesses.push_back(e);
         }
     }
+    std::make_heap(rs.victimHeap.begin(), rs.victimHeap.end(), victimAfter);
+    rs.victimHeapValid = true;
+}
+
+// A frame was loaded or accessed for the first time since the last pass,
+// which is about to set its ageEpoch; the pass moves it to the newest band
+static void noteIntervalAccess(ReplacementState &rs, int slot)
+{
+    if (rs.victimHeapValid && rs.ageEpoch[slot] != rs.agingEpoch) {
+        rs.intervalAccesses.push_back(VictimHeapEntry{0, 0, 0, slot});
+    }
+}
+
+// Pop entries off a heap until its top is current and take that slot
+// out, -1 if it runs out. Entries of frames still in the heap are re-keyed
+// (their key grew); entries of frames that moved on are dropped.
+template <typename Member>
+static int heapVictim(ReplacementState &rs, std::vector<VictimHeapEntry> &heap,
+                      Member member)
+{
+    while (!heap.empty()) {
+        INSTRUMENT_COUNT(IC_VICTIM_SCAN_STEPS);
+        const VictimHeapEntry &top = heap.front();
+        int slot = top.slot;
+        if (top.ageBits == frameAgeBits(rs, slot) &&
+            top.lastAccessTime == rs.lastAccessTime[slot] &&
+            top.dirty == (rs.preferClean && frameDirty(rs, slot)))
+        {
+            // The frame is about to be replaced; its new page is noted
+            // when loaded
+            std::pop_heap(heap.begin(), heap.end(), victimAfter);
+            heap.pop_back();
+            return slot;
+        }
+        std::pop_heap(heap.begin(), heap.end(), victimAfter);
+        if (member(slot)) {
+            heap.back() = victimEntryFor(rs, slot);
+            std::push_heap(heap.begin(), heap.end(), victimAfter);
+        } else {
+            heap.pop_back();
+        }
+    }
+    return -1;
+}
+
+// Choose a victim index: the slot with the lowest (ageBits, lastAccessTime)
+static int chooseVictimIndex(ReplacementState &rs)
+{
+    // If no loaded pages, return -1
+    if (rs.frameVPN.empty()) return -1;
+
+    if (!rs.victimHeapValid) {
+        INSTRUMENT_COUNT(IC_VICTIM_HEAP_REBUILDS);
+        rebuildVictimHeap(rs);
+    }
+
+    int victim = heapVictim(rs, rs.victimHeap, [&rs](int slot) {
+        return frameAgeBits(rs, slot) == 0;
+    });
+    if (victim >= 0) return victim;
+
+    // No frame has aged to zero: take the oldest band with frames left
+    for (unsigned int i = 0; i < AGING_BANDS; i++) {
+        unsigned int band = rs.agingEpoch - (AGING_BANDS - 1) + i;
+        AgingBand &b = rs.agingBands[band % AGING_BANDS];
+        if (b.heap.empty()) continue;
+
+        if (!b.ordered || b.orderedEpoch != rs.agingEpoch) {
+            // A pass shifted every key; re-key the frames still here
+            size_t kept = 0;
+            for (const VictimHeapEntry &e : b.heap) {
+                if (inAgingBand(rs, e.slot, band)) {
+                    b.heap[kept++] = victimEntryFor(rs, e.slot);
+                }
+            }
+            b.heap.resize(kept);
+            std::make_heap(b.heap.begin(), b.heap.end(), victimAfter);
+            b.ordered = true;
+            b.orderedEpoch = rs.agingEpoch;
+        }
+
+        victim = heapVictim(rs, b.heap, [&rs, band](int slot) {
+            return inAgingBand(rs, slot, band);
+        });
+        if (victim >= 0) return victim;
+    }
     return -1;
 }
 
 // Perform aging update
 void performAgingUpdate(ReplacementState &rs)
 {
-    for (auto &entry : rs.loaded) {
-        // Shift right by 1
-        entry.ageBits >>= 1;
-        
-        // If it was accessed within the last interval, set MSB = 1
-        if (entry.accessedThisInterval) {
-            entry.ageBits |= (1u << 15);
+    INSTRUMENT_COUNT(IC_AGING_PASSES);
+    rs.agingEpoch += 1;
+    if (!rs.victimHeapValid) return;
+
+    // The oldest band has aged to zero and its slot takes the frames
+    // accessed in the interval just ended, whose MSB this pass set
+    AgingBand &b = rs.agingBands[rs.agingEpoch % AGING_BANDS];
+    for (const VictimHeapEntry &e : b.heap) {
+        if (frameAgeBits(rs, e.slot) == 0) {
+            rs.victimHeap.push_back(victimEntryFor(rs, e.slot));
+            std::push_heap(rs.victimHeap.begin(), rs.victimHeap.end(), victimAfter);
         }
+    }
+    b.heap.swap(rs.intervalAccesses);
+    b.ordered = false;
+    rs.intervalAccesses.clear();
 
-        // Reset flag
-        entry.accessedThisInterval = false;
+    // Entries of frames accessed since they aged to zero are only dropped
+    // when they reach the top; start over once they are most of the heap
+    if (rs.victimHeap.size() > 2 * rs.frameVPN.size() + 64) {
+        rs.victimHeapValid = false;
     }
 }
 
@@ -45,61 +355,44 @@ void performAgingUpdate(ReplacementState &rs)
 void tickReplacementClock(ReplacementState &rs)
 {
     rs.currentTime += 1;
-    rs.accessesSinceAging += 1;
-
-    if (rs.accessesSinceAging >= rs.bitstringInterval) {
-        // Time to age
-        performAgingUpdate(rs);
-        rs.accessesSinceAging = 0;
+    if (rs.policy->tick) {
+        rs.policy->tick(rs);
     }
 }
 
 // Note a frame access
 void noteFrameAccess(ReplacementState &rs,
-                    unsigned int fullVPN,
+                    vaddr_t fullVPN,
                     int frameNumber)
 {
-    for (auto &entry : rs.loaded) {
-        if (entry.fullVPN == fullVPN &&
-            entry.frameNumber == frameNumber)
-        {
-            entry.lastAccessTime = rs.currentTime;
-            entry.accessedThisInterval = true;
-            return;
-        }
+    // Slots are indexed by frame number, so only that slot can match
+    if (frameNumber < 0 || (size_t)frameNumber >= rs.frameVPN.size()) {
+        return;
     }
-}
-
-// Choose a victim index
-static int chooseVictimIndex(const ReplacementState &rs)
-{
-    // If no loaded pages, return -1
-    if (rs.loaded.empty()) return -1;
-
-    uint16_t bestAge = std::numeric_limits<uint16_t>::max();
-    unsigned int bestLast = std::numeric_limits<unsigned int>::max();
-    int bestIdx = -1;
 
-    for (size_t i = 0; i < rs.loaded.size(); i++) {
-        const auto &e = rs.loaded[i];
-        if ( (e.ageBits < bestAge) ||
-             (e.ageBits == bestAge && e.lastAccessTime < bestLast) )
-        {
-            bestAge = e.ageBits;
-            bestLast = e.lastAccessTime;
-            bestIdx = (int)i;
+    if (rs.frameVPN[frameNumber] == fullVPN) {
+        if (rs.policy->access) {
+            rs.policy->access(rs, frameNumber);
+        }
+        // Catch the bitstring up on the passes since the last access
+        // before this one is recorded
+        if (rs.ageEpoch[frameNumber] != rs.agingEpoch) {
+            noteIntervalAccess(rs, frameNumber);
+            rs.ageBits[frameNumber] = frameAgeBits(rs, frameNumber);
+            rs.ageEpoch[frameNumber] = rs.agingEpoch;
         }
+        rs.lastAccessTime[frameNumber] = rs.currentTime;
+        rs.accessedBits[frameNumber >> 6] |= 1ull << (frameNumber & 63);
     }
-    return bestIdx;
 }
 
 int ensureResidentPage(PageTable *pt,
                         ReplacementState &rs,
-                        unsigned int virtualAddress,
-                        unsigned int fullVPN,
+                        vaddr_t virtualAddress,
+                        vaddr_t fullVPN,
                         bool &didFault,
                         bool &didEvict,
-                        unsigned int &evictedVPN,
+                        vaddr_t &evictedVPN,
                         uint16_t &evictedAgeBits)
 {
     didFault = false;
@@ -110,52 +403,117 @@ int ensureResidentPage(PageTable *pt,
     // Check if the page is already resident
     int idx = findLoadedVPN(rs, fullVPN);
     if (idx >= 0) {
-        return rs.loaded[idx].frameNumber;
+        return idx;
     }
     didFault = true;
     
     // If there is still space for the new page
-    if (rs.loaded.size() < rs.maxFrames) {
+    if (rs.frameVPN.size() < rs.maxFrames) {
         int newPFN = rs.nextFreeFrame;
         rs.nextFreeFrame++;
 
         // Insert into page table
         insertMapForVpn2Pfn(pt, virtualAddress, newPFN);
 
-        // Track in loaded
-        LoadedPageInfo info;
-        info.fullVPN = fullVPN;
-        info.frameNumber = newPFN;
-        info.ageBits = (1u << 15); // new page starts with MSB set
-        info.lastAccessTime = rs.currentTime;
-        info.accessedThisInterval = true;
-        rs.loaded.push_back(info);
+        // Track the new frame
+        rs.frameVPN.push_back(fullVPN);
+        rs.ageBits.push_back(1u << 15); // new page starts with MSB set
+        rs.ageEpoch.push_back(rs.agingEpoch);
+        rs.lastAccessTime.push_back(rs.currentTime);
+        if ((newPFN & 63) == 0) {
+            rs.accessedBits.push_back(0);
+            rs.dirtyBits.push_back(0);
+        }
+        rs.accessedBits[newPFN >> 6] |= 1ull << (newPFN & 63);
+        residentIndexInsert(rs.residentIndex, fullVPN, newPFN);
+
+        if (rs.policy->loaded) {
+            rs.policy->loaded(rs, newPFN, false);
+        }
 
         return newPFN;
     }
 
     // Otherwise: we must evict someone
-    int victimIdx = chooseVictimIndex(rs);
-    LoadedPageInfo &victim = rs.loaded[victimIdx];
+    INSTRUMENT_COUNT(IC_VICTIM_CHOICES);
+    int victimIdx = rs.policy->chooseVictim(rs, fullVPN);
 
     didEvict = true;
-    evictedVPN = victim.fullVPN;
-    evictedAgeBits = victim.ageBits;
+    evictedVPN = rs.frameVPN[victimIdx];
+    evictedAgeBits = frameAgeBits(rs, victimIdx);
+    if (frameDirty(rs, victimIdx)) {
+        rs.dirtyEvictions++;
+    }
 
-    int reusedPFN = victim.frameNumber;
-    // Get the victim virtual address
-    unsigned int victimVA = (evictedVPN << pt->offsetBits);
-    insertMapForVpn2Pfn(pt, victimVA, -1);
+    int reusedPFN = victimIdx;
+    // Get the victim virtual address, in its owner's table
+    PageTable *victimPT = pt;
+    vaddr_t victimVPN = evictedVPN;
+    if (rs.tables) {
+        victimPT = rs.tables[evictedVPN >> rs.tableShift];
+        victimVPN = evictedVPN & (((vaddr_t)1 << rs.tableShift) - 1u);
+    }
+    vaddr_t victimVA = (victimVPN << victimPT->offsetBits);
+    insertMapForVpn2Pfn(victimPT, victimVA, -1);
+    if (rs.tlb) {
+        tlbInvalidate(rs.tlb, evictedVPN);
+    }
+
+    residentIndexErase(rs.residentIndex, evictedVPN);
+    residentIndexInsert(rs.residentIndex, fullVPN, victimIdx);
+
+    // Now reuse the victim's frame for the new page:
+    rs.frameVPN[reusedPFN] = fullVPN;
+    noteIntervalAccess(rs, reusedPFN);
+    rs.ageBits[reusedPFN] = (1u << 15);
+    rs.ageEpoch[reusedPFN] = rs.agingEpoch;
+    rs.lastAccessTime[reusedPFN] = rs.currentTime;
+    rs.accessedBits[reusedPFN >> 6] |= 1ull << (reusedPFN & 63);
+    rs.dirtyBits[reusedPFN >> 6] &= ~(1ull << (reusedPFN & 63));
 
-    // Now reuse victim entry struct for the new page:
-    victim.fullVPN = fullVPN;
-    victim.frameNumber = reusedPFN;
-    victim.ageBits = (1u << 15);
-    victim.lastAccessTime = rs.currentTime;
-    victim.accessedThisInterval = true;
+    if (rs.policy->loaded) {
+        rs.policy->loaded(rs, reusedPFN, true);
+    }
 
     // Install new mapping in page table
     insertMapForVpn2Pfn(pt, virtualAddress, reusedPFN);
 
     return reusedPFN;
 }
+
+// Aging engine
+
+static void agingTick(ReplacementState &rs)
+{
+    rs.accessesSinceAging += 1;
+
+    if (rs.accessesSinceAging >= rs.bitstringInterval) {
+        // Time to age
+        performAgingUpdate(rs);
+        rs.accessesSinceAging = 0;
+    }
+}
+
+static int agingChooseVictim(ReplacementState &rs, vaddr_t incomingVPN)
+{
+    (void)incomingVPN;
+    return chooseVictimIndex(rs);
+}
+
+static void agingLoaded(ReplacementState &rs, int frame, bool replaced)
+{
+    (void)replaced;
+    if (!rs.victimHeapValid) return;
+
+    // A new page's MSB is set, so it joins the newest band now (and the
+    // next one at the pass, as ensureResidentPage noted)
+    AgingBand &b = rs.agingBands[rs.agingEpoch % AGING_BANDS];
+    b.heap.push_back(victimEntryFor(rs, frame));
+    if (b.ordered && b.orderedEpoch == rs.agingEpoch) {
+        std::push_heap(b.heap.begin(), b.heap.end(), victimAfter);
+    }
+}
+
+const ReplacementPolicy agingPolicy = {
+    "aging", agingTick, nullptr, agingChooseVictim, agingLoaded
+};
@@ -7,14 +7,86 @@
 
 // Forward declaration to avoid circular dependency
 struct PageTable;
+struct Tlb;
+struct ReplacementState;
 
-// Struct to store information about a loaded page
-struct LoadedPageInfo {
-    unsigned int fullVPN;           
-    int frameNumber;                
-    uint16_t ageBits;               
-    unsigned int lastAccessTime;    
-    bool accessedThisInterval;      
+// Bucket in the resident-page index
+struct ResidentBucket {
+    vaddr_t fullVPN;
+    int slot;                       // -1 marks an empty bucket
+};
+
+// Open-addressing fullVPN -> slot map (linear probing, power-of-two size)
+struct ResidentIndex {
+    std::vector<ResidentBucket> buckets;
+    unsigned int hashShift;         // 32 - log2(bucket count)
+    unsigned int count;
+};
+
+// Victim heap entry: key cached when the entry was (re)pushed
+struct VictimHeapEntry {
+    uint16_t ageBits;
+    uint8_t dirty;                  // only set when clean victims are preferred
+    unsigned int lastAccessTime;
+    int slot;
+};
+
+// Aging passes a bitstring's MSB survives before it is zero
+static const unsigned int AGING_BANDS = 16;
+
+// Frames whose bitstring MSB was shifted in by the same aging pass. The
+// entries are a heap only once ordered for the current epoch.
+struct AgingBand {
+    std::vector<VictimHeapEntry> heap;
+    unsigned int orderedEpoch;      // agingEpoch the heap was ordered for
+    bool ordered;
+};
+
+// Replacement policy engine. ensureResidentPage owns frame allocation and
+// page table / TLB invalidation for every policy; an engine only keeps
+// its own recency state and picks victims. Hooks may be nullptr.
+struct ReplacementPolicy {
+    const char *name;
+
+    // Once per access, after the clock advanced
+    void (*tick)(ReplacementState &rs);
+
+    // A resident page was accessed, before lastAccessTime is updated
+    void (*access)(ReplacementState &rs, int frame);
+
+    // All frames are in use: pick the frame to give to incomingVPN
+    int (*chooseVictim)(ReplacementState &rs, vaddr_t incomingVPN);
+
+    // A page was placed in frame, either a new frame or a victim's
+    void (*loaded)(ReplacementState &rs, int frame, bool replaced);
+};
+
+// Built-in engines
+extern const ReplacementPolicy agingPolicy;
+extern const ReplacementPolicy clockPolicy;
+extern const ReplacementPolicy lruPolicy;
+extern const ReplacementPolicy fifoPolicy;
+extern const ReplacementPolicy arcPolicy;
+
+// Look up a built-in engine by name, nullptr if there is none
+const ReplacementPolicy *findReplacementPolicy(const char *name);
+
+// Doubly linked list threaded through per-element prev/next arrays
+struct IndexList {
+    int head;                       // most recent, -1 if empty
+    int tail;                       // least recent, -1 if empty
+    unsigned int size;
+};
+
+// ARC ghost lists: pages recently evicted from T1 (B1) and T2 (B2)
+struct ArcGhosts {
+    std::vector<vaddr_t> vpn;       // page held by each node
+    std::vector<int> prev;
+    std::vector<int> next;
+    std::vector<uint8_t> list;      // 0 = B1, 1 = B2
+    std::vector<int> freeNodes;
+    ResidentIndex index;            // fullVPN -> node
+    IndexList lists[2];
 };
 
 // Struct to store replacement state
@@ -25,34 +97,139 @@ struct ReplacementState {
     unsigned int currentTime;         
     unsigned int nextFreeFrame;       
 
-    std::vector<LoadedPageInfo> loaded;
+    // Loaded pages, struct-of-arrays indexed by frame number: frames are
+    // handed out in order and a victim's frame is reused for the page
+    // that replaces it, so slot i always holds frame i.
+    std::vector<vaddr_t> frameVPN;            // fullVPN held by each frame
+    std::vector<uint16_t> ageBits;            // aging bitstring as of ageEpoch
+    std::vector<unsigned int> ageEpoch;       // aging pass of the frame's last access
+    std::vector<unsigned int> lastAccessTime; // tick of the last access
+    std::vector<uint64_t> accessedBits;       // 1 bit per frame, CLOCK reference bits
+    std::vector<uint64_t> dirtyBits;          // 1 bit per frame, written since loaded
+
+    // Aging is lazy: a pass only advances agingEpoch. A frame's bitstring
+    // is brought up to date when it is accessed, and otherwise worked out
+    // from the passes it sat through (see frameAgeBits), so a pass costs
+    // nothing and an interval costs what its accesses do.
+    unsigned int agingEpoch;          // aging passes so far
+
+    // fullVPN -> frame, so residency checks do not scan frames
+    ResidentIndex residentIndex;
+
+    // Victim order over (ageBits, lastAccessTime, slot). A bitstring whose
+    // MSB was shifted in k passes ago lies in [2^(15-k), 2^(16-k)), so the
+    // frames fall into AGING_BANDS bands by the pass that set their MSB,
+    // each below the next newer one, plus those aged to zero. The zero
+    // frames keep their order from pass to pass in victimHeap; a band is
+    // heaped again only when a victim is wanted from it after a pass. A
+    // pass moves the oldest band to victimHeap and makes the frames
+    // accessed in the interval it ends the newest. Between those moves a
+    // frame's key only grows, so stale entries are repaired when they
+    // reach the top and entries of frames that moved on are dropped.
+    // Built on the first eviction, or again once victimHeap is mostly
+    // stale. With preferClean, clean pages sort before dirty ones of equal
+    // age; a page only turns dirty while loaded, so the key still only
+    // grows.
+    std::vector<VictimHeapEntry> victimHeap;      // frames aged to zero
+    AgingBand agingBands[AGING_BANDS];            // [pass % AGING_BANDS]
+    std::vector<VictimHeapEntry> intervalAccesses; // frames accessed since the last pass
+    bool victimHeapValid;
+    bool preferClean;
+
+    // Evictions of pages that had been written, which need a write-back
+    unsigned int dirtyEvictions;
+
+    // Optional TLB whose entries are dropped when their page is evicted
+    Tlb *tlb;
+
+    // Per-process mode: page keys are (table << tableShift) | VPN and a
+    // victim is unmapped from tables[key >> tableShift]. nullptr when
+    // every page belongs to the page table passed to ensureResidentPage.
+    PageTable *const *tables;
+    unsigned int tableShift;
+
+    // Policy engine and the state of the built-in ones
+    const ReplacementPolicy *policy;
+    unsigned int hand;                // CLOCK hand / next FIFO victim
+    std::vector<int> framePrev;       // LRU and ARC recency lists
+    std::vector<int> frameNext;
+    std::vector<uint8_t> frameList;   // ARC: 0 = T1, 1 = T2
+    IndexList recency[2];             // LRU uses [0]; ARC T1 and T2
+    ArcGhosts arcGhosts;
+    unsigned int arcTarget;           // ARC p, target size of T1
+    bool arcToFrequent;               // ARC: next page loads into T2
 };
 
-// Initialize the replacement state
+// Number of frames currently holding a page
+inline unsigned int loadedFrameCount(const ReplacementState &rs)
+{
+    return (unsigned int)rs.frameVPN.size();
+}
+
+// Whether a frame was accessed since the last aging update
+inline bool frameAccessedThisInterval(const ReplacementState &rs, int frame)
+{
+    return rs.ageEpoch[frame] == rs.agingEpoch;
+}
+
+// Current aging bitstring of a frame. ageBits holds it as of the pass the
+// frame was last accessed in; the first pass since shifts that access in
+// as the MSB and every later one shifts in a zero.
+inline uint16_t frameAgeBits(const ReplacementState &rs, int frame)
+{
+    unsigned int passes = rs.agingEpoch - rs.ageEpoch[frame];
+    uint16_t age = rs.ageBits[frame];
+    if (passes == 0) return age;
+    if (passes > 16) return 0;
+    return (uint16_t)(((age >> 1) | 0x8000u) >> (passes - 1));
+}
+
+// Whether a frame was written since its page was loaded
+inline bool frameDirty(const ReplacementState &rs, int frame)
+{
+    return (rs.dirtyBits[frame >> 6] >> (frame & 63)) & 1u;
+}
+
+// Note a write to the page in a frame
+inline void noteFrameWrite(ReplacementState &rs, int frame)
+{
+    rs.dirtyBits[frame >> 6] |= 1ull << (frame & 63);
+}
+
+// Initialize the replacement state (aging unless another policy is given).
+// maxFrames is capped at PTE_FRAME_COUNT, which also stands in for UINT_MAX
+// ("infinite").
 void initReplacementState(ReplacementState &rs,
     unsigned int maxFrames,
-    unsigned int bitInterval);
+    unsigned int bitInterval,
+    const ReplacementPolicy *policy = nullptr);
+
+// Resident index operations
+void residentIndexInit(ResidentIndex &ix, unsigned int expectedEntries);
+int residentIndexFind(const ResidentIndex &ix, vaddr_t fullVPN);
+void residentIndexInsert(ResidentIndex &ix, vaddr_t fullVPN, int slot);
+void residentIndexErase(ResidentIndex &ix, vaddr_t fullVPN);
 
 // Tick the replacement clock
 void tickReplacementClock(ReplacementState &rs);
 
 // Note a frame access
-void noteFrameAccess(ReplacementState &rs, unsigned int fullVPN, int frameNumber);
+void noteFrameAccess(ReplacementState &rs, vaddr_t fullVPN, int frameNumber);
 
 // Find a loaded VPN
-int findLoadedVPN(const ReplacementState &rs, unsigned int fullVPN);
+int findLoadedVPN(const ReplacementState &rs, vaddr_t fullVPN);
 
 // Ensure a resident page
 int ensureResidentPage(PageTable *pt,
     ReplacementState &rs,
-    unsigned int virtualAddress,
-    unsigned int fullVPN,
+    vaddr_t virtualAddress,
+    vaddr_t fullVPN,
     bool &didFault,
     bool &didEvict,
-    unsigned int &evictedVPN,
+    vaddr_t &evictedVPN,
     uint16_t &evictedAgeBits);
 
-// Perform aging update
+// Perform aging update: start the next aging interval
 void performAgingUpdate(ReplacementState &rs);
 
 #endif // REPLACEMENT_H
@@ -0,0 +1,274 @@
+#include "replacement.h"
+#include "instrument.h"
+#include <algorithm>
+#include <cstring>
+
+// Intrusive lists: head is the most recent element, tail the least
+
+static void listPushFront(IndexList &l, std::vector<int> &prev,
+                          std::vector<int> &next, int i)
+{
+    prev[i] = -1;
+    next[i] = l.head;
+    if (l.head >= 0) {
+        prev[l.head] = i;
+    } else {
+        l.tail = i;
+    }
+    l.head = i;
+    l.size++;
+}
+
+static void listUnlink(IndexList &l, std::vector<int> &prev,
+                       std::vector<int> &next, int i)
+{
+    if (prev[i] >= 0) {
+        next[prev[i]] = next[i];
+    } else {
+        l.head = next[i];
+    }
+    if (next[i] >= 0) {
+        prev[next[i]] = prev[i];
+    } else {
+        l.tail = prev[i];
+    }
+    l.size--;
+}
+
+// Make room for a frame's list links the first time it is loaded
+static void growFrameLinks(ReplacementState &rs, int frame)
+{
+    if ((size_t)frame >= rs.framePrev.size()) {
+        rs.framePrev.resize(frame + 1, -1);
+        rs.frameNext.resize(frame + 1, -1);
+        rs.frameList.resize(frame + 1, 0);
+    }
+}
+
+// CLOCK (second chance): the frame access bits are the reference bits,
+// and the hand clears them a 64-frame word at a time until it finds a
+// frame that was not referenced since the hand last passed.
+
+static int clockChooseVictim(ReplacementState &rs, vaddr_t incomingVPN)
+{
+    (void)incomingVPN;
+    unsigned int frames = loadedFrameCount(rs);
+    if (frames == 0) return -1;
+
+    while (true) {
+        INSTRUMENT_COUNT(IC_VICTIM_SCAN_STEPS);
+        unsigned int w = rs.hand >> 6;
+        unsigned int bit = rs.hand & 63;
+        unsigned int inWord = frames - (w << 6) < 64 ? frames - (w << 6) : 64;
+        uint64_t valid = inWord == 64 ? ~0ull : (1ull << inWord) - 1;
+        uint64_t fromHand = valid & (~0ull << bit);
+        uint64_t unreferenced = ~rs.accessedBits[w] & fromHand;
+
+        if (unreferenced) {
+            unsigned int victimBit = (unsigned int)__builtin_ctzll(unreferenced);
+            // Pages the hand swept past lose their second chance
+            rs.accessedBits[w] &= ~(fromHand & ((1ull << victimBit) - 1));
+            rs.hand = (w << 6) + victimBit;
+            return (int)rs.hand;
+        }
+
+        rs.accessedBits[w] &= ~fromHand;
+        rs.hand = (w << 6) + inWord;
+        if (rs.hand >= frames) rs.hand = 0;
+    }
+}
+
+static void clockLoaded(ReplacementState &rs, int frame, bool replaced)
+{
+    // The hand moves past the frame it just filled
+    if (replaced) {
+        rs.hand = (unsigned int)frame + 1;
+        if (rs.hand >= loadedFrameCount(rs)) rs.hand = 0;
+    }
+}
+
+// FIFO: frames fill in order and a replacement takes over its victim's
+// frame, so load order is frame order and victims go round robin.
+
+static int fifoChooseVictim(ReplacementState &rs, vaddr_t incomingVPN)
+{
+    (void)incomingVPN;
+    if (loadedFrameCount(rs) == 0) return -1;
+    return (int)rs.hand;
+}
+
+static void fifoLoaded(ReplacementState &rs, int frame, bool replaced)
+{
+    (void)frame;
+    if (replaced) {
+        rs.hand = (rs.hand + 1) % loadedFrameCount(rs);
+    }
+}
+
+// LRU: frames on a recency list, moved to the front on every access
+
+static void lruAccess(ReplacementState &rs, int frame)
+{
+    IndexList &l = rs.recency[0];
+    if (l.head != frame) {
+        listUnlink(l, rs.framePrev, rs.frameNext, frame);
+        listPushFront(l, rs.framePrev, rs.frameNext, frame);
+    }
+}
+
+static int lruChooseVictim(ReplacementState &rs, vaddr_t incomingVPN)
+{
+    (void)incomingVPN;
+    return rs.recency[0].tail;
+}
+
+static void lruLoaded(ReplacementState &rs, int frame, bool replaced)
+{
+    growFrameLinks(rs, frame);
+    if (replaced) {
+        listUnlink(rs.recency[0], rs.framePrev, rs.frameNext, frame);
+    }
+    listPushFront(rs.recency[0], rs.framePrev, rs.frameNext, frame);
+}
+
+// ARC (Megiddo and Modha): T1 holds pages seen once recently, T2 pages
+// seen at least twice, and the ghost lists B1/B2 remember pages evicted
+// from each. A ghost hit in B1 grows the target size p of T1, one in B2
+// shrinks it, so the split between recency and frequency adapts.
+
+enum { ARC_T1 = 0, ARC_T2 = 1, ARC_B1 = 0, ARC_B2 = 1 };
+
+static void arcGhostRemove(ArcGhosts &g, int node)
+{
+    listUnlink(g.lists[g.list[node]], g.prev, g.next, node);
+    residentIndexErase(g.index, g.vpn[node]);
+    g.freeNodes.push_back(node);
+}
+
+static void arcGhostAdd(ArcGhosts &g, unsigned int list, vaddr_t fullVPN)
+{
+    int node;
+    if (!g.freeNodes.empty()) {
+        node = g.freeNodes.back();
+        g.freeNodes.pop_back();
+    } else {
+        node = (int)g.vpn.size();
+        g.vpn.push_back(0);
+        g.prev.push_back(-1);
+        g.next.push_back(-1);
+        g.list.push_back(0);
+    }
+    g.vpn[node] = fullVPN;
+    g.list[node] = (uint8_t)list;
+    listPushFront(g.lists[list], g.prev, g.next, node);
+    residentIndexInsert(g.index, fullVPN, node);
+}
+
+// ARC REPLACE: evict from T1 when it is over target, else from T2, and
+// remember the page in the matching ghost list
+static int arcReplace(ReplacementState &rs, bool ghostInB2)
+{
+    unsigned int t1 = rs.recency[ARC_T1].size;
+    bool fromT1 = t1 > 0 &&
+                  (t1 > rs.arcTarget || (ghostInB2 && t1 == rs.arcTarget));
+    if (rs.recency[ARC_T2].size == 0) fromT1 = true;
+
+    int victim = rs.recency[fromT1 ? ARC_T1 : ARC_T2].tail;
+    arcGhostAdd(rs.arcGhosts, fromT1 ? ARC_B1 : ARC_B2, rs.frameVPN[victim]);
+    return victim;
+}
+
+static void arcAccess(ReplacementState &rs, int frame)
+{
+    // The access that loaded the page is not a reuse
+    if (rs.lastAccessTime[frame] == rs.currentTime) return;
+
+    // Any reuse makes the page frequent
+    listUnlink(rs.recency[rs.frameList[frame]], rs.framePrev, rs.frameNext, frame);
+    rs.frameList[frame] = ARC_T2;
+    listPushFront(rs.recency[ARC_T2], rs.framePrev, rs.frameNext, frame);
+}
+
+static int arcChooseVictim(ReplacementState &rs, vaddr_t incomingVPN)
+{
+    ArcGhosts &g = rs.arcGhosts;
+    unsigned int c = loadedFrameCount(rs);
+    if (c == 0) return -1;
+
+    unsigned int b1 = g.lists[ARC_B1].size;
+    unsigned int b2 = g.lists[ARC_B2].size;
+    int node = residentIndexFind(g.index, incomingVPN);
+
+    if (node >= 0) {
+        // Ghost hit: adapt p and bring the page back as frequent
+        bool inB2 = g.list[node] == ARC_B2;
+        if (!inB2) {
+            unsigned int delta = std::max(b2 / b1, 1u);
+            rs.arcTarget = std::min(rs.arcTarget + delta, c);
+        } else {
+            unsigned int delta = std::max(b1 / b2, 1u);
+            rs.arcTarget = rs.arcTarget > delta ? rs.arcTarget - delta : 0;
+        }
+        int victim = arcReplace(rs, inB2);
+        arcGhostRemove(g, node);
+        rs.arcToFrequent = true;
+        return victim;
+    }
+
+    rs.arcToFrequent = false;
+    unsigned int t1 = rs.recency[ARC_T1].size;
+    if (t1 + b1 >= c) {
+        if (t1 < c) {
+            arcGhostRemove(g, g.lists[ARC_B1].tail);
+            return arcReplace(rs, false);
+        }
+        // B1 is empty and T1 fills the cache: drop T1's LRU outright
+        return rs.recency[ARC_T1].tail;
+    }
+    if (t1 + rs.recency[ARC_T2].size + b1 + b2 >= 2 * c && b2 > 0) {
+        arcGhostRemove(g, g.lists[ARC_B2].tail);
+    }
+    return arcReplace(rs, false);
+}
+
+static void arcLoaded(ReplacementState &rs, int frame, bool replaced)
+{
+    growFrameLinks(rs, frame);
+    if (replaced) {
+        listUnlink(rs.recency[rs.frameList[frame]], rs.framePrev, rs.frameNext, frame);
+    }
+    unsigned int list = rs.arcToFrequent ? ARC_T2 : ARC_T1;
+    rs.arcToFrequent = false;
+    rs.frameList[frame] = (uint8_t)list;
+    listPushFront(rs.recency[list], rs.framePrev, rs.frameNext, frame);
+}
+
+const ReplacementPolicy clockPolicy = {
+    "clock", nullptr, nullptr, clockChooseVictim, clockLoaded
+};
+
+const ReplacementPolicy lruPolicy = {
+    "lru", nullptr, lruAccess, lruChooseVictim, lruLoaded
+};
+
+const ReplacementPolicy fifoPolicy = {
+    "fifo", nullptr, nullptr, fifoChooseVictim, fifoLoaded
+};
+
+const ReplacementPolicy arcPolicy = {
+    "arc", nullptr, arcAccess, arcChooseVictim, arcLoaded
+};
+
+// Look up a built-in engine by name
+const ReplacementPolicy *findReplacementPolicy(const char *name)
+{
+    static const ReplacementPolicy *const policies[] = {
+        &agingPolicy, &clockPolicy, &lruPolicy, &fifoPolicy, &arcPolicy
+    };
+    for (const ReplacementPolicy *p : policies) {
+        if (strcmp(p->name, name) == 0) {
+            return p;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,286 @@
+#include "shard.h"
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "instrument.h"
+#include "simulator.h"
+
+// Forward declarations for C functions
+extern "C" {
+    void log_summary(unsigned int page_size,
+                     unsigned int numOfPageReplaces,
+                     unsigned int pageTableHits,
+                     unsigned int numOfAddresses,
+                     unsigned int numOfFramesAllocated,
+                     unsigned long int pgtableEntries);
+    void log_tlb_summary(unsigned int tlbEntries,
+                         unsigned int tlbWays,
+                         unsigned long int tlbHits,
+                         unsigned long int tlbMisses);
+    void log_proc_summary(unsigned int proc,
+                          unsigned int numOfAddresses,
+                          unsigned int pageTableHits,
+                          unsigned int evictionsCaused,
+                          unsigned int pagesEvicted,
+                          unsigned long int pgtableEntries);
+}
+
+// Records read from the trace per batch
+static const size_t SHARD_BATCH_RECORDS = 65536;
+// Records of one shard handed to its worker at a time
+static const size_t SHARD_CHUNK_RECORDS = 4096;
+// Chunks queued per worker before the reader waits
+static const size_t SHARD_QUEUE_CHUNKS = 16;
+
+// Consecutive records of one shard, in trace order
+struct ShardChunk {
+    unsigned int shard;
+    size_t count;
+    std::vector<p2AddrTr> records;
+};
+
+// Single-producer/single-consumer ring from the reading thread to one
+// worker, run like the trace prefetcher's: the reader fills slots in
+// [head, tail + size) and publishes by advancing head; the worker
+// releases the slot it simulated by advancing tail.
+struct ShardQueue {
+    std::vector<ShardChunk> ring;
+
+    alignas(64) std::atomic<size_t> head;  // chunks published
+    alignas(64) std::atomic<size_t> tail;  // chunks released
+    std::atomic<bool> done;                // no more chunks will come
+
+    std::thread worker;
+};
+
+// Shards are owned by worker shard % workers and only touched by it, so
+// sims needs no locks; the reader reads it after the workers have joined.
+struct ShardPool {
+    const ShardConfig *config;
+    unsigned int offsetBits;
+    std::vector<Simulator *> sims;          // [shard], nullptr until first seen
+    std::unique_ptr<ShardQueue[]> queues;   // [worker]
+    unsigned int workers;
+};
+
+// Parse a -S argument
+bool parseShardSpec(const char *spec, ShardConfig &config)
+{
+    if (strcmp(spec, "proc") == 0) {
+        config.mode = SHARD_PROC;
+        config.shards = 256;
+        return true;
+    }
+    if (strncmp(spec, "vpn:", 4) == 0) {
+        char *end;
+        unsigned long shards = strtoul(spec + 4, &end, 10);
+        if (*end != '\0' || shards < 1 || shards > 65536) return false;
+        config.mode = SHARD_VPN;
+        config.shards = (unsigned int) shards;
+        return true;
+    }
+    return false;
+}
+
+// Fibonacci hash of the VPN, so strided pages still spread over shards
+static inline unsigned int vpnShard(vaddr_t va, unsigned int offsetBits,
+                                    unsigned int shards)
+{
+    uint32_t h = foldVPN(va >> offsetBits) * 0x9E3779B1u;
+    return (h >> 16) % shards;
+}
+
+// Frames given to one shard
+static unsigned int shardFrames(const ShardConfig &c, unsigned int shard)
+{
+    if (c.mode == SHARD_PROC || c.maxFrames == UINT_MAX) return c.maxFrames;
+    return c.maxFrames / c.shards + (shard < c.maxFrames % c.shards ? 1 : 0);
+}
+
+static void shardWorker(ShardPool *pool, ShardQueue *q)
+{
+    const ShardConfig &c = *pool->config;
+    size_t slots = q->ring.size();
+    size_t taken = 0;
+
+    while (1) {
+        if (q->head.load(std::memory_order_acquire) == taken) {
+            // done is set after the last publish, so recheck head after it
+            if (q->done.load(std::memory_order_acquire) &&
+                q->head.load(std::memory_order_acquire) == taken)
+            {
+                return;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+
+        ShardChunk &chunk = q->ring[taken % slots];
+        Simulator *&sim = pool->sims[chunk.shard];
+        if (!sim) {
+            sim = createSimulator(c.levelCount, c.levelBits,
+                                  shardFrames(c, chunk.shard), c.bitInterval,
+                                  c.policy, c.tlbEntries, c.tlbWays);
+        }
+        simulateBatch(*sim, chunk.records.data(), chunk.count);
+
+        taken++;
+        q->tail.store(taken, std::memory_order_release);
+    }
+}
+
+// Hand a staged chunk to its worker, waiting while the queue is full. The
+// chunk's buffer is swapped with the slot's, so no records are copied.
+static void pushChunk(ShardQueue &q, ShardChunk &staged)
+{
+    size_t slots = q.ring.size();
+    size_t h = q.head.load(std::memory_order_relaxed);
+    while (h - q.tail.load(std::memory_order_acquire) == slots) {
+        std::this_thread::yield();
+    }
+
+    ShardChunk &slot = q.ring[h % slots];
+    slot.shard = staged.shard;
+    slot.count = staged.count;
+    slot.records.swap(staged.records);
+    staged.count = 0;
+
+    q.head.store(h + 1, std::memory_order_release);
+}
+
+// Print the merged summary, then one line per process in SHARD_PROC mode
+static void logShardedSummary(const ShardPool &pool)
+{
+    const ShardConfig &c = *pool.config;
+    Stats total = {0, 0, 0, 0, 0};
+    unsigned int frames = 0;
+    unsigned long entries = 0;
+    unsigned long tlbHits = 0;
+    unsigned long tlbMisses = 0;
+    unsigned int tlbWays = c.tlbWays;
+
+    for (const Simulator *sim : pool.sims) {
+        if (!sim) continue;
+        total.addressesProcessed += sim->stats.addressesProcessed;
+        total.hits += sim->stats.hits;
+        total.evictions += sim->stats.evictions;
+        frames += sim->rs.nextFreeFrame;
+        entries += simulatorPageTableEntries(*sim);
+        if (sim->tlb) {
+            tlbHits += sim->tlb->hits;
+            tlbMisses += sim->tlb->misses;
+            tlbWays = sim->tlb->ways;
+        }
+    }
+
+    log_summary(1u << pool.offsetBits, total.evictions, total.hits,
+                total.addressesProcessed, frames, entries);
+    if (c.tlbEntries) {
+        log_tlb_summary(c.tlbEntries, tlbWays, tlbHits, tlbMisses);
+    }
+
+    if (c.mode != SHARD_PROC) return;
+    for (unsigned int proc = 0; proc < pool.sims.size(); proc++) {
+        const Simulator *sim = pool.sims[proc];
+        if (!sim) continue;
+        // Frames are private, so every replacement is of the process's own page
+        log_proc_summary(proc, sim->stats.addressesProcessed, sim->stats.hits,
+                         sim->stats.evictions, sim->stats.evictions,
+                         simulatorPageTableEntries(*sim));
+    }
+}
+
+// Run sharded
+void runSharded(TraceReader *reader,
+                TracePrefetcher *prefetch,
+                const ShardConfig &config,
+                unsigned int threads,
+                unsigned int limitN)
+{
+    ShardPool pool;
+    pool.config = &config;
+    unsigned int sumBits = 0;
+    for (unsigned int i = 0; i < config.levelCount; i++) {
+        sumBits += config.levelBits[i];
+    }
+    pool.offsetBits = VADDR_BITS - sumBits;
+    pool.sims.assign(config.shards, nullptr);
+
+    // More workers than shards would sit idle
+    pool.workers = threads < config.shards ? threads : config.shards;
+    pool.queues.reset(new ShardQueue[pool.workers]);
+    for (unsigned int w = 0; w < pool.workers; w++) {
+        ShardQueue &q = pool.queues[w];
+        q.ring.resize(SHARD_QUEUE_CHUNKS);
+        for (ShardChunk &chunk : q.ring) {
+            chunk.records.resize(SHARD_CHUNK_RECORDS);
+            chunk.count = 0;
+        }
+        q.head.store(0);
+        q.tail.store(0);
+        q.done.store(false);
+        q.worker = std::thread(shardWorker, &pool, &q);
+    }
+
+    // Records are staged per shard; buffers are sized on first use
+    std::vector<ShardChunk> staged(config.shards);
+    for (unsigned int s = 0; s < config.shards; s++) {
+        staged[s].shard = s;
+        staged[s].count = 0;
+    }
+
+    unsigned long processed = 0;
+    while (limitN == 0 || processed < limitN) {
+        size_t want = SHARD_BATCH_RECORDS;
+        if (prefetch) want = SIZE_MAX;
+        if (limitN != 0 && limitN - processed < want) {
+            want = limitN - processed;
+        }
+
+        const p2AddrTr *batch;
+        INSTRUMENT_TIMER_START(readStart);
+        size_t batchCount = nextTraceBatch(reader, prefetch, want, &batch);
+        INSTRUMENT_TIMER_STOP(IT_TRACE_READ, readStart);
+        if (batchCount == 0) break; // EOF
+        processed += batchCount;
+
+        for (size_t r = 0; r < batchCount; r++) {
+            unsigned int shard = config.mode == SHARD_PROC
+                ? batch[r].proc
+                : vpnShard(batch[r].addr, pool.offsetBits, config.shards);
+
+            ShardChunk &chunk = staged[shard];
+            if (chunk.records.empty()) {
+                chunk.records.resize(SHARD_CHUNK_RECORDS);
+            }
+            chunk.records[chunk.count++] = batch[r];
+            if (chunk.count == SHARD_CHUNK_RECORDS) {
+                pushChunk(pool.queues[shard % pool.workers], chunk);
+            }
+        }
+    }
+
+    // Flush partial chunks and let the workers drain their queues
+    for (ShardChunk &chunk : staged) {
+        if (chunk.count > 0) {
+            pushChunk(pool.queues[chunk.shard % pool.workers], chunk);
+        }
+    }
+    for (unsigned int w = 0; w < pool.workers; w++) {
+        pool.queues[w].done.store(true, std::memory_order_release);
+    }
+    for (unsigned int w = 0; w < pool.workers; w++) {
+        pool.queues[w].worker.join();
+    }
+
+    logShardedSummary(pool);
+    for (Simulator *sim : pool.sims) {
+        destroySimulator(sim);
+    }
+}
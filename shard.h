@@ -0,0 +1,42 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "replacement.h"
+#include "trace_prefetch.h"
+#include "vaddr_tracereader.h"
+
+// How sharded mode splits the trace
+enum ShardMode {
+    SHARD_PROC,     // one shard per trace proc value, each with its own frames
+    SHARD_VPN       // a fixed number of shards by VPN hash, sharing the frames
+};
+
+// Settings every shard's simulator is built with
+struct ShardConfig {
+    ShardMode mode;
+    unsigned int shards;                // SHARD_VPN only
+    unsigned int levelCount;
+    const unsigned int *levelBits;
+    unsigned int maxFrames;             // UINT_MAX means infinite
+    unsigned int bitInterval;
+    const ReplacementPolicy *policy;    // nullptr means aging
+    unsigned int tlbEntries;            // 0 means no TLB
+    unsigned int tlbWays;
+};
+
+// Parse "proc" or "vpn:<shards>" into config. Returns false if malformed.
+bool parseShardSpec(const char *spec, ShardConfig &config);
+
+// Simulate every shard over a single pass of the trace, each on the worker
+// thread that owns it, then print one merged summary. In SHARD_PROC mode
+// every process gets maxFrames frames of its own and a line of its own
+// after the summary; in SHARD_VPN mode the frames are split evenly between
+// the shards. Results do not depend on the thread count. limitN == 0 reads
+// the whole trace; prefetch may be nullptr.
+void runSharded(TraceReader *reader,
+                TracePrefetcher *prefetch,
+                const ShardConfig &config,
+                unsigned int threads,
+                unsigned int limitN);
+
+#endif // SHARD_H
@@ -0,0 +1,453 @@
+#include "simulator.h"
+#include "instrument.h"
+#include "pagetable_walk.h"
+#include <cstdio>
+#include <cstdlib>
+
+// Forward declarations for C functions
+extern "C" {
+    void log_summary(unsigned int page_size,
+                     unsigned int numOfPageReplaces,
+                     unsigned int pageTableHits,
+                     unsigned int numOfAddresses,
+                     unsigned int numOfFramesAllocated,
+                     unsigned long int pgtableEntries);
+    void log_tlb_summary(unsigned int tlbEntries,
+                         unsigned int tlbWays,
+                         unsigned long int tlbHits,
+                         unsigned long int tlbMisses);
+    void log_writeback_summary(unsigned int writes,
+                               unsigned int dirtyReplaces,
+                               unsigned int cleanReplaces,
+                               unsigned long long int writebackBytes,
+                               double faultMillis,
+                               double writebackMillis);
+    void log_huge_page_summary(unsigned long int promotions,
+                               unsigned long int demotions,
+                               unsigned long int tableBytes,
+                               unsigned int tlbEntries,
+                               unsigned long int tlbLargeHits,
+                               unsigned long int tlbReachPages);
+    void log_proc_summary(unsigned int proc,
+                          unsigned int numOfAddresses,
+                          unsigned int pageTableHits,
+                          unsigned int evictionsCaused,
+                          unsigned int pagesEvicted,
+                          unsigned long int pgtableEntries);
+    void log_page_prefetch_summary(const char *policy,
+                                   unsigned int depth,
+                                   unsigned long int issued,
+                                   unsigned long int useful,
+                                   unsigned long int unused,
+                                   unsigned long int evictions,
+                                   unsigned int misses);
+}
+
+// Create a simulator
+Simulator *createSimulator(unsigned int levelCount,
+                           const unsigned int levelBits[],
+                           unsigned int maxFrames,
+                           unsigned int bitInterval,
+                           const ReplacementPolicy *policy,
+                           unsigned int tlbEntries,
+                           unsigned int tlbWays,
+                           bool perProcess,
+                           PageTableBackend backend,
+                           unsigned int addressBits)
+{
+    Tlb *tlb = nullptr;
+    if (tlbEntries > 0) {
+        tlb = createTlb(tlbEntries, tlbWays);
+        if (!tlb) {
+            return nullptr;
+        }
+    }
+
+    Simulator *sim = new Simulator;
+    sim->pt = createPageTable(levelCount, levelBits, backend, addressBits);
+    sim->pt->walk = findPageTableWalk(levelCount, levelBits, addressBits);
+    initReplacementState(sim->rs, maxFrames, bitInterval, policy);
+    sim->tlb = tlb;
+    sim->rs.tlb = tlb;
+    sim->stats.addressesProcessed = 0;
+    sim->stats.hits = 0;
+    sim->stats.misses = 0;
+    sim->stats.evictions = 0;
+    sim->stats.writes = 0;
+    sim->procs = nullptr;
+    sim->writeBack = WriteBackModel{false, 0, 0};
+    sim->prefetch = nullptr;
+
+    if (perProcess) {
+        ProcessTables *pr = new ProcessTables;
+        for (int &slot : pr->slotOf) slot = -1;
+        pr->vpnBits = addressBits - sim->pt->offsetBits;
+        pr->maxSlots = pr->vpnBits > VADDR_BITS - 8 ? 1u << (VADDR_BITS - pr->vpnBits) : 256;
+        // Never reallocated, so the replacement state can point into it
+        pr->tables.reserve(pr->maxSlots);
+        sim->rs.tables = pr->tables.data();
+        sim->rs.tableShift = pr->vpnBits;
+        sim->procs = pr;
+    }
+    return sim;
+}
+
+// Give proc the next slot and a page table (the simulator's own for the
+// first process seen)
+static int addProcess(Simulator &sim, unsigned int proc)
+{
+    ProcessTables &pr = *sim.procs;
+    if (pr.tables.size() == pr.maxSlots) {
+        fprintf(stderr, "Too many processes for %u page table bits, at most %u fit\n",
+                pr.vpnBits, pr.maxSlots);
+        exit(1);
+    }
+
+    PageTable *pt = sim.pt;
+    if (!pr.tables.empty()) {
+        pt = createPageTable(sim.pt->levelCount, sim.pt->levelBits,
+                             pageTableBackend(sim.pt), sim.pt->addressBits);
+        pt->walk = sim.pt->walk;
+        pt->hugePages = sim.pt->hugePages;
+    }
+    int slot = (int)pr.tables.size();
+    pr.tables.push_back(pt);
+    pr.procOf.push_back(proc);
+    pr.stats.push_back(ProcStats{0, 0, 0, 0, 0});
+    pr.slotOf[proc] = slot;
+    return slot;
+}
+
+// Destroy a simulator
+void destroySimulator(Simulator *sim)
+{
+    if (!sim) return;
+    destroyTlb(sim->tlb);
+    if (sim->procs) {
+        // tables[0], if any, is sim->pt
+        for (size_t i = 1; i < sim->procs->tables.size(); i++) {
+            destroyPageTable(sim->procs->tables[i]);
+        }
+        delete sim->procs;
+    }
+    destroyPagePrefetcher(sim->prefetch);
+    destroyPageTable(sim->pt);
+    delete sim;
+}
+
+// Addresses whose walks simulateBatch runs together
+static const size_t SIM_WALK_WINDOW = 32;
+
+// Bring in the pages the prefetch policy proposes after a trigger of
+// proc at page vpn of pt, skipping those already resident. Replacements
+// they cause count as the summary's page replacements too. Returns how
+// many pages were loaded.
+static unsigned int prefetchPages(Simulator &sim, PageTable *pt, vaddr_t tag,
+                                  vaddr_t vpn, unsigned int proc)
+{
+    PagePrefetcher &pf = *sim.prefetch;
+    vaddr_t pages[PREFETCH_MAX_DEPTH];
+    unsigned int n = predictPrefetches(pf, proc, tag, vpn, pages);
+
+    unsigned int loaded = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        if (pages[i] > pt->vpnMask || pages[i] == vpn) continue;
+
+        bool didFault, didEvict;
+        vaddr_t evictedVPN;
+        uint16_t evictedAgeBits;
+        int pfn = ensureResidentPage(pt, sim.rs, pages[i] << pt->offsetBits,
+                                     tag | pages[i], didFault, didEvict,
+                                     evictedVPN, evictedAgeBits);
+        if (!didFault) continue;
+
+        loaded++;
+        pf.stats.issued++;
+        notePrefetchFrameLoaded(pf, pfn, true);
+        if (didEvict) {
+            sim.stats.evictions++;
+            pf.stats.evictions++;
+            if (sim.procs) {
+                sim.procs->stats[evictedVPN >> sim.procs->vpnBits].pagesEvicted++;
+            }
+        }
+    }
+    return loaded;
+}
+
+// Simulate one access to pt, whose pages are keyed tag | VPN in the
+// replacement state and TLB (the evicted VPN is returned with its tag).
+// When walked is set, m is the page table walk for va done beforehand
+// (nullptr for a page table miss) and is used instead of walking again on
+// a TLB miss; it must still be current. proc is the trace proc, whose
+// stream the prefetch policy learns from.
+static void simulateWalkedAccess(Simulator &sim, PageTable *pt,
+                                 vaddr_t tag, vaddr_t va, unsigned int proc,
+                                 bool write, Map *m, bool walked,
+                                 AccessResult &res)
+{
+    ReplacementState &rs = sim.rs;
+    Tlb *tlb = sim.tlb;
+
+    sim.stats.addressesProcessed++;
+
+    // Tick time / maybe aging update
+    tickReplacementClock(rs);
+
+    bool didFault = false;
+    res.didEvict = false;
+    res.evictedVPN = 0;
+    res.evictedAgeBits = 0;
+    res.prefetched = 0;
+
+    res.fullVPN = getFullVPN(pt, va);
+    vaddr_t fullVPN = tag | res.fullVPN;
+
+    // Look up in the TLB, then walk the page table on a TLB miss
+    int tlbPfn = tlb ? tlbLookup(tlb, fullVPN) : -1;
+    if (tlbPfn < 0 && !walked) {
+        INSTRUMENT_TIMER_START(walkStart);
+        m = searchMappedPfn(pt, va);
+        INSTRUMENT_TIMER_STOP(IT_WALK, walkStart);
+    }
+
+    res.hit = (tlbPfn >= 0 || m != nullptr);
+
+    int pfn;
+    if (tlbPfn >= 0) {
+        // TLB hit, which implies a page table hit
+        pfn = tlbPfn;
+        sim.stats.hits++;
+    } else if (res.hit) {
+        // Page hit
+        pfn = mapFrameFor(*m, res.fullVPN);
+        sim.stats.hits++;
+    } else {
+        // Miss / demand paging
+        sim.stats.misses++;
+
+        // EnsureResidentPage also updates pageTable for us
+        INSTRUMENT_TIMER_START(replaceStart);
+        pfn = ensureResidentPage(pt,
+                                 rs,
+                                 va,
+                                 fullVPN,
+                                 didFault,
+                                 res.didEvict,
+                                 res.evictedVPN,
+                                 res.evictedAgeBits);
+        INSTRUMENT_TIMER_STOP(IT_REPLACEMENT, replaceStart);
+
+        if (res.didEvict) {
+            sim.stats.evictions++;
+        }
+    }
+
+    // Refill the TLB after a walk, with the whole page a large mapping covers
+    if (tlb && tlbPfn < 0) {
+        tlbInsert(tlb, fullVPN, pfn, m ? mapSpanBits(*m) : 0);
+    }
+
+    // Track access in replacement state
+    noteFrameAccess(rs, fullVPN, pfn);
+    if (write) {
+        sim.stats.writes++;
+        noteFrameWrite(rs, pfn);
+    }
+
+    res.pfn = pfn;
+
+    // A fault, or the first access to a prefetched page, runs the policy
+    if (sim.prefetch) {
+        bool trigger = !res.hit;
+        if (trigger) {
+            notePrefetchFrameLoaded(*sim.prefetch, pfn, false);
+        } else if (framePrefetched(*sim.prefetch, pfn)) {
+            notePrefetchFrameUsed(*sim.prefetch, pfn);
+            trigger = true;
+        }
+        if (trigger) {
+            INSTRUMENT_TIMER_START(prefetchStart);
+            res.prefetched = prefetchPages(sim, pt, tag, res.fullVPN, proc);
+            INSTRUMENT_TIMER_STOP(IT_REPLACEMENT, prefetchStart);
+        }
+    }
+}
+
+// Simulate one access of proc in per-process mode
+static void simulateProcessAccess(Simulator &sim, vaddr_t va,
+                                  unsigned int proc, bool write,
+                                  AccessResult &res)
+{
+    ProcessTables &pr = *sim.procs;
+    int slot = pr.slotOf[proc & 0xFF];
+    if (slot < 0) {
+        slot = addProcess(sim, proc & 0xFF);
+    }
+
+    simulateWalkedAccess(sim, pr.tables[slot], (vaddr_t)slot << pr.vpnBits,
+                         va, proc, write, nullptr, false, res);
+
+    ProcStats &ps = pr.stats[slot];
+    ps.addresses++;
+    if (res.hit) {
+        ps.hits++;
+    } else {
+        ps.misses++;
+    }
+    if (res.didEvict) {
+        ps.evictionsCaused++;
+        pr.stats[res.evictedVPN >> pr.vpnBits].pagesEvicted++;
+        res.evictedVPN &= ((vaddr_t)1 << pr.vpnBits) - 1u;
+    }
+}
+
+// Simulate one access
+void simulateAccess(Simulator &sim, vaddr_t va, AccessResult &res,
+                    unsigned int proc, bool write)
+{
+    if (sim.procs) {
+        simulateProcessAccess(sim, va, proc, write, res);
+        return;
+    }
+    simulateWalkedAccess(sim, sim.pt, 0, va, proc, write, nullptr, false, res);
+}
+
+// Simulate a batch of trace records, walking a window of addresses at a
+// time through searchMappedPfnBatch. A fault in the window can map or
+// unmap pages after the walks ran, but a leaf entry never moves: a found
+// entry is rechecked in place, and a miss is walked again only if the
+// table changed since (by a fault or a prefetch).
+void simulateBatch(Simulator &sim, const p2AddrTr *batch, size_t count)
+{
+    AccessResult res;
+    vaddr_t vas[SIM_WALK_WINDOW];
+    Map *maps[SIM_WALK_WINDOW];
+
+    // Neighbouring records may belong to different tables; walk singly
+    if (sim.procs) {
+        for (size_t r = 0; r < count; r++) {
+            simulateProcessAccess(sim, batch[r].addr, batch[r].proc,
+                                  batch[r].reqtype == MEMWRITE, res);
+        }
+        return;
+    }
+
+    for (size_t r = 0; r < count; r += SIM_WALK_WINDOW) {
+        size_t n = count - r < SIM_WALK_WINDOW ? count - r : SIM_WALK_WINDOW;
+        for (size_t i = 0; i < n; i++) {
+            vas[i] = batch[r + i].addr;
+        }
+        INSTRUMENT_TIMER_START(walkStart);
+        searchMappedPfnBatch(sim.pt, vas, n, maps);
+        INSTRUMENT_TIMER_STOP(IT_WALK, walkStart);
+
+        bool changed = false;
+        for (size_t i = 0; i < n; i++) {
+            Map *m = maps[i];
+            bool walked = true;
+            if (changed && mapsMayMove(sim.pt)) {
+                m = nullptr;        // may now belong to another page
+                walked = false;
+            } else if (m && !mapIsValid(*m)) {
+                m = nullptr;        // evicted earlier in the window
+            } else if (!m && changed) {
+                walked = false;     // may have been mapped since
+            }
+            simulateWalkedAccess(sim, sim.pt, 0, vas[i], batch[r + i].proc,
+                                 batch[r + i].reqtype == MEMWRITE,
+                                 m, walked, res);
+            changed = changed || !res.hit || res.prefetched;
+        }
+    }
+}
+
+// Number of page table entries
+unsigned long simulatorPageTableEntries(const Simulator &sim)
+{
+    if (!sim.procs || sim.procs->tables.empty()) return pageTableEntries(sim.pt);
+
+    unsigned long entries = 0;
+    for (const PageTable *pt : sim.procs->tables) {
+        entries += pageTableEntries(pt);
+    }
+    return entries;
+}
+
+// Bytes held by the page tables
+size_t simulatorPageTableBytes(const Simulator &sim)
+{
+    if (!sim.procs || sim.procs->tables.empty()) return pageTableBytes(sim.pt);
+
+    size_t bytes = 0;
+    for (const PageTable *pt : sim.procs->tables) {
+        bytes += pageTableBytes(pt);
+    }
+    return bytes;
+}
+
+// Print the summary
+void logSimulatorSummary(const Simulator &sim)
+{
+    unsigned long entries = simulatorPageTableEntries(sim);
+
+    // Calculate page size from offset bits
+    unsigned int pageSize = 1u << sim.pt->offsetBits;
+
+    log_summary(pageSize, sim.stats.evictions, sim.stats.hits,
+                sim.stats.addressesProcessed, sim.rs.nextFreeFrame,
+                entries);
+
+    if (sim.tlb) {
+        log_tlb_summary(sim.tlb->entryCount, sim.tlb->ways,
+                        sim.tlb->hits, sim.tlb->misses);
+    }
+
+    // Promotions and what they saved in table memory and TLB reach
+    if (sim.pt->hugePages) {
+        unsigned long promotions = sim.pt->promotions;
+        unsigned long demotions = sim.pt->demotions;
+        if (sim.procs) {
+            promotions = demotions = 0;
+            for (const PageTable *pt : sim.procs->tables) {
+                promotions += pt->promotions;
+                demotions += pt->demotions;
+            }
+        }
+        log_huge_page_summary(promotions, demotions,
+                              (unsigned long)simulatorPageTableBytes(sim),
+                              sim.tlb ? sim.tlb->entryCount : 0,
+                              sim.tlb ? sim.tlb->largeHits : 0,
+                              sim.tlb ? tlbReach(sim.tlb) : 0);
+    }
+
+    // Write-back volume and the memory stall it adds to the faults
+    if (sim.writeBack.enabled) {
+        unsigned int dirty = sim.rs.dirtyEvictions;
+        log_writeback_summary(sim.stats.writes, dirty,
+                              sim.stats.evictions - dirty,
+                              (unsigned long long)dirty * pageSize,
+                              sim.stats.misses * sim.writeBack.faultMicros / 1000.0,
+                              dirty * sim.writeBack.writebackMicros / 1000.0);
+    }
+
+    // How much of the fault stream prefetching took off the faults
+    if (sim.prefetch) {
+        const PagePrefetcher &pf = *sim.prefetch;
+        log_page_prefetch_summary(pf.policy->name, pf.depth, pf.stats.issued,
+                                  pf.stats.useful, pf.stats.unused,
+                                  pf.stats.evictions, sim.stats.misses);
+    }
+
+    // Per-process breakdown, in proc order
+    if (sim.procs) {
+        const ProcessTables &pr = *sim.procs;
+        for (unsigned int proc = 0; proc < 256; proc++) {
+            int slot = pr.slotOf[proc];
+            if (slot < 0) continue;
+            const ProcStats &ps = pr.stats[slot];
+            log_proc_summary(proc, ps.addresses, ps.hits, ps.evictionsCaused,
+                             ps.pagesEvicted, pageTableEntries(pr.tables[slot]));
+        }
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "page_prefetch.h"
+#include "pagetable.h"
+#include "replacement.h"
+#include "tlb.h"
+#include "vaddr_tracereader.h"
+
+// Simulation statistics
+struct Stats {
+    unsigned int addressesProcessed;
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int evictions;
+    unsigned int writes;            // MEMWRITE accesses
+};
+
+// Write-back cost model for the summary's memory stall estimate
+struct WriteBackModel {
+    bool enabled;                   // print write statistics
+    double faultMicros;             // reading a page in on a miss
+    double writebackMicros;         // writing a dirty victim back
+};
+
+// Outcome of one simulated access, for per-address logging
+struct AccessResult {
+    vaddr_t fullVPN;
+    int pfn;
+    bool hit;
+    bool didEvict;
+    vaddr_t evictedVPN;
+    uint16_t evictedAgeBits;
+    unsigned int prefetched;        // pages prefetched after the access
+};
+
+// Per-process statistics, in per-process mode
+struct ProcStats {
+    unsigned int addresses;
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int evictionsCaused;   // faults of this process that evicted a page
+    unsigned int pagesEvicted;      // pages of this process evicted by any fault
+};
+
+// Per-process mode: one page table per trace proc value, all sharing the
+// simulator's frames, replacement state and TLB. A process is given the
+// next free slot when first seen; pages are keyed (slot << vpnBits) | VPN
+// in the replacement state and TLB, so at most maxSlots processes fit.
+struct ProcessTables {
+    int slotOf[256];                // proc -> slot, -1 until first seen
+    unsigned int maxSlots;
+    unsigned int vpnBits;
+    std::vector<PageTable *> tables; // [slot], tables[0] is the simulator's pt
+    std::vector<unsigned int> procOf; // [slot]
+    std::vector<ProcStats> stats;   // [slot]
+};
+
+// One simulated machine: a page table, its replacement state and an
+// optional TLB. Instances share nothing, so several can run side by side.
+struct Simulator {
+    PageTable *pt;
+    ReplacementState rs;
+    Tlb *tlb;               // nullptr when no TLB is modelled
+    Stats stats;
+    ProcessTables *procs;   // nullptr unless per-process
+    WriteBackModel writeBack;
+    PagePrefetcher *prefetch; // nullptr unless prefetching; destroyed with the simulator
+};
+
+// Create a simulator; a nullptr policy means aging and tlbEntries == 0
+// means no TLB. Returns nullptr if the TLB configuration is invalid.
+// With perProcess, every trace proc value gets its own page table, each
+// organised as backend says and translating addressBits-wide addresses.
+Simulator *createSimulator(unsigned int levelCount,
+                           const unsigned int levelBits[],
+                           unsigned int maxFrames,
+                           unsigned int bitInterval,
+                           const ReplacementPolicy *policy,
+                           unsigned int tlbEntries,
+                           unsigned int tlbWays,
+                           bool perProcess = false,
+                           PageTableBackend backend = PT_RADIX,
+                           unsigned int addressBits = VADDR_BITS);
+
+// Destroy a simulator
+void destroySimulator(Simulator *sim);
+
+// Simulate one access: TLB, page walk, demand paging and replacement.
+// proc selects the page table in per-process mode and is ignored otherwise;
+// write marks the page dirty.
+void simulateAccess(Simulator &sim, vaddr_t va, AccessResult &res,
+                    unsigned int proc = 0, bool write = false);
+
+// Simulate a batch of trace records without per-address results; MEMWRITE
+// records mark their page dirty
+void simulateBatch(Simulator &sim, const p2AddrTr *batch, size_t count);
+
+// Number of page table entries, as reported by the summary
+unsigned long simulatorPageTableEntries(const Simulator &sim);
+
+// Bytes held by the page tables
+size_t simulatorPageTableBytes(const Simulator &sim);
+
+// Print the summary (and TLB, write and prefetch statistics, if modelled)
+void logSimulatorSummary(const Simulator &sim);
+
+#endif // SIMULATOR_H
@@ -0,0 +1,68 @@
+#include "snapshot.h"
+#include <chrono>
+
+static double nowSeconds()
+{
+    using namespace std::chrono;
+    return duration_cast<duration<double>>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+void initSnapshotReporter(SnapshotReporter &sr, FILE *out,
+                          unsigned long everyAddresses, double everySeconds,
+                          const Simulator &sim)
+{
+    sr.out = out;
+    sr.everyAddresses = everyAddresses;
+    sr.everySeconds = everySeconds;
+    // Intervals count from the start of the trace, also when resumed
+    sr.untilNext = everyAddresses ?
+        everyAddresses - sim.stats.addressesProcessed % everyAddresses : 0;
+    sr.startTime = nowSeconds();
+    sr.lastTime = sr.startTime;
+    sr.nextTime = sr.startTime + everySeconds;
+    sr.last = sim.stats;
+}
+
+static void writeSnapshot(SnapshotReporter &sr, const Simulator &sim, double now)
+{
+    const Stats &s = sim.stats;
+    unsigned int window = s.addressesProcessed - sr.last.addressesProcessed;
+    unsigned int hits = s.hits - sr.last.hits;
+    double seconds = now - sr.lastTime;
+
+    fprintf(sr.out,
+            "snapshot addresses=%u seconds=%.3f window_hits=%.2f%% "
+            "window_evictions=%u frames=%u table_bytes=%lu "
+            "accesses_per_sec=%.0f\n",
+            s.addressesProcessed, now - sr.startTime,
+            window ? 100.0 * hits / window : 0.0,
+            s.evictions - sr.last.evictions, sim.rs.nextFreeFrame,
+            (unsigned long)simulatorPageTableBytes(sim),
+            seconds > 0 ? window / seconds : 0.0);
+    fflush(sr.out);
+
+    sr.last = s;
+    sr.lastTime = now;
+}
+
+void snapshotAdvance(SnapshotReporter &sr, const Simulator &sim, size_t processed)
+{
+    bool due = false;
+    if (sr.everyAddresses) {
+        sr.untilNext -= processed;
+        if (sr.untilNext == 0) {
+            due = true;
+            sr.untilNext = sr.everyAddresses;
+        }
+    }
+
+    double now = sr.everySeconds > 0 || due ? nowSeconds() : 0;
+    if (sr.everySeconds > 0 && now >= sr.nextTime) {
+        due = true;
+    }
+    if (due) {
+        writeSnapshot(sr, sim, now);
+        sr.nextTime = now + sr.everySeconds;
+    }
+}
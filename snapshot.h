@@ -0,0 +1,40 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdio>
+#include "simulator.h"
+
+// Interval statistics for long runs (-i/-I): a one-line snapshot every
+// N addresses and/or T seconds, with the hit rate and evictions over the
+// window since the last snapshot and the current memory footprint.
+// The main loop processes the trace in segments that end exactly where
+// an address interval does, so no check is made per access; the clock is
+// read once per segment.
+struct SnapshotReporter {
+    FILE *out;
+    unsigned long everyAddresses;   // 0 when only timed
+    double everySeconds;            // 0 when only counted
+    unsigned long untilNext;        // addresses left before the next snapshot
+    double startTime;
+    double lastTime;
+    double nextTime;                // steady clock time of the next timed one
+    Stats last;                     // totals at the previous snapshot
+};
+
+// Start reporting on sim to out
+void initSnapshotReporter(SnapshotReporter &sr, FILE *out,
+                          unsigned long everyAddresses, double everySeconds,
+                          const Simulator &sim);
+
+// How many of the available records to process before calling
+// snapshotAdvance, so an address interval is never overrun
+inline size_t snapshotSegment(const SnapshotReporter &sr, size_t available)
+{
+    return sr.everyAddresses && sr.untilNext < available ? sr.untilNext : available;
+}
+
+// Account for processed records and write a snapshot if one is due
+void snapshotAdvance(SnapshotReporter &sr, const Simulator &sim, size_t processed);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,168 @@
+#include "stack_distance.h"
+#include <cmath>
+
+// Forward declarations for C functions
+extern "C" {
+    void log_mrc_header(unsigned int page_size,
+                        unsigned long int numOfAddresses,
+                        unsigned long int distinctPages,
+                        double sampleRate);
+    void log_mrc_point(unsigned long int frames, double missRatio);
+}
+
+// Smallest tree the engine renumbers into
+static const unsigned int MIN_TREE_POSITIONS = 1u << 16;
+
+// Sampling hashes are compared against a threshold out of 2^24
+static const unsigned int SAMPLE_HASH_BITS = 24;
+
+// Fenwick tree over positions
+
+static void treeAdd(std::vector<unsigned int> &tree, unsigned int pos, int delta)
+{
+    for (; pos < tree.size(); pos += pos & (0u - pos)) {
+        tree[pos] += delta;
+    }
+}
+
+// Marked positions in [1, pos]
+static unsigned int treePrefix(const std::vector<unsigned int> &tree, unsigned int pos)
+{
+    unsigned int sum = 0;
+    for (; pos > 0; pos -= pos & (0u - pos)) {
+        sum += tree[pos];
+    }
+    return sum;
+}
+
+// Renumber every page's last access to 1..pages in time order and
+// rebuild the tree with room for as many accesses again
+static void renumberPositions(StackDistance *sd)
+{
+    unsigned int positions = (unsigned int) sd->tree.size() - 1;
+    std::vector<unsigned int> byPos(positions + 1, UINT32_MAX);
+    for (unsigned int id = 0; id < sd->pageCount; id++) {
+        if (sd->lastPos[id] != 0) {
+            byPos[sd->lastPos[id]] = id;
+        }
+    }
+
+    unsigned int marked = 0;
+    for (unsigned int pos = 1; pos <= positions; pos++) {
+        if (byPos[pos] != UINT32_MAX) {
+            sd->lastPos[byPos[pos]] = ++marked;
+        }
+    }
+
+    unsigned int capacity = 2 * marked;
+    if (capacity < MIN_TREE_POSITIONS) capacity = MIN_TREE_POSITIONS;
+    sd->tree.assign(capacity + 1, 0);
+
+    // Marks fill 1..marked, so each node's count follows from its range
+    for (unsigned int i = 1; i <= capacity; i++) {
+        unsigned int lo = i - (i & (0u - i));
+        unsigned int hi = i < marked ? i : marked;
+        sd->tree[i] = hi > lo ? hi - lo : 0;
+    }
+    sd->nextPos = marked + 1;
+}
+
+// Create an engine
+StackDistance *createStackDistance(double sampleRate)
+{
+    StackDistance *sd = new StackDistance;
+    residentIndexInit(sd->pageIds, 1024);
+    sd->tree.assign(MIN_TREE_POSITIONS + 1, 0);
+    sd->nextPos = 1;
+    sd->pageCount = 0;
+    sd->histogram.assign(1, 0);
+    sd->coldMisses = 0;
+    sd->references = 0;
+    sd->sampled = 0;
+    sd->sampleRate = sampleRate;
+    sd->sampleThreshold =
+        (uint32_t) std::ceil(sampleRate * (double) (1u << SAMPLE_HASH_BITS));
+    return sd;
+}
+
+// Destroy an engine
+void destroyStackDistance(StackDistance *sd)
+{
+    delete sd;
+}
+
+// Well-mixed hash of a page number (murmur3 finalizer)
+static uint32_t sampleHash(vaddr_t fullVPN)
+{
+    uint32_t h = foldVPN(fullVPN);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h & ((1u << SAMPLE_HASH_BITS) - 1);
+}
+
+// Record an access to a page
+void stackDistanceAccess(StackDistance *sd, vaddr_t fullVPN)
+{
+    sd->references++;
+    if (sd->sampleRate < 1.0 && sampleHash(fullVPN) >= sd->sampleThreshold) {
+        return;
+    }
+    sd->sampled++;
+
+    int id = residentIndexFind(sd->pageIds, fullVPN);
+    if (id < 0) {
+        id = (int) sd->pageCount++;
+        sd->lastPos.push_back(0);
+        residentIndexInsert(sd->pageIds, fullVPN, id);
+        sd->coldMisses++;
+    } else {
+        // Every page is marked once, so the pages marked after this
+        // one are those accessed since, and the distance counts itself
+        unsigned int last = sd->lastPos[id];
+        unsigned int distance = sd->pageCount - treePrefix(sd->tree, last) + 1;
+        treeAdd(sd->tree, last, -1);
+        sd->lastPos[id] = 0;
+
+        size_t scaled = distance;
+        if (sd->sampleRate < 1.0) {
+            scaled = (size_t) std::llround(distance / sd->sampleRate);
+        }
+        if (scaled >= sd->histogram.size()) {
+            sd->histogram.resize(scaled + 1, 0);
+        }
+        sd->histogram[scaled]++;
+    }
+
+    if (sd->nextPos >= sd->tree.size()) {
+        renumberPositions(sd);
+    }
+    sd->lastPos[id] = sd->nextPos++;
+    treeAdd(sd->tree, sd->lastPos[id], 1);
+}
+
+// Print the miss ratio curve
+void logMissRatioCurve(const StackDistance *sd, unsigned int pageSize)
+{
+    double rate = sd->sampleRate;
+
+    // SHARDS adjustment: sampling keeps rate * references accesses only
+    // in expectation, so credit the difference to the smallest distance
+    double expected = (double) sd->references * rate;
+    double hits = expected - (double) sd->sampled;
+
+    log_mrc_header(pageSize, sd->references,
+                   (unsigned long) std::llround(sd->pageCount / rate), rate);
+    if (expected <= 0) return;
+
+    for (size_t d = 1; d < sd->histogram.size(); d++) {
+        if (sd->histogram[d] == 0) continue;
+        hits += (double) sd->histogram[d];
+        double missRatio = 1.0 - hits / expected;
+        if (missRatio < 0) missRatio = 0;
+        if (missRatio > 1) missRatio = 1;
+        log_mrc_point((unsigned long) d, missRatio);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef STACK_DISTANCE_H
+#define STACK_DISTANCE_H
+
+#include <cstdint>
+#include <vector>
+#include "replacement.h"
+
+// LRU stack distances over a fullVPN stream, giving the miss ratio at
+// every frame count from one pass.
+//
+// Each page is marked at the time of its last access in a Fenwick tree,
+// so the number of distinct pages touched since then is a suffix sum.
+// Times are renumbered when the tree fills, which bounds it by the
+// number of distinct pages rather than the trace length.
+//
+// With a sample rate below 1, only pages whose hash falls under the rate
+// are tracked (SHARDS spatial sampling) and distances are scaled up by
+// 1 / rate.
+struct StackDistance {
+    ResidentIndex pageIds;              // fullVPN -> page id
+    std::vector<unsigned int> lastPos;  // tree position of each page's last access
+    std::vector<unsigned int> tree;     // Fenwick tree over positions 1..size-1
+    unsigned int nextPos;               // position of the next access
+    unsigned int pageCount;             // distinct pages tracked
+
+    std::vector<uint64_t> histogram;    // [d] = reuses at (scaled) distance d
+    uint64_t coldMisses;                // first accesses of tracked pages
+    uint64_t references;                // all accesses seen
+    uint64_t sampled;                   // accesses to tracked pages
+
+    double sampleRate;                  // 1 means exact
+    uint32_t sampleThreshold;           // track pages hashing below this
+};
+
+// Create an engine; sampleRate must be in (0, 1]
+StackDistance *createStackDistance(double sampleRate);
+
+// Destroy an engine
+void destroyStackDistance(StackDistance *sd);
+
+// Record an access to a page
+void stackDistanceAccess(StackDistance *sd, vaddr_t fullVPN);
+
+// Print the miss ratio curve, one point per frame count where it changes
+void logMissRatioCurve(const StackDistance *sd, unsigned int pageSize);
+
+#endif // STACK_DISTANCE_H
@@ -0,0 +1,257 @@
+#include "sweep.h"
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include "instrument.h"
+#include "simulator.h"
+
+// Forward declarations for C functions
+extern "C" {
+    void log_sweep_config(unsigned int index, const char *config);
+}
+
+// Records each batch hands to every configuration
+static const size_t SWEEP_BATCH_RECORDS = 65536;
+
+// Parse one sweep line into config; returns an error message or nullptr
+static const char *parseSweepLine(char *line, SweepConfig &config)
+{
+    bool haveBits = false;
+    unsigned int sumBits = 0;
+
+    for (char *tok = strtok(line, " \t"); tok; tok = strtok(nullptr, " \t")) {
+        if (strcmp(tok, "-f") == 0 || strcmp(tok, "-b") == 0 ||
+            strcmp(tok, "-p") == 0 || strcmp(tok, "-t") == 0)
+        {
+            char flag = tok[1];
+            char *arg = strtok(nullptr, " \t");
+            if (!arg) {
+                return "Missing option argument";
+            }
+            if (flag == 'f') {
+                config.maxFrames = (unsigned int) atoi(arg);
+                if (config.maxFrames < 1) {
+                    return "Number of available frames must be a number and greater than 0";
+                }
+                if (strtoul(arg, nullptr, 10) > PTE_FRAME_COUNT) {
+                    return "Number of available frames is more than a page table entry can hold";
+                }
+            } else if (flag == 'b') {
+                config.bitInterval = (unsigned int) atoi(arg);
+                if (config.bitInterval < 1) {
+                    return "Bit string update interval must be a number and greater than 0";
+                }
+            } else if (flag == 'p') {
+                config.policy = findReplacementPolicy(arg);
+                if (!config.policy) {
+                    return "Unknown replacement policy";
+                }
+            } else if (!parseTlbSpec(arg, config.tlbEntries, config.tlbWays)) {
+                return "TLB entries must be a power-of-two multiple of its ways";
+            }
+            continue;
+        }
+        if (tok[0] == '-') {
+            return "Bad argument";
+        }
+
+        // Level bits replace the defaults as a whole
+        if (!haveBits) {
+            config.levelBits.clear();
+            haveBits = true;
+        }
+        unsigned int bits = (unsigned int) atoi(tok);
+        if (bits < 1) {
+            return "Page table levels must be at least 1 bit";
+        }
+        config.levelBits.push_back(bits);
+    }
+
+    if (config.levelBits.empty()) {
+        return "Missing level bits";
+    }
+    for (unsigned int bits : config.levelBits) {
+        sumBits += bits;
+    }
+    if (config.levelBits.size() > 32 || sumBits > VADDR_BITS - 4) {
+        return "Too many bits used in page tables";
+    }
+    if (VADDR_BITS - sumBits > 31) {
+        return "Too few bits used in page tables";
+    }
+    return nullptr;
+}
+
+// Read a sweep file
+bool loadSweepConfigs(const char *path,
+                      const SweepConfig &defaults,
+                      std::vector<SweepConfig> &configs)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return false;
+    }
+
+    char line[1024];
+    unsigned int lineNo = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        lineNo++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        const char *start = line + strspn(line, " \t");
+        if (*start == '\0' || *start == '#') {
+            continue;
+        }
+
+        SweepConfig config = defaults;
+        config.label = start;
+        const char *err = parseSweepLine(line, config);
+        if (err) {
+            fprintf(stderr, "%s:%u: %s\n", path, lineNo, err);
+            ok = false;
+        } else {
+            configs.push_back(config);
+        }
+    }
+    fclose(f);
+
+    if (ok && configs.empty()) {
+        fprintf(stderr, "%s: no configurations\n", path);
+        ok = false;
+    }
+    return ok;
+}
+
+// Workers simulate one batch at a time. Configurations are handed out
+// through a shared counter, so a slow configuration only holds up the
+// thread that took it.
+struct SweepPool {
+    std::vector<Simulator *> sims;
+    const p2AddrTr *batch;
+    size_t batchCount;
+    std::atomic<size_t> nextSim;
+
+    std::mutex lock;
+    std::condition_variable start;      // a new batch is ready
+    std::condition_variable finished;   // the last worker is done
+    unsigned long generation;           // batches published so far
+    unsigned int running;               // workers still on this batch
+    bool stop;
+};
+
+// Take configurations off the pool until the batch is done for all
+static void simulateBatchShare(SweepPool &pool)
+{
+    size_t i;
+    while ((i = pool.nextSim.fetch_add(1)) < pool.sims.size()) {
+        simulateBatch(*pool.sims[i], pool.batch, pool.batchCount);
+    }
+}
+
+static void sweepWorker(SweepPool *pool)
+{
+    unsigned long seen = 0;
+    while (1) {
+        {
+            std::unique_lock<std::mutex> guard(pool->lock);
+            pool->start.wait(guard, [&] {
+                return pool->stop || pool->generation != seen;
+            });
+            if (pool->stop) return;
+            seen = pool->generation;
+        }
+
+        simulateBatchShare(*pool);
+
+        std::lock_guard<std::mutex> guard(pool->lock);
+        if (--pool->running == 0) {
+            pool->finished.notify_one();
+        }
+    }
+}
+
+// Run a sweep
+void runSweep(TraceReader *reader,
+              TracePrefetcher *prefetch,
+              const std::vector<SweepConfig> &configs,
+              unsigned int threads,
+              unsigned int limitN)
+{
+    SweepPool pool;
+    for (const SweepConfig &c : configs) {
+        pool.sims.push_back(createSimulator((unsigned int) c.levelBits.size(),
+                                            c.levelBits.data(),
+                                            c.maxFrames, c.bitInterval,
+                                            c.policy, c.tlbEntries, c.tlbWays));
+    }
+    pool.batch = nullptr;
+    pool.batchCount = 0;
+    pool.nextSim = 0;
+    pool.generation = 0;
+    pool.running = 0;
+    pool.stop = false;
+
+    // The calling thread takes a share of every batch too
+    if (threads > configs.size()) {
+        threads = (unsigned int) configs.size();
+    }
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < threads; t++) {
+        workers.emplace_back(sweepWorker, &pool);
+    }
+
+    // Decode each batch once and feed it to every configuration
+    unsigned long processed = 0;
+    while (limitN == 0 || processed < limitN) {
+        size_t want = SWEEP_BATCH_RECORDS;
+        if (prefetch) want = SIZE_MAX;
+        if (limitN != 0 && limitN - processed < want) {
+            want = limitN - processed;
+        }
+
+        const p2AddrTr *batch;
+        INSTRUMENT_TIMER_START(readStart);
+        size_t batchCount = nextTraceBatch(reader, prefetch, want, &batch);
+        INSTRUMENT_TIMER_STOP(IT_TRACE_READ, readStart);
+        if (batchCount == 0) break; // EOF
+        processed += batchCount;
+
+        pool.batch = batch;
+        pool.batchCount = batchCount;
+        pool.nextSim = 0;
+        {
+            std::lock_guard<std::mutex> guard(pool.lock);
+            pool.generation++;
+            pool.running = (unsigned int) workers.size();
+        }
+        pool.start.notify_all();
+
+        simulateBatchShare(pool);
+
+        std::unique_lock<std::mutex> guard(pool.lock);
+        pool.finished.wait(guard, [&] { return pool.running == 0; });
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(pool.lock);
+        pool.stop = true;
+    }
+    pool.start.notify_all();
+    for (std::thread &w : workers) {
+        w.join();
+    }
+
+    for (size_t i = 0; i < configs.size(); i++) {
+        log_sweep_config((unsigned int) i + 1, configs[i].label.c_str());
+        logSimulatorSummary(*pool.sims[i]);
+        destroySimulator(pool.sims[i]);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <string>
+#include <vector>
+#include "replacement.h"
+#include "trace_prefetch.h"
+#include "vaddr_tracereader.h"
+
+// One configuration of a sweep
+struct SweepConfig {
+    std::string label;                  // line it was read from
+    unsigned int maxFrames;             // UINT_MAX means infinite
+    unsigned int bitInterval;
+    const ReplacementPolicy *policy;    // nullptr means aging
+    unsigned int tlbEntries;            // 0 means no TLB
+    unsigned int tlbWays;
+    std::vector<unsigned int> levelBits;
+};
+
+// Read a sweep file. Each line is one configuration written like the
+// command line, "[-f frames] [-b interval] [-p policy] [-t entries[:ways]]
+// [bits...]";
+// anything a line leaves out is taken from defaults. Blank lines and
+// lines starting with '#' are skipped. Prints an error and returns false
+// on a bad line.
+bool loadSweepConfigs(const char *path,
+                      const SweepConfig &defaults,
+                      std::vector<SweepConfig> &configs);
+
+// Simulate every configuration over a single pass of the trace, spread
+// over the given number of threads, then print one summary per
+// configuration in file order. limitN == 0 reads the whole trace;
+// prefetch may be nullptr.
+void runSweep(TraceReader *reader,
+              TracePrefetcher *prefetch,
+              const std::vector<SweepConfig> &configs,
+              unsigned int threads,
+              unsigned int limitN);
+
+#endif // SWEEP_H
@@ -0,0 +1,163 @@
+#include "tlb.h"
+#include <cstdlib>
+#include <cstring>
+
+// Create a TLB
+Tlb *createTlb(unsigned int entryCount, unsigned int ways)
+{
+    if (entryCount == 0 || ways == 0 || entryCount % ways != 0) {
+        return nullptr;
+    }
+    unsigned int setCount = entryCount / ways;
+    if ((setCount & (setCount - 1)) != 0) {
+        return nullptr;
+    }
+
+    Tlb *tlb = new Tlb;
+    tlb->entryCount = entryCount;
+    tlb->ways = ways;
+    tlb->setCount = setCount;
+    tlb->setMask = setCount - 1;
+    tlb->entries = new TlbEntry[entryCount];
+    for (unsigned int i = 0; i < entryCount; i++) {
+        tlb->entries[i].fullVPN = 0;
+        tlb->entries[i].frameNumber = -1;
+        tlb->entries[i].lastUse = 0;
+        tlb->entries[i].valid = false;
+        tlb->entries[i].spanBits = 0;
+    }
+    tlb->useClock = 0;
+    tlb->spanSizes = 0;
+    tlb->hits = 0;
+    tlb->misses = 0;
+    tlb->largeHits = 0;
+    return tlb;
+}
+
+// Parse a TLB option
+bool parseTlbSpec(const char *spec, unsigned int &entries, unsigned int &ways)
+{
+    const char *colon = strchr(spec, ':');
+    entries = (unsigned int) atoi(spec);
+    ways = 4;
+    if (colon) {
+        ways = (unsigned int) atoi(colon + 1);
+    } else if (entries < ways) {
+        ways = entries; // small TLBs are fully associative
+    }
+    return entries > 0 && ways > 0 && entries % ways == 0 &&
+           ((entries / ways) & (entries / ways - 1)) == 0;
+}
+
+// Destroy a TLB
+void destroyTlb(Tlb *tlb)
+{
+    if (!tlb) return;
+    delete [] tlb->entries;
+    delete tlb;
+}
+
+// First entry of the set a page maps to
+static TlbEntry *tlbSet(Tlb *tlb, vaddr_t fullVPN)
+{
+    return &tlb->entries[(fullVPN & tlb->setMask) * tlb->ways];
+}
+
+// Entry of a set caching page fullVPN at the given span, nullptr if none
+static TlbEntry *tlbFind(Tlb *tlb, vaddr_t fullVPN, unsigned int spanBits)
+{
+    TlbEntry *set = tlbSet(tlb, fullVPN >> spanBits);
+    for (unsigned int w = 0; w < tlb->ways; w++) {
+        if (set[w].valid && set[w].fullVPN == fullVPN &&
+            set[w].spanBits == spanBits)
+        {
+            return &set[w];
+        }
+    }
+    return nullptr;
+}
+
+// Look up a translation
+int tlbLookup(Tlb *tlb, vaddr_t fullVPN)
+{
+    TlbEntry *e = tlbFind(tlb, fullVPN, 0);
+    if (e) {
+        e->lastUse = ++tlb->useClock;
+        tlb->hits++;
+        return e->frameNumber;
+    }
+
+    for (uint32_t spans = tlb->spanSizes; spans; spans &= spans - 1) {
+        unsigned int s = (unsigned int)__builtin_ctz(spans);
+        unsigned int offset = (unsigned int)fullVPN & ((1u << s) - 1);
+        e = tlbFind(tlb, fullVPN - offset, s);
+        if (e) {
+            e->lastUse = ++tlb->useClock;
+            tlb->hits++;
+            tlb->largeHits++;
+            return e->frameNumber + (int)offset;
+        }
+    }
+    tlb->misses++;
+    return -1;
+}
+
+// Cache a translation
+void tlbInsert(Tlb *tlb, vaddr_t fullVPN, int frameNumber,
+               unsigned int spanBits)
+{
+    if (spanBits) {
+        unsigned int offset = (unsigned int)fullVPN & ((1u << spanBits) - 1);
+        fullVPN -= offset;
+        frameNumber -= (int)offset;
+        tlb->spanSizes |= 1u << spanBits;
+    }
+    TlbEntry *set = tlbSet(tlb, fullVPN >> spanBits);
+
+    // Prefer an existing entry for the page, then a free one, then LRU
+    TlbEntry *slot = &set[0];
+    for (unsigned int w = 0; w < tlb->ways; w++) {
+        if (set[w].valid && set[w].fullVPN == fullVPN &&
+            set[w].spanBits == spanBits)
+        {
+            slot = &set[w];
+            break;
+        }
+        if (!set[w].valid) {
+            if (slot->valid) slot = &set[w];
+        } else if (slot->valid && set[w].lastUse < slot->lastUse) {
+            slot = &set[w];
+        }
+    }
+
+    slot->fullVPN = fullVPN;
+    slot->frameNumber = frameNumber;
+    slot->lastUse = ++tlb->useClock;
+    slot->valid = true;
+    slot->spanBits = (uint8_t)spanBits;
+}
+
+// Drop the translation for a page
+void tlbInvalidate(Tlb *tlb, vaddr_t fullVPN)
+{
+    TlbEntry *e = tlbFind(tlb, fullVPN, 0);
+    if (e) e->valid = false;
+
+    for (uint32_t spans = tlb->spanSizes; spans; spans &= spans - 1) {
+        unsigned int s = (unsigned int)__builtin_ctz(spans);
+        e = tlbFind(tlb, fullVPN & ~(vaddr_t)((1u << s) - 1), s);
+        if (e) e->valid = false;
+    }
+}
+
+// Pages the valid entries cover
+unsigned long tlbReach(const Tlb *tlb)
+{
+    unsigned long pages = 0;
+    for (unsigned int i = 0; i < tlb->entryCount; i++) {
+        if (tlb->entries[i].valid) {
+            pages += 1ul << tlb->entries[i].spanBits;
+        }
+    }
+    return pages;
+}
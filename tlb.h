@@ -0,0 +1,61 @@
+#ifndef TLB_H
+#define TLB_H
+
+#include <cstdint>
+#include "vaddr_tracereader.h" // for vaddr_t
+
+// One cached translation. A large page entry covers 2^spanBits pages from
+// fullVPN (aligned) onwards, backed by the frames from frameNumber on.
+struct TlbEntry {
+    vaddr_t fullVPN;        // page number of the translation
+    int frameNumber;        // frame it maps to
+    unsigned int lastUse;   // LRU stamp within the set
+    bool valid;             // true if the entry holds a translation
+    uint8_t spanBits;       // 0 for a single page
+};
+
+// Set-associative fullVPN -> PFN cache in front of the page table walk
+struct Tlb {
+    unsigned int entryCount;    // total entries (setCount * ways)
+    unsigned int ways;          // entries per set
+    unsigned int setCount;      // number of sets, a power of two
+    unsigned int setMask;       // setCount - 1
+    TlbEntry *entries;          // [setCount * ways], set-major
+    unsigned int useClock;      // source of LRU stamps
+    uint32_t spanSizes;         // bit s set once a 2^s page was cached
+
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long largeHits;    // hits on large page entries
+};
+
+// Create a TLB; entryCount must be a multiple of ways and
+// entryCount / ways a power of two. Returns nullptr otherwise.
+Tlb *createTlb(unsigned int entryCount, unsigned int ways);
+
+// Parse a "<entries>[:<ways>]" TLB option into entries and ways. Without
+// ways the TLB is 4-way, or fully associative below 4 entries. Returns
+// false if createTlb would reject the result.
+bool parseTlbSpec(const char *spec, unsigned int &entries, unsigned int &ways);
+
+// Destroy a TLB
+void destroyTlb(Tlb *tlb);
+
+// Look up a translation; returns the frame or -1 on a miss. Large page
+// entries are found in the set of their page number shifted by their
+// span, so each page size in use costs one more set probe on a miss.
+int tlbLookup(Tlb *tlb, vaddr_t fullVPN);
+
+// Cache a translation, replacing the LRU entry of its set. With spanBits,
+// it is the large page of 2^spanBits pages that fullVPN lies in.
+void tlbInsert(Tlb *tlb, vaddr_t fullVPN, int frameNumber,
+               unsigned int spanBits = 0);
+
+// Drop the translation for a page, if cached, and any large page entry
+// covering it
+void tlbInvalidate(Tlb *tlb, vaddr_t fullVPN);
+
+// Pages the valid entries cover
+unsigned long tlbReach(const Tlb *tlb);
+
+#endif // TLB_H
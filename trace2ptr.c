@@ -0,0 +1,107 @@
+/* trace2ptr - convert a BYU address trace (.tr) to the compressed page
+ * trace format (.ptr) described in compressed_trace.h.
+ *
+ * usage: trace2ptr [-o offsetBits] [-m] [-B blockRecords] input output
+ *   -o  page/offset split used for encoding (default 12)
+ *   -m  keep reqtype and proc in each record
+ *   -B  records per independently decodable block
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "vaddr_tracereader.h"
+#include "compressed_trace.h"
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-o offsetBits] [-m] [-B blockRecords] input output\n",
+          prog);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+
+  int opt;
+  int offsetBits = 12;
+  int keepMeta = 0;
+  long blockRecords = PTR_DEFAULT_BLOCK_RECORDS;
+  TraceReader *reader;
+  FILE *out;
+  PtrWriter *writer;
+  const p2AddrTr *span;
+  size_t n, i;
+  unsigned long long records = 0;
+  long outBytes;
+
+  while ((opt = getopt(argc, argv, "o:mB:")) != -1) {
+    switch (opt) {
+      case 'o':
+        offsetBits = atoi(optarg);
+        if (offsetBits < 0 || offsetBits > 31) {
+          fprintf(stderr, "Offset bits must be between 0 and 31\n");
+          return 1;
+        }
+        break;
+      case 'm':
+        keepMeta = 1;
+        break;
+      case 'B':
+        blockRecords = atol(optarg);
+        if (blockRecords < 1) {
+          fprintf(stderr, "Block size must be greater than 0\n");
+          return 1;
+        }
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (argc - optind != 2)
+    usage(argv[0]);
+
+  reader = OpenTraceReader(argv[optind]);
+  if (reader == NULL) {
+    fprintf(stderr, "Unable to open %s\n", argv[optind]);
+    return 1;
+  }
+  out = fopen(argv[optind + 1], "wb");
+  if (out == NULL) {
+    fprintf(stderr, "Unable to create %s\n", argv[optind + 1]);
+    CloseTraceReader(reader);
+    return 1;
+  }
+
+  writer = PtrOpenWriter(out, (unsigned int) offsetBits, keepMeta,
+                         (uint32_t) blockRecords);
+  if (writer == NULL) {
+    fprintf(stderr, "Unable to start %s\n", argv[optind + 1]);
+    return 1;
+  }
+
+  while ((n = NextAddressBatch(reader, &span, 65536)) > 0) {
+    for (i = 0; i < n; i++) {
+      if (!PtrWriteRecord(writer, &span[i])) {
+        fprintf(stderr, "Write to %s failed\n", argv[optind + 1]);
+        return 1;
+      }
+    }
+    records += n;
+  }
+
+  if (!PtrCloseWriter(writer)) {
+    fprintf(stderr, "Write to %s failed\n", argv[optind + 1]);
+    return 1;
+  }
+  fseek(out, 0, SEEK_END);
+  outBytes = ftell(out);
+  fclose(out);
+  CloseTraceReader(reader);
+
+  fprintf(stderr, "%llu records, %llu bytes raw -> %ld bytes (%.2fx)\n",
+          records, records * (unsigned long long) sizeof(p2AddrTr), outBytes,
+          outBytes > 0
+            ? (double) (records * sizeof(p2AddrTr)) / (double) outBytes
+            : 0.0);
+  return 0;
+}
@@ -0,0 +1,146 @@
+#include "trace_prefetch.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// One slot of the ring
+struct PrefetchBuffer {
+    std::vector<p2AddrTr> records;
+    size_t count;
+};
+
+// Single-producer/single-consumer ring. The producer owns slots in
+// [tail, head + free) and publishes by advancing head; the consumer owns
+// the slot at tail - 1 it is processing and releases it by advancing tail.
+// Each index is written by one thread only, so no locks are needed.
+struct TracePrefetcher {
+    TraceReader *reader;
+    std::vector<PrefetchBuffer> ring;
+
+    alignas(64) std::atomic<size_t> head;  // buffers published
+    alignas(64) std::atomic<size_t> tail;  // buffers released
+    std::atomic<bool> done;                // producer hit end of trace
+    std::atomic<bool> stop;                // consumer asked producer to quit
+
+    size_t taken;                          // buffers handed to consumer
+    unsigned long waits;                   // times consumer found ring empty
+    double waitSeconds;                    // total time spent waiting
+
+    std::thread producer;
+};
+
+static void producerLoop(TracePrefetcher *pf)
+{
+    size_t slots = pf->ring.size();
+
+    while (!pf->stop.load(std::memory_order_relaxed)) {
+        size_t h = pf->head.load(std::memory_order_relaxed);
+
+        // Wait for a free slot
+        if (h - pf->tail.load(std::memory_order_acquire) == slots) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        PrefetchBuffer &buf = pf->ring[h % slots];
+        size_t filled = 0;
+        while (filled < buf.records.size()) {
+            const p2AddrTr *span;
+            size_t n = NextAddressBatch(pf->reader, &span,
+                                        buf.records.size() - filled);
+            if (n == 0) break;
+            memcpy(&buf.records[filled], span, n * sizeof(p2AddrTr));
+            filled += n;
+        }
+        buf.count = filled;
+
+        if (filled > 0) {
+            pf->head.store(h + 1, std::memory_order_release);
+        }
+        if (filled < buf.records.size()) {
+            break; // end of trace
+        }
+    }
+    pf->done.store(true, std::memory_order_release);
+}
+
+TracePrefetcher *startTracePrefetch(TraceReader *reader,
+                                    size_t bufferRecords,
+                                    unsigned int bufferCount)
+{
+    TracePrefetcher *pf = new TracePrefetcher;
+    pf->reader = reader;
+    pf->ring.resize(bufferCount < 2 ? 2 : bufferCount);
+    for (auto &buf : pf->ring) {
+        buf.records.resize(bufferRecords);
+        buf.count = 0;
+    }
+    pf->head.store(0);
+    pf->tail.store(0);
+    pf->done.store(false);
+    pf->stop.store(false);
+    pf->taken = 0;
+    pf->waits = 0;
+    pf->waitSeconds = 0;
+
+    pf->producer = std::thread(producerLoop, pf);
+    return pf;
+}
+
+size_t nextPrefetchedBatch(TracePrefetcher *pf, const p2AddrTr **span)
+{
+    // Release the buffer handed out last time
+    pf->tail.store(pf->taken, std::memory_order_release);
+
+    if (pf->head.load(std::memory_order_acquire) == pf->taken) {
+        auto start = std::chrono::steady_clock::now();
+        bool ended = false;
+        while (pf->head.load(std::memory_order_acquire) == pf->taken) {
+            // done is set after the last publish, so recheck head after it
+            if (pf->done.load(std::memory_order_acquire)) {
+                ended = (pf->head.load(std::memory_order_acquire) == pf->taken);
+                break;
+            }
+            std::this_thread::yield();
+        }
+        std::chrono::duration<double> waited =
+            std::chrono::steady_clock::now() - start;
+        if (ended) return 0;
+
+        pf->waits++;
+        pf->waitSeconds += waited.count();
+    }
+
+    PrefetchBuffer &buf = pf->ring[pf->taken % pf->ring.size()];
+    pf->taken++;
+    *span = buf.records.data();
+    return buf.count;
+}
+
+void stopTracePrefetch(TracePrefetcher *pf)
+{
+    if (!pf) return;
+    pf->stop.store(true, std::memory_order_relaxed);
+    pf->producer.join();
+    delete pf;
+}
+
+size_t nextTraceBatch(TraceReader *reader, TracePrefetcher *pf,
+                      size_t max, const p2AddrTr **span)
+{
+    size_t n = pf ? nextPrefetchedBatch(pf, span)
+                  : NextAddressBatch(reader, span, max);
+    return n < max ? n : max;
+}
+
+unsigned long prefetchWaitCount(const TracePrefetcher *pf)
+{
+    return pf->waits;
+}
+
+double prefetchWaitSeconds(const TracePrefetcher *pf)
+{
+    return pf->waitSeconds;
+}
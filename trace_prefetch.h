@@ -0,0 +1,33 @@
+#ifndef TRACE_PREFETCH_H
+#define TRACE_PREFETCH_H
+
+#include <cstddef>
+#include "vaddr_tracereader.h"
+
+struct TracePrefetcher;
+
+// Start a producer thread that fills a ring of bufferCount buffers of
+// bufferRecords records each from the reader, ahead of the consumer.
+// The reader must not be used by anyone else until the prefetcher stops.
+TracePrefetcher *startTracePrefetch(TraceReader *reader,
+                                    size_t bufferRecords,
+                                    unsigned int bufferCount);
+
+// Hand the next filled buffer to the consumer, waiting if the producer
+// is behind. Releases the previously returned buffer. Returns 0 at the
+// end of the trace.
+size_t nextPrefetchedBatch(TracePrefetcher *pf, const p2AddrTr **span);
+
+// Stop the producer (even mid-trace) and release the prefetcher
+void stopTracePrefetch(TracePrefetcher *pf);
+
+// Next batch of at most max records, from the prefetcher if there is one
+// and straight from the reader otherwise. Returns 0 at the end of the trace.
+size_t nextTraceBatch(TraceReader *reader, TracePrefetcher *pf,
+                      size_t max, const p2AddrTr **span);
+
+// Consumer stall statistics
+unsigned long prefetchWaitCount(const TracePrefetcher *pf);
+double prefetchWaitSeconds(const TracePrefetcher *pf);
+
+#endif // TRACE_PREFETCH_H
@@ -1,5 +1,12 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "vaddr_tracereader.h"
+#include "compressed_trace.h"
 
 
 /*
@@ -13,6 +20,17 @@ uint32_t swap_endian(uint32_t num)
   ((num >> 8) & 0x0000ff00) | ((num >> 24) & 0x000000ff) );
 }
 
+/* swap_endian for a trace address, which may be 64 bits wide */
+static vaddr_t swap_vaddr(vaddr_t addr)
+{
+#if VADDR_BITS == 64
+  return ((vaddr_t) swap_endian((uint32_t) addr) << 32) |
+    swap_endian((uint32_t) (addr >> 32));
+#else
+  return swap_endian(addr);
+#endif
+}
+
 /* determine if system is big- or little- endian */
 ENDIAN endian()
 {
@@ -61,7 +79,7 @@ int NextAddress(FILE *trace_file, p2AddrTr *addr_ptr) {
     
     if (byte_order == BIG) {
       /* records stored in little endian format, convert */
-      addr_ptr->addr = swap_endian(addr_ptr->addr);
+      addr_ptr->addr = swap_vaddr(addr_ptr->addr);
       addr_ptr->time = swap_endian(addr_ptr->time);
     }
   }
@@ -69,13 +87,294 @@ int NextAddress(FILE *trace_file, p2AddrTr *addr_ptr) {
   return readN;    
 }
 
+/* Records per read() when the trace cannot be memory-mapped */
+#define TRACE_CHUNK_RECORDS 65536
+
+struct TraceReader {
+  int fd;                 /* trace file descriptor */
+  ENDIAN byte_order;      /* host byte order */
+
+  /* whole trace in memory: an mmap of a regular file, or a compressed
+   * stream read into a malloc'd buffer */
+  const unsigned char *image;   /* NULL if not in memory */
+  size_t image_bytes;
+  int image_owned;              /* image was malloc'd rather than mapped */
+
+  /* raw BYU traces in memory */
+  size_t count;           /* whole records in the image */
+  size_t next;            /* next record to hand out */
+
+  /* compressed (.ptr) traces */
+  int compressed;
+  PtrDecoder decoder;
+
+  /* chunk buffer: reads when unmapped, decoded records for compressed
+   * traces, byte-swapped copies on big-endian */
+  p2AddrTr *buffer;
+  size_t buffer_records;
+
+  /* bytes read from an unmapped stream to sniff its format */
+  unsigned char prefix[4];
+  size_t prefix_len;
+};
+
+/* Read up to len bytes, retrying short reads; returns bytes read */
+static size_t ReadFully(int fd, unsigned char *dst, size_t len) {
+
+  size_t have = 0;
+
+  while (have < len) {
+    ssize_t got = read(fd, dst + have, len - have);
+    if (got <= 0)
+      break;
+    have += (size_t) got;
+  }
+  return have;
+}
+
+/* Read the rest of a stream into memory after the sniffed prefix */
+static int SlurpStream(TraceReader *reader) {
+
+  size_t cap = 1 << 20;
+  size_t len = reader->prefix_len;
+  unsigned char *buf = (unsigned char *) malloc(cap);
+
+  if (buf == NULL)
+    return 0;
+  memcpy(buf, reader->prefix, len);
+  reader->prefix_len = 0;
+
+  while (1) {
+    size_t got;
+    if (len == cap) {
+      unsigned char *grown = (unsigned char *) realloc(buf, cap * 2);
+      if (grown == NULL) {
+        free(buf);
+        return 0;
+      }
+      buf = grown;
+      cap *= 2;
+    }
+    got = ReadFully(reader->fd, buf + len, cap - len);
+    len += got;
+    if (len < cap)
+      break;  /* end of stream */
+  }
+
+  reader->image = buf;
+  reader->image_bytes = len;
+  reader->image_owned = 1;
+  return 1;
+}
+
+/* TraceReader *OpenTraceReader(const char *path)
+ * Open a trace file for bulk reading.  The format is sniffed from the
+ * first bytes: compressed .ptr traces start with PTR_MAGIC, anything
+ * else is read as raw BYU records.  Regular files are mmapped; raw
+ * traces on pipes or devices are read in TRACE_CHUNK_RECORDS chunks.
+ */
+TraceReader *OpenTraceReader(const char *path) {
+
+  struct stat st;
+  TraceReader *reader;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    return NULL;
+
+  reader = (TraceReader *) calloc(1, sizeof(TraceReader));
+  if (reader == NULL) {
+    close(fd);
+    return NULL;
+  }
+  reader->fd = fd;
+  reader->byte_order = endian();
+
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      madvise(p, (size_t) st.st_size, MADV_SEQUENTIAL);
+      reader->image = (const unsigned char *) p;
+      reader->image_bytes = (size_t) st.st_size;
+    }
+  }
+
+  if (reader->image == NULL) {
+    /* a stream: sniff it, and keep compressed ones in memory */
+    reader->prefix_len = ReadFully(fd, reader->prefix, sizeof(reader->prefix));
+    if (PtrIsCompressed(reader->prefix, reader->prefix_len) &&
+        !SlurpStream(reader)) {
+      CloseTraceReader(reader);
+      return NULL;
+    }
+  }
+
+  if (reader->image != NULL &&
+      PtrIsCompressed(reader->image, reader->image_bytes)) {
+    PtrHeader hdr;
+    if (!PtrParseHeader(reader->image, reader->image_bytes, &hdr)) {
+      fprintf(stderr, "%s: unsupported or corrupt compressed trace header\n",
+              path);
+      CloseTraceReader(reader);
+      return NULL;
+    }
+    reader->compressed = 1;
+    PtrDecoderInit(&reader->decoder, reader->image, reader->image_bytes, &hdr);
+  } else if (reader->image != NULL) {
+    reader->count = reader->image_bytes / sizeof(p2AddrTr);
+  }
+
+  /* Everything except raw mapped traces on little-endian hosts is
+   * produced into the chunk buffer */
+  if (reader->image == NULL || reader->compressed ||
+      reader->byte_order == BIG) {
+    reader->buffer_records = TRACE_CHUNK_RECORDS;
+    reader->buffer = (p2AddrTr *) malloc(TRACE_CHUNK_RECORDS * sizeof(p2AddrTr));
+    if (reader->buffer == NULL) {
+      CloseTraceReader(reader);
+      return NULL;
+    }
+  }
+
+  return reader;
+}
+
+/* Fill the chunk buffer from the file descriptor, returning whole records.
+ * Reads until the chunk is full, so only the end of the trace can leave a
+ * partial record, which is dropped just as fread would.
+ */
+static size_t ReadChunk(TraceReader *reader, size_t max) {
+
+  unsigned char *dst = (unsigned char *) reader->buffer;
+  size_t want = max * sizeof(p2AddrTr);
+  size_t have = reader->prefix_len;
+
+  /* hand out the sniffed bytes first */
+  memcpy(dst, reader->prefix, reader->prefix_len);
+  reader->prefix_len = 0;
+
+  have += ReadFully(reader->fd, dst + have, want - have);
+  return have / sizeof(p2AddrTr);
+}
+
+/* size_t NextAddressBatch(TraceReader *reader, const p2AddrTr **span,
+ *                         size_t max)
+ * Fetch up to max records from the trace.  On little-endian hosts a
+ * mapped raw trace is handed out in place; otherwise records are decoded
+ * or copied into the reader's buffer and byte-swapped in one pass if
+ * needed.
+ */
+size_t NextAddressBatch(TraceReader *reader, const p2AddrTr **span,
+                        size_t max) {
+
+  size_t n, i;
+  p2AddrTr *out;
+
+  if (reader->buffer_records && max > reader->buffer_records)
+    max = reader->buffer_records;
+
+  if (reader->compressed) {
+    /* decoded values are already in host order */
+    n = PtrDecode(&reader->decoder, reader->buffer, max);
+    *span = reader->buffer;
+    return n;
+  }
+
+  if (reader->image != NULL) {
+    const p2AddrTr *records = (const p2AddrTr *) reader->image;
+
+    n = reader->count - reader->next;
+    if (n > max)
+      n = max;
+    if (n == 0)
+      return 0;
+
+    if (reader->byte_order != BIG) {
+      *span = records + reader->next;
+      reader->next += n;
+      return n;
+    }
+
+    memcpy(reader->buffer, records + reader->next, n * sizeof(p2AddrTr));
+    reader->next += n;
+  } else {
+    n = ReadChunk(reader, max);
+    if (n == 0)
+      return 0;
+  }
+
+  out = reader->buffer;
+  if (reader->byte_order == BIG) {
+    /* records stored in little endian format, convert */
+    for (i = 0; i < n; i++) {
+      out[i].addr = swap_vaddr(out[i].addr);
+      out[i].time = swap_endian(out[i].time);
+    }
+  }
+
+  *span = out;
+  return n;
+}
+
+/* size_t SkipAddresses(TraceReader *reader, size_t count)
+ * Move past count records, as when a run resumes from a checkpoint.
+ * Mapped raw traces move their cursor and compressed traces seek through
+ * the block index; streams are read and dropped a chunk at a time.
+ */
+size_t SkipAddresses(TraceReader *reader, size_t count) {
+
+  size_t skipped = 0;
+
+  if (reader->compressed) {
+    uint64_t left = reader->decoder.hdr.recordCount - reader->decoder.next;
+    if (count > left)
+      count = (size_t) left;
+    if (!PtrDecoderSeek(&reader->decoder, reader->decoder.next + count))
+      return 0;
+    return count;
+  }
+
+  if (reader->image != NULL) {
+    if (count > reader->count - reader->next)
+      count = reader->count - reader->next;
+    reader->next += count;
+    return count;
+  }
+
+  while (skipped < count) {
+    size_t want = count - skipped;
+    size_t n = ReadChunk(reader, want < reader->buffer_records
+                                 ? want : reader->buffer_records);
+    if (n == 0)
+      break;
+    skipped += n;
+  }
+  return skipped;
+}
+
+/* void CloseTraceReader(TraceReader *reader)
+ * Release the reader, its mapping or buffers, and the file.
+ */
+void CloseTraceReader(TraceReader *reader) {
+
+  if (reader == NULL)
+    return;
+  if (reader->image_owned)
+    free((void *) reader->image);
+  else if (reader->image != NULL)
+    munmap((void *) reader->image, reader->image_bytes);
+  free(reader->buffer);
+  close(reader->fd);
+  free(reader);
+}
+
 /* void AddressDecoder(p2AddrTr *addr_ptr, FILE *out)
  * Decode a Pentium II BYU address and print to the specified
  * file handle (opened by fopen in write mode)
  */
 void AddressDecoder(p2AddrTr *addr_ptr, FILE *out) {
   
-  fprintf(out, "%08lx ", (long unsigned int) addr_ptr->addr);	/* address */
+  fprintf(out, "%08llx ", (unsigned long long) addr_ptr->addr);	/* address */
   /* what type of address request */
   switch (addr_ptr->reqtype) {
     case FETCH:
@@ -1,3 +1,6 @@
+#ifndef VADDR_TRACEREADER_H
+#define VADDR_TRACEREADER_H
+
 
 /* C and C++ define some of their types in different places.
  * Check and see if we are using C or C++ and include appropriately
@@ -10,11 +13,29 @@
 /* C includes */
 #include <inttypes.h>
 #endif 
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
+/* Virtual addresses, and the page numbers taken from them, are 32 bits
+ * wide.  Building every file with -DPAGING_VA64 makes them 64 bits wide
+ * instead, for traces from 64-bit hosts: trace records then hold a 64-bit
+ * addr (16 bytes, same fields in the same order).
+ */
+#ifdef PAGING_VA64
+typedef uint64_t vaddr_t;
+#define VADDR_BITS 64
+#else
+typedef uint32_t vaddr_t;
+#define VADDR_BITS 32
+#endif
 
 typedef struct BYUADDRESSTRACE
 {
-  uint32_t addr;
+  vaddr_t addr;
   unsigned char reqtype;
   unsigned char size;
   unsigned char attr;
@@ -34,6 +55,35 @@ typedef enum {
  */
 int NextAddress(FILE *trace_file, p2AddrTr *addr_ptr);
 
+/* Bulk trace reader.  Maps the trace file into memory (or reads it in
+ * large chunks when it cannot be mapped) and hands out spans of records.
+ */
+typedef struct TraceReader TraceReader;
+
+/* OpenTraceReader - Open a trace file for bulk reading.
+ * Returns NULL if the file cannot be opened.
+ */
+TraceReader *OpenTraceReader(const char *path);
+
+/* NextAddressBatch - Fetch up to max records.
+ * Points *span at the records and returns how many there are, 0 at the
+ * end of the trace.  The span stays valid until the next call.
+ */
+size_t NextAddressBatch(TraceReader *reader, const p2AddrTr **span,
+                        size_t max);
+
+/* SkipAddresses - Move past count records without handing them out.
+ * Returns how many were skipped, fewer only at the end of the trace.
+ */
+size_t SkipAddresses(TraceReader *reader, size_t count);
+
+/* CloseTraceReader - Release the reader and its file. */
+void CloseTraceReader(TraceReader *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
 /* reqtype values */
 #define FETCH			0x00	// instruction fetch
 #define MEMREAD			0x01	// memory read
@@ -55,5 +105,5 @@ int NextAddress(FILE *trace_file, p2AddrTr *addr_ptr);
 #define FLUSHACK		0x35	// acknowledge flush
 #define STOPCLKACK		0x36	// acknowledge stop clock
 #define SMIACK			0x37	// acknowledge SMI mode
-						
 
+#endif /* VADDR_TRACEREADER_H */